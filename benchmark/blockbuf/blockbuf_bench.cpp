@@ -0,0 +1,112 @@
+/**
+ * Pending output of a connection with a large backlog, Buffer against BlockBuffer. The producer keeps
+ * appending chunks while a pipe, drained by one chunk per round, takes what it can of the front, so the
+ * backlog stays around its initial size. Buffer writes from peek() and moves or grows its vector to make
+ * room, BlockBuffer writes blocks with writev and never moves them.
+ *
+ * Usage: blockbuf_bench [backlog MB] [chunk KB] [total MB]
+ */
+#include "hohnor/common/Buffer.h"
+#include "hohnor/common/BlockBuffer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double mbPerSec;
+    //User CPU per GB appended and written, where copies and moves of the buffer show up
+    double userMsPerGb;
+};
+
+static double userSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+}
+
+static ssize_t flush(Buffer &buffer, int fd)
+{
+    ssize_t n = ::write(fd, buffer.peek(), buffer.readableBytes());
+    if (n > 0)
+        buffer.retrieve(n);
+    return n;
+}
+
+static ssize_t flush(BlockBuffer &buffer, int fd)
+{
+    int savedErrno = 0;
+    return buffer.writeFd(fd, &savedErrno);
+}
+
+template <typename BufferType>
+Result run(size_t backlog, size_t chunk, size_t total)
+{
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        std::perror("pipe2");
+        std::exit(1);
+    }
+    ::fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+    std::string data(chunk, 'x');
+    std::vector<char> sink(chunk);
+    BufferType buffer;
+    while (buffer.readableBytes() < backlog)
+        buffer.append(data);
+
+    double userStart = userSeconds();
+    MonotonicTime start = MonotonicTime::now();
+    size_t appended = 0;
+    while (appended < total)
+    {
+        buffer.append(data);
+        appended += chunk;
+        flush(buffer, fds[1]);
+        //The peer takes one chunk per round
+        if (::read(fds[0], sink.data(), sink.size()) < 0)
+            break;
+    }
+    double elapsed = timeDifference(MonotonicTime::now(), start);
+    double user = userSeconds() - userStart;
+    ::close(fds[0]);
+    ::close(fds[1]);
+    Result result;
+    result.mbPerSec = appended / elapsed / (1024 * 1024);
+    result.userMsPerGb = user * 1e3 / (static_cast<double>(appended) / (1024 * 1024 * 1024));
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t backlogMb = argc > 1 ? std::atoi(argv[1]) : 8;
+    size_t chunkKb = argc > 2 ? std::atoi(argv[2]) : 64;
+    size_t totalMb = argc > 3 ? std::atoi(argv[3]) : 4096;
+    if (backlogMb == 0 || chunkKb == 0 || totalMb == 0)
+    {
+        std::fprintf(stderr, "Usage: %s [backlog MB] [chunk KB] [total MB]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%zuMB backlog, %zuKB chunks, %zuMB written\n", backlogMb, chunkKb, totalMb);
+    std::printf("%-12s %10s %16s\n", "buffer", "MB/s", "user ms/GB");
+    for (int round = 0; round < 2; ++round)
+    {
+        Result a = run<Buffer>(backlogMb << 20, chunkKb << 10, totalMb << 20);
+        Result b = run<BlockBuffer>(backlogMb << 20, chunkKb << 10, totalMb << 20);
+        //The first round warms up
+        if (round == 1)
+        {
+            std::printf("%-12s %10.0f %16.1f\n", "Buffer", a.mbPerSec, a.userMsPerGb);
+            std::printf("%-12s %10.0f %16.1f\n", "BlockBuffer", b.mbPerSec, b.userMsPerGb);
+        }
+    }
+    return 0;
+}
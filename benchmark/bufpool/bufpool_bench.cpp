@@ -0,0 +1,110 @@
+/**
+ * Read and write buffers of many mostly idle connections. Each round a few random connections take a request
+ * into the read buffer and stage a response in the write buffer, both drained right away. Buffers that keep
+ * their storage, as a connection's buffers did before, against buffers constructed empty and released once
+ * drained, borrowing storage from the pool of the thread only while bytes are in them. Reports the resident
+ * memory per connection and the time per request.
+ *
+ * Usage: bufpool_bench [connections] [requests] [request bytes]
+ */
+#include "hohnor/common/Buffer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Connection
+{
+    explicit Connection(size_t initialSize) : readBuffer(initialSize), writeBuffer(initialSize) {}
+    Buffer readBuffer;
+    Buffer writeBuffer;
+};
+
+struct Result
+{
+    double bytesPerConnection;
+    double nsPerRequest;
+};
+
+static size_t residentBytes()
+{
+    long pages = 0, resident = 0;
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return static_cast<size_t>(resident) * ::sysconf(_SC_PAGESIZE);
+}
+
+Result run(bool pooled, int numConnections, int numRequests, int requestBytes)
+{
+    const std::string request(requestBytes, 'q');
+    const std::string response(requestBytes * 4, 'r');
+    size_t before = residentBytes();
+    std::vector<std::unique_ptr<Connection>> connections;
+    connections.reserve(numConnections);
+    for (int i = 0; i < numConnections; ++i)
+        connections.emplace_back(new Connection(pooled ? 0 : kInitialSize));
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> pick(0, numConnections - 1);
+    MonotonicTime start = MonotonicTime::now();
+    for (int i = 0; i < numRequests; ++i)
+    {
+        Connection &conn = *connections[pick(random)];
+        conn.readBuffer.append(request);
+        conn.readBuffer.retrieveAll();
+        conn.writeBuffer.append(response);
+        conn.writeBuffer.retrieveAll();
+        if (pooled)
+        {
+            conn.readBuffer.release();
+            conn.writeBuffer.release();
+        }
+    }
+    Result result;
+    result.nsPerRequest = timeDifference(MonotonicTime::now(), start) * 1e9 / numRequests;
+    result.bytesPerConnection = static_cast<double>(residentBytes() - before) / numConnections;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int numConnections = argc > 1 ? std::atoi(argv[1]) : 500000;
+    int numRequests = argc > 2 ? std::atoi(argv[2]) : 5000000;
+    int requestBytes = argc > 3 ? std::atoi(argv[3]) : 512;
+    if (numConnections <= 0 || numRequests <= 0 || requestBytes <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [connections] [requests] [request bytes]\n", argv[0]);
+        return 1;
+    }
+    const bool pooled = argc > 4 && std::string(argv[4]) == "pooled";
+    if (argc <= 4)
+    {
+        //One process per mode, so the resident memory of one does not hide the other
+        std::printf("%d connections, %d requests of %d bytes, responses of %d bytes\n", numConnections,
+                    numRequests, requestBytes, requestBytes * 4);
+        std::printf("%-8s %18s %14s\n", "buffers", "bytes/connection", "ns/request");
+        std::fflush(stdout);
+        for (const char *mode : {"eager", "pooled"})
+        {
+            std::string command = std::string(argv[0]) + " " + std::to_string(numConnections) + " " +
+                                  std::to_string(numRequests) + " " + std::to_string(requestBytes) + " " + mode;
+            if (std::system(command.c_str()) != 0)
+                return 1;
+        }
+        return 0;
+    }
+    Result r = run(pooled, numConnections, numRequests, requestBytes);
+    std::printf("%-8s %18.0f %14.1f\n", pooled ? "pooled" : "eager", r.bytesPerConnection, r.nsPerRequest);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Small message echo on one loop, a shared loop against a thread confined one. Both ends of every
+ * connection are TCPConnections over a socketpair in the same loop, each connection has one message
+ * in flight and the client end sends the next one when the echo is back. Write complete callbacks
+ * are set, so every write also posts a functor as a real server would. Then the loop posts functors to
+ * itself, the cost a thread confined loop saves most on.
+ *
+ * Usage: confined_bench [connections] [message bytes] [seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/net/TCPConnection.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double messagesPerSec;
+    double iterationsPerSec;
+    //Post and run of a functor the loop queues to itself
+    double postNs;
+};
+
+Result run(bool confined, int numConnections, int messageBytes, double seconds)
+{
+    EventLoop::Options options;
+    options.threadConfined = confined;
+    auto loop = EventLoop::create(options);
+    std::vector<TCPConnectionPtr> connections;
+    const std::string message(messageBytes, 'x');
+    uint64_t messages = 0;
+    uint64_t startIteration = 0;
+    Result result = {0, 0, 0};
+
+    loop->runInLoop([&]() {
+        for (int i = 0; i < numConnections; ++i)
+        {
+            int fds[2];
+            ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+            TCPConnectionPtr server = TCPConnection::create(loop->handleIO(fds[0]));
+            TCPConnectionPtr client = TCPConnection::create(loop->handleIO(fds[1]));
+            server->setReadCompleteCallback([](TCPConnectionPtr conn) { conn->write(&conn->getReadBuffer()); });
+            server->setWriteCompleteCallback([](TCPConnectionPtr) {});
+            client->setReadCompleteCallback([&message, &messages, messageBytes](TCPConnectionPtr conn) {
+                Buffer &buffer = conn->getReadBuffer();
+                while (buffer.readableBytes() >= static_cast<size_t>(messageBytes))
+                {
+                    buffer.retrieve(messageBytes);
+                    ++messages;
+                    conn->write(message);
+                }
+            });
+            client->setWriteCompleteCallback([](TCPConnectionPtr) {});
+            server->readRaw();
+            client->readRaw();
+            client->write(message);
+            connections.push_back(server);
+            connections.push_back(client);
+        }
+        //Measure once the connections are set up
+        loop->queueInLoop([&]() {
+            MonotonicTime start = MonotonicTime::now();
+            messages = 0;
+            startIteration = loop->iteration();
+            loop->addTimer([&, start]() {
+                double elapsed = timeDifference(MonotonicTime::now(), start);
+                result.messagesPerSec = messages / elapsed;
+                result.iterationsPerSec = (loop->iteration() - startIteration) / elapsed;
+                const int kPosts = 1000000;
+                int ran = 0;
+                MonotonicTime postStart = MonotonicTime::now();
+                for (int i = 0; i < kPosts; ++i)
+                    loop->queueInLoop([&ran]() { ++ran; });
+                loop->queueInLoop([&, postStart]() {
+                    result.postNs = timeDifference(MonotonicTime::now(), postStart) * 1e9 / kPosts;
+                    loop->endLoop();
+                });
+            }, addTime(loop->now(), seconds));
+        });
+    });
+    loop->loop();
+    connections.clear();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int numConnections = argc > 1 ? std::atoi(argv[1]) : 16;
+    int messageBytes = argc > 2 ? std::atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 3.0;
+    if (numConnections <= 0 || messageBytes <= 0 || seconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [connections] [message bytes] [seconds]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%d connections echoing %d byte messages, %gs each\n", numConnections, messageBytes, seconds);
+    std::printf("%-10s %14s %16s %10s\n", "loop", "messages/s", "iterations/s", "post ns");
+    const char *names[] = {"shared", "confined"};
+    //Twice in turns, the first rounds warm up
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            Result r = run(i == 1, numConnections, messageBytes, seconds);
+            if (round == 1)
+                std::printf("%-10s %14.0f %16.0f %10.1f\n", names[i], r.messagesPerSec, r.iterationsPerSec, r.postNs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * Micro-benchmark of callback construction on the loop's hot paths.
+ * Global operator new is counted, so the allocations per call are exact.
+ *
+ * Usage: functor_bench [iterations]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/EventLoopThreadPool.h"
+#include "hohnor/common/StringPiece.h"
+#include "hohnor/thread/CountDownLatch.h"
+#include "hohnor/time/Timestamp.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+
+using namespace Hohnor;
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Run body iterations times after a warm up, print time and allocations per call
+template <typename Body>
+void measure(const char *name, int iterations, Body body)
+{
+    for (int i = 0; i < iterations / 10; ++i)
+        body();
+    uint64_t allocations = g_allocations.load();
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < iterations; ++i)
+        body();
+    double seconds = timeDifference(Timestamp::now(), start);
+    allocations = g_allocations.load() - allocations;
+    std::printf("%-40s %8.1f ns/call %8.3f allocations/call\n", name,
+                seconds * 1e9 / iterations, static_cast<double>(allocations) / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    if (iterations <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    // Same captures as TCPConnection::write(): the connection and the message
+    auto connection = std::make_shared<std::string>("connection");
+    StringPiece message("GET / HTTP/1.1\r\n\r\n");
+    size_t sink = 0;
+
+    auto loop = EventLoop::create();
+    loop->queueInLoop([&]() {
+        measure("Functor, construct and call", iterations, [&]() {
+            Functor f([connection, message, &sink]() { sink += message.size(); });
+            f();
+        });
+        measure("std::function, construct and call", iterations, [&]() {
+            std::function<void()> f([connection, message, &sink]() { sink += message.size(); });
+            f();
+        });
+        measure("runInLoop in loop thread", iterations, [&]() {
+            loop->runInLoop([connection, message, &sink]() { sink += message.size(); });
+        });
+        loop->endLoop();
+    });
+    loop->loop();
+
+    // Posts from another thread, the queue node is the only allocation left
+    EventLoopThread thread(nullptr, "functor_bench");
+    EventLoopPtr ioLoop = thread.startLoop();
+    int batch = 1000;
+    measure("queueInLoop from other thread, per post", iterations / batch, [&]() {
+        CountDownLatch latch(1);
+        for (int i = 0; i < batch - 1; ++i)
+            ioLoop->queueInLoop([connection, message, &sink]() { sink += message.size(); });
+        ioLoop->queueInLoop([&latch]() { latch.countDown(); });
+        latch.wait();
+    });
+    std::printf("(per post: divide the line above by %d)\n", batch);
+    thread.stopLoop();
+
+    std::printf("sink %zu\n", sink);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Idle timeouts of many connections, IdleReaper against a timer per connection that is moved on
+ * every activity. Tracks the entries, touches random ones as reads would, then lets the loop idle
+ * and measures the CPU time the ticks take.
+ *
+ * Usage: idle_bench [connections] [touches] [idle seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IdleReaper.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/resource.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double addNs;
+    double touchNs;
+    //CPU time of the loop per second while connections are idle
+    double idleCpuMsPerSec;
+};
+
+static double cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+Result run(bool reaper, int numConnections, int numTouches, double idleSeconds)
+{
+    EventLoop::Options options;
+    options.idleTick = 0.01;
+    auto loop = EventLoop::create(options);
+    Result result = {0, 0, 0};
+    std::vector<IdleReaper::EntryPtr> entries;
+    std::vector<std::shared_ptr<TimerHandler>> timers;
+    const double timeout = 60.0;
+
+    loop->runInLoop([&]() {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> pick(0, numConnections - 1);
+        MonotonicTime start = MonotonicTime::now();
+        for (int i = 0; i < numConnections; ++i)
+        {
+            if (reaper)
+            {
+                entries.push_back(std::make_shared<IdleReaper::Entry>([]() {}));
+                loop->idleReaper()->add(entries.back(), timeout);
+            }
+            else
+            {
+                timers.push_back(loop->addTimer([]() {}, addTime(loop->now(), timeout)));
+            }
+        }
+        result.addNs = timeDifference(MonotonicTime::now(), start) * 1e9 / numConnections;
+
+        start = MonotonicTime::now();
+        for (int i = 0; i < numTouches; ++i)
+        {
+            //What a read or write does with the connection's timeout
+            if (reaper)
+                entries[pick(rng)]->touch(loop->now());
+            else
+                timers[pick(rng)]->reschedule(addTime(loop->now(), timeout));
+        }
+        result.touchNs = timeDifference(MonotonicTime::now(), start) * 1e9 / numTouches;
+
+        //Timers are queued by functors addTimer posted, measure from after them
+        loop->queueInLoop([&, idleSeconds]() {
+            double cpuStart = cpuSeconds();
+            loop->addTimer([&, cpuStart, idleSeconds]() {
+                result.idleCpuMsPerSec = (cpuSeconds() - cpuStart) * 1e3 / idleSeconds;
+                loop->endLoop();
+            }, addTime(loop->now(), idleSeconds));
+        });
+    });
+    loop->loop();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int numConnections = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int numTouches = argc > 2 ? std::atoi(argv[2]) : 10000000;
+    double idleSeconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+    if (numConnections <= 0 || numTouches <= 0 || idleSeconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [connections] [touches] [idle seconds]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%d connections with 60s idle timeout, %d touches, reaper tick 10ms, idle for %gs\n",
+                numConnections, numTouches, idleSeconds);
+    std::printf("%-8s %14s %14s %18s\n", "method", "add ns/op", "touch ns/op", "idle cpu ms/s");
+    const char *names[] = {"timer", "reaper"};
+    for (int i = 0; i < 2; ++i)
+    {
+        Result r = run(i == 1, numConnections, numTouches, idleSeconds);
+        std::printf("%-8s %14.1f %14.1f %18.3f\n", names[i], r.addNs, r.touchNs, r.idleCpuMsPerSec);
+    }
+    return 0;
+}
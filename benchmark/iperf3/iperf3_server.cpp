@@ -5,12 +5,13 @@
 
 #include "hohnor/core/EventLoop.h"
 #include "hohnor/core/Signal.h"
-#include "hohnor/net/TCPAcceptor.h"
+#include "hohnor/net/TCPServer.h"
 #include "hohnor/net/InetAddress.h"
 #include "hohnor/net/TCPConnection.h"
 #include "hohnor/core/IOHandler.h"
 #include "hohnor/time/Timestamp.h"
 #include "hohnor/log/Logging.h"
+#include "hohnor/thread/Mutex.h"
 #include <iostream>
 #include <memory>
 #include <unordered_map>
@@ -24,7 +25,8 @@
 using namespace Hohnor;
 
 struct ConnectionStats {
-    uint64_t bytesReceived = 0;
+    // Written by the connection's IO loop, read by the reporting timer in the accept loop
+    std::atomic<uint64_t> bytesReceived{0};
     Timestamp startTime;
     Timestamp lastReportTime;
     uint64_t lastBytesReceived = 0;
@@ -36,10 +38,14 @@ struct ConnectionStats {
 class IPerf3Server {
 private:
     EventLoopPtr loop_;
-    TCPAcceptorPtr listenSocket_;
+    TCPServerPtr server_;
+    // Connections live in different IO loops, the maps are shared among them
+    Mutex clientsLock_;
     std::unordered_map<int, TCPConnectionPtr> clients_;
-    std::unordered_map<int, ConnectionStats> clientStats_;
+    std::unordered_map<int, std::shared_ptr<ConnectionStats>> clientStats_;
     uint16_t port_;
+    size_t numLoops_;
+    bool edgeTriggered_;
     bool running_;
     int testDuration_;  // Test duration in seconds (0 = unlimited)
     std::atomic<uint64_t> totalBytesReceived_;
@@ -49,8 +55,8 @@ private:
     static constexpr double REPORT_INTERVAL = 1.0; // Report every 1 second
 
 public:
-    IPerf3Server(EventLoopPtr loop, uint16_t port, int duration = 0) 
-        : loop_(loop), port_(port), running_(false), testDuration_(duration), 
+    IPerf3Server(EventLoopPtr loop, uint16_t port, int duration = 0, size_t numLoops = 0, bool edgeTriggered = false) 
+        : loop_(loop), port_(port), numLoops_(numLoops), edgeTriggered_(edgeTriggered), running_(false), testDuration_(duration), 
           totalBytesReceived_(0), serverStartTime_(Timestamp::now()) {}
 
     void start() {
@@ -60,29 +66,30 @@ public:
         }
 
         try {
-            // Create TCP listen socket
-            listenSocket_ = TCPAcceptor::create(loop_);
+            // Create TCP server, connections are spread over numLoops_ IO loops
+            server_ = TCPServer::create(loop_, InetAddress(port_, false, false), "IPerf3Server"); // port, not loopback only, not ipv6
+            server_->setLoopNum(numLoops_);
 
             // Set socket options for high performance
-            listenSocket_->setReuseAddr(true);
-            listenSocket_->setReusePort(true);
-            listenSocket_->setTCPNoDelay(true);  // Disable Nagle's algorithm
-            listenSocket_->setKeepAlive(true);   // Enable keep-alive
+            server_->acceptor()->setReuseAddr(true);
+            server_->acceptor()->setReusePort(true);
+            server_->acceptor()->setTCPNoDelay(true);  // Disable Nagle's algorithm
+            server_->acceptor()->setKeepAlive(true);   // Enable keep-alive
             
-            // Bind to address and port
-            listenSocket_->bindAddress(port_, false, false); // port, not loopback only, not ipv6
-            
-            // Start listening
-            listenSocket_->listen();
-            
-            // Set accept callback
-            listenSocket_->setAcceptCallback(std::bind(&IPerf3Server::handleNewConnection, this, std::placeholders::_1));
+            // Set connection callback, it runs in the IO loop owning the connection
+            server_->setConnectionCallback(std::bind(&IPerf3Server::handleNewConnection, this, std::placeholders::_1));
+
+            // Start IO loops and listening
+            server_->start();
 
             running_ = true;
             serverStartTime_ = Timestamp::now();
             
             std::cout << "-----------------------------------------------------------" << std::endl;
             std::cout << "Server listening on " << port_ << std::endl;
+            std::cout << "IO loops: " << (numLoops_ ? numLoops_ : 1) << std::endl;
+            std::cout << "Poller backend: " << pollerBackendName(loop_->backend()) << std::endl;
+            std::cout << "Trigger mode: " << (edgeTriggered_ ? "edge" : "level") << std::endl;
             if (testDuration_ > 0) {
                 std::cout << "Test duration: " << testDuration_ << " seconds" << std::endl;
             } else {
@@ -116,15 +123,19 @@ public:
         printFinalStats();
         
         // Close all client connections
-        for (auto& pair : clients_) {
-            pair.second->forceClose();
+        {
+            MutexGuard guard(clientsLock_);
+            for (auto& pair : clients_) {
+                pair.second->forceClose();
+            }
+            clients_.clear();
+            clientStats_.clear();
         }
-        clients_.clear();
-        clientStats_.clear();
         
-        // Close listen socket
-        if (listenSocket_) {
-            listenSocket_.reset();
+        // Stop listening and end IO loops
+        if (server_) {
+            server_->stop();
+            server_.reset();
         }
         
         std::cout << "iperf Done." << std::endl;
@@ -142,17 +153,26 @@ private:
             
             // Set TCP options for performance
             clientConnection->setTCPNoDelay(true);
+            if (edgeTriggered_) {
+                // Drain the socket on every event instead of one read per wakeup
+                clientConnection->setEdgeTriggered(true);
+            }
             
             // Store client connection and initialize stats
-            clients_[clientFd] = clientConnection;
-            clientStats_[clientFd] = ConnectionStats();
+            auto stats = std::make_shared<ConnectionStats>();
+            {
+                MutexGuard guard(clientsLock_);
+                clients_[clientFd] = clientConnection;
+                clientStats_[clientFd] = stats;
+            }
             
             std::cout << "Accepted connection from " << clientConnection->getPeerAddr().toIpPort() 
                       << " on port " << port_ << std::endl;
 
             // Set up client callbacks
-            clientConnection->setReadCompleteCallback([this, clientFd](TCPConnectionPtr conn) {
-                this->handleClientData(clientFd);
+            // The stats are captured so that reads do not touch the shared maps
+            clientConnection->setReadCompleteCallback([this, stats](TCPConnectionPtr conn) {
+                this->handleClientData(conn, *stats);
             });
 
             clientConnection->setCloseCallback([this, clientFd]() {
@@ -171,15 +191,7 @@ private:
         }
     }
 
-    void handleClientData(int clientFd) {
-        auto it = clients_.find(clientFd);
-        if (it == clients_.end()) {
-            return;
-        }
-
-        auto clientConnection = it->second;
-        auto& stats = clientStats_[clientFd];
-        
+    void handleClientData(TCPConnectionPtr clientConnection, ConnectionStats& stats) {
         try {
             // Get data from the read buffer
             Buffer& readBuffer = clientConnection->getReadBuffer();
@@ -199,14 +211,15 @@ private:
             }
         } catch (const std::exception& e) {
             std::cerr << "Error handling client data: " << e.what() << std::endl;
-            handleClientError(clientFd);
+            handleClientError(clientConnection->fd());
         }
     }
 
     void handleClientDisconnect(int clientFd) {
+        MutexGuard guard(clientsLock_);
         auto it = clientStats_.find(clientFd);
         if (it != clientStats_.end()) {
-            auto& stats = it->second;
+            auto& stats = *it->second;
             stats.active = false;
             
             // Print final stats for this connection
@@ -244,13 +257,15 @@ private:
     }
 
     void printIntervalStats() {
-        if (!running_ || clients_.empty()) return;
+        if (!running_) return;
+        MutexGuard guard(clientsLock_);
+        if (clients_.empty()) return;
         
         Timestamp now = Timestamp::now();
         
         for (auto& pair : clientStats_) {
             int clientFd = pair.first;
-            auto& stats = pair.second;
+            auto& stats = *pair.second;
             
             if (!stats.active) continue;
             
@@ -283,6 +298,22 @@ private:
                   << std::fixed << std::setprecision(1) << "0.0-" << totalDuration << " sec  "
                   << std::setw(8) << formatBytes(totalBytesReceived_) << "  "
                   << std::setw(8) << std::setprecision(1) << totalThroughputMbps << " Mbits/sec" << std::endl;
+        // Syscalls spent by the pollers of all IO loops, the figure to compare backends with
+        if (server_ && server_->threadPool()) {
+            uint64_t syscalls = 0;
+            uint64_t events = 0;
+            for (auto &ioLoop : server_->threadPool()->getAllLoops()) {
+                auto stats = ioLoop->pollStats();
+                syscalls += stats.syscalls;
+                events += stats.events;
+            }
+            std::cout << "Poller events: " << events << std::endl;
+            std::cout << "Poller syscalls: " << syscalls;
+            if (totalBytesReceived_ >= 1000000) {
+                std::cout << " (" << std::setprecision(2) << syscalls / (totalBytesReceived_ / 1000000.0) << " per MByte)";
+            }
+            std::cout << std::endl;
+        }
         std::cout << "-----------------------------------------------------------" << std::endl;
     }
 
@@ -309,16 +340,22 @@ void printUsage(const char* program) {
     std::cout << "  -s, --server          Run in server mode" << std::endl;
     std::cout << "  -p, --port <port>     Server port to listen on (default: 5201)" << std::endl;
     std::cout << "  -t, --time <sec>      Time in seconds to run (default: unlimited)" << std::endl;
+    std::cout << "  -l, --loops <num>     Number of IO loops, one thread each (default: 0, accept loop only)" << std::endl;
+    std::cout << "  --backend <name>      Poller backend, epoll or io_uring (default: epoll)" << std::endl;
+    std::cout << "  -e, --edge-triggered  Drain sockets until EAGAIN on every edge-triggered event" << std::endl;
     std::cout << "  -h, --help            Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Example:" << std::endl;
-    std::cout << "  " << program << " -s -p 5201 -t 10" << std::endl;
+    std::cout << "  " << program << " -s -p 5201 -t 10 --loops 4" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     uint16_t port = 5201;  // Default iperf3 port
     int testDuration = 0;  // 0 = unlimited
     bool serverMode = false;
+    size_t numLoops = 0;   // 0 = serve connections in the accept loop
+    EventLoop::Options options;  // Default: epoll backend
+    bool edgeTriggered = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -348,6 +385,35 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Option " << arg << " requires an argument" << std::endl;
                 return 1;
             }
+        } else if (arg == "-l" || arg == "--loops") {
+            if (i + 1 < argc) {
+                int loops = std::atoi(argv[++i]);
+                if (loops < 0) {
+                    std::cerr << "Invalid loop number: " << argv[i] << std::endl;
+                    return 1;
+                }
+                numLoops = static_cast<size_t>(loops);
+            } else {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--backend") {
+            if (i + 1 < argc) {
+                std::string backend = argv[++i];
+                if (backend == "epoll") {
+                    options.backend = PollerBackend::Epoll;
+                } else if (backend == "io_uring") {
+                    options.backend = PollerBackend::IOUring;
+                } else {
+                    std::cerr << "Invalid backend: " << backend << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-e" || arg == "--edge-triggered") {
+            edgeTriggered = true;
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -365,11 +431,11 @@ int main(int argc, char* argv[]) {
     }
 
     try {
-        // Create event loop
-        auto loop = EventLoop::create();
+        // Create event loop, IO loops are created with the same options
+        auto loop = EventLoop::create(options);
         
         // Create iperf3 server
-        IPerf3Server server(loop, port, testDuration);
+        IPerf3Server server(loop, port, testDuration, numLoops, edgeTriggered);
 
         // Set up signal handling for graceful shutdown
         loop->handleSignal(SIGINT, SignalAction::Handled, [&]() {
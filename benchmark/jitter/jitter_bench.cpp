@@ -0,0 +1,76 @@
+/**
+ * Jitter of a pacing timer, ordinary and precision timers woken up by a timerfd or by the poll timeout.
+ * A repeating timer of the given period runs for the given time, its lateness from the scheduled
+ * expiration is taken by the clock read first thing in the callback.
+ *
+ * Usage: jitter_bench [period in microseconds] [seconds] [spin in microseconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/common/Histogram.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+using namespace Hohnor;
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+Histogram::Snapshot run(bool precise, bool timerfd, double period, double seconds, double spin)
+{
+    EventLoop::Options options;
+    options.timerfd = timerfd;
+    auto loop = EventLoop::create(options);
+    Histogram lateness;
+    std::shared_ptr<TimerHandler> timer;
+    MonotonicTime start = addTime(MonotonicTime::now(), 0.01);
+    auto onTimer = [&]() {
+        int64_t now = monotonicNs();
+        int64_t late = now - timer->expiration().microSeconds() * 1000;
+        lateness.record(late > 0 ? static_cast<uint64_t>(late) : 0);
+    };
+    if (precise)
+        timer = loop->addPrecisionTimer(onTimer, start, period, spin);
+    else
+        timer = loop->addTimer(onTimer, start, period);
+    loop->addTimer([&]() {
+        timer->cancel();
+        loop->endLoop();
+    }, addTime(start, seconds));
+    loop->loop();
+    return lateness.snapshot();
+}
+
+int main(int argc, char *argv[])
+{
+    double periodUs = argc > 1 ? std::atof(argv[1]) : 1000;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+    double spinUs = argc > 3 ? std::atof(argv[3]) : 50;
+    if (periodUs <= 0 || seconds <= 0 || spinUs <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [period in microseconds] [seconds] [spin in microseconds]\n", argv[0]);
+        return 1;
+    }
+    std::printf("Repeating timer every %gus for %gs, precision timers spin %gus, lateness in us\n", periodUs, seconds,
+                spinUs);
+    std::printf("%-10s %-8s %10s %10s %10s %10s %10s %10s\n", "timer", "wakeup", "runs", "mean", "p50", "p99",
+                "p99.9", "max");
+    for (int precise = 0; precise < 2; ++precise)
+    {
+        for (int timerfd = 1; timerfd >= 0; --timerfd)
+        {
+            Histogram::Snapshot s = run(precise, timerfd, periodUs / 1e6, seconds, spinUs / 1e6);
+            std::printf("%-10s %-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", precise ? "precision" : "ordinary",
+                        timerfd ? "timerfd" : "poll", static_cast<unsigned long long>(s.count), s.mean() / 1e3,
+                        s.percentile(50) / 1e3, s.percentile(99) / 1e3, s.percentile(99.9) / 1e3, s.max / 1e3);
+        }
+    }
+    return 0;
+}
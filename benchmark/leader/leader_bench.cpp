@@ -0,0 +1,227 @@
+/**
+ * Uneven connections on a few threads, LeaderFollowerPool against EventLoopThreadPool with connections
+ * assigned round-robin. Each connection has one request in flight, hot connections cost more CPU per
+ * request than the others and the round-robin happens to put them all on one loop. A client thread
+ * answers every response with the next request and measures the round trips.
+ *
+ * Usage: leader_bench [threads] [connections] [hot connections] [light us] [hot us] [seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/EventLoopThreadPool.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/core/LeaderFollowerPool.h"
+#include "hohnor/thread/CountDownLatch.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Config
+{
+    int threads;
+    int connections;
+    int hot;
+    int lightUs;
+    int hotUs;
+    double seconds;
+};
+
+struct Result
+{
+    double requestsPerSec;
+    double p50Us;
+    double p99Us;
+    //Busiest thread's share of the requests
+    double maxShare;
+};
+
+//Hot connections all fall on the first loop of the round-robin, as a few busy clients can by chance
+static bool isHot(const Config &config, int i)
+{
+    return i % config.threads == 0 && i / config.threads < config.hot;
+}
+
+static void spin(int us)
+{
+    MonotonicTime end(MonotonicTime::now().microSeconds() + us);
+    while (MonotonicTime::now() < end)
+        ;
+}
+
+//Answer every request read from fd after its work, returns the requests served
+static int serve(int fd, int workUs)
+{
+    char buf[64];
+    int served = 0;
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0)
+    {
+        for (ssize_t i = 0; i < n; ++i)
+            spin(workUs);
+        if (::write(fd, buf, n) != n)
+            std::perror("write");
+        served += static_cast<int>(n);
+    }
+    return served;
+}
+
+//Drive the client ends until the time is up, latencies are in microseconds
+static std::vector<int64_t> drive(const std::vector<int> &clients, double seconds)
+{
+    int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<MonotonicTime> sent(clients.size());
+    std::vector<int64_t> latencies;
+    latencies.reserve(1 << 20);
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i], &event);
+        sent[i] = MonotonicTime::now();
+        if (::write(clients[i], "r", 1) != 1)
+            std::perror("write");
+    }
+    MonotonicTime end(MonotonicTime::now().microSeconds() + static_cast<int64_t>(seconds * 1e6));
+    std::vector<struct epoll_event> events(clients.size());
+    MonotonicTime now = MonotonicTime::now();
+    while (now < end)
+    {
+        int n = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+        now = MonotonicTime::now();
+        for (int i = 0; i < n; ++i)
+        {
+            size_t index = events[i].data.u64;
+            char c;
+            if (::read(clients[index], &c, 1) != 1)
+                continue;
+            latencies.push_back(now.microSeconds() - sent[index].microSeconds());
+            sent[index] = now;
+            if (now < end && ::write(clients[index], "r", 1) != 1)
+                std::perror("write");
+        }
+    }
+    ::close(epollFd);
+    return latencies;
+}
+
+static Result summarize(std::vector<int64_t> &latencies, const std::vector<uint64_t> &perThread, double seconds)
+{
+    Result result = {0, 0, 0, 0};
+    if (latencies.empty())
+        return result;
+    std::sort(latencies.begin(), latencies.end());
+    result.requestsPerSec = latencies.size() / seconds;
+    result.p50Us = static_cast<double>(latencies[latencies.size() / 2]);
+    result.p99Us = static_cast<double>(latencies[latencies.size() * 99 / 100]);
+    uint64_t total = 0, busiest = 0;
+    for (uint64_t count : perThread)
+    {
+        total += count;
+        busiest = std::max(busiest, count);
+    }
+    result.maxShare = total ? static_cast<double>(busiest) / total : 0;
+    return result;
+}
+
+static Result runLeaderFollower(const Config &config)
+{
+    LeaderFollowerPool pool("LFBench");
+    pool.start(config.threads);
+    std::vector<int> clients;
+    for (int i = 0; i < config.connections; ++i)
+    {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+        clients.push_back(fds[0]);
+        int fd = fds[1];
+        int workUs = isHot(config, i) ? config.hotUs : config.lightUs;
+        pool.add(fd, EPOLLIN, [fd, workUs](uint32_t) { serve(fd, workUs); });
+    }
+    std::vector<int64_t> latencies = drive(clients, config.seconds);
+    pool.stop();
+    std::vector<uint64_t> perThread = pool.dispatched();
+    for (int fd : clients)
+        ::close(fd);
+    return summarize(latencies, perThread, config.seconds);
+}
+
+static Result runReactors(const Config &config)
+{
+    auto base = EventLoop::create();
+    EventLoopThreadPool pool(base, "ReactorBench");
+    pool.start(config.threads);
+    std::vector<EventLoopPtr> loops = pool.getAllLoops();
+    std::vector<int> clients;
+    std::vector<IOHandlerPtr> handlers(config.connections);
+    std::vector<uint64_t> perThread(config.threads);
+    CountDownLatch latch(config.connections);
+    for (int i = 0; i < config.connections; ++i)
+    {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+        clients.push_back(fds[0]);
+        int fd = fds[1];
+        int workUs = isHot(config, i) ? config.hotUs : config.lightUs;
+        size_t index = i % loops.size();
+        EventLoopPtr loop = loops[index];
+        loop->runInLoop([&, loop, fd, workUs, i, index]() {
+            //Each thread touches only its own counter
+            uint64_t *served = &perThread[index];
+            handlers[i] = loop->handleIO(fd);
+            handlers[i]->setReadCallback([fd, workUs, served]() { *served += serve(fd, workUs); });
+            handlers[i]->enable();
+            latch.countDown();
+        });
+    }
+    latch.wait();
+    std::vector<int64_t> latencies = drive(clients, config.seconds);
+    CountDownLatch released(config.connections);
+    for (int i = 0; i < config.connections; ++i)
+    {
+        loops[i % loops.size()]->runInLoop([&, i]() {
+            handlers[i].reset();
+            released.countDown();
+        });
+    }
+    released.wait();
+    pool.stop();
+    for (int fd : clients)
+        ::close(fd);
+    return summarize(latencies, perThread, config.seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    config.threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    config.connections = argc > 2 ? std::atoi(argv[2]) : 64;
+    config.hot = argc > 3 ? std::atoi(argv[3]) : 4;
+    config.lightUs = argc > 4 ? std::atoi(argv[4]) : 5;
+    config.hotUs = argc > 5 ? std::atoi(argv[5]) : 200;
+    config.seconds = argc > 6 ? std::atof(argv[6]) : 3.0;
+    if (config.threads <= 0 || config.connections <= 0 || config.hot < 0 || config.lightUs < 0 ||
+        config.hotUs < 0 || config.seconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [threads] [connections] [hot connections] [light us] [hot us] [seconds]\n",
+                     argv[0]);
+        return 1;
+    }
+    std::printf("%d threads, %d connections, %d hot ones at %dus per request, others at %dus, %gs each\n",
+                config.threads, config.connections, config.hot, config.hotUs, config.lightUs, config.seconds);
+    std::printf("%-16s %12s %10s %10s %14s\n", "model", "requests/s", "p50 us", "p99 us", "busiest share");
+    const char *names[] = {"reactors", "leader/follower"};
+    for (int i = 0; i < 2; ++i)
+    {
+        Result r = i == 0 ? runReactors(config) : runLeaderFollower(config);
+        std::printf("%-16s %12.0f %10.0f %10.0f %13.1f%%\n", names[i], r.requestsPerSec, r.p50Us, r.p99Us,
+                    r.maxShare * 100);
+    }
+    return 0;
+}
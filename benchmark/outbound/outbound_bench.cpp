@@ -0,0 +1,119 @@
+/**
+ * Worker threads producing responses off the loop for one connection. A closure posted per write, the way
+ * writes from other threads were handed to the loop before, against TCPConnection::write copying the bytes
+ * and moving them in, both through the outbound queue the loop flushes with one writev per iteration. The
+ * client end is a TCPConnection over a socketpair in the same loop, the run ends when every byte is back.
+ *
+ * Usage: outbound_bench [threads] [messages per thread] [message bytes]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/net/TCPConnection.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Hohnor;
+
+enum Mode
+{
+    kClosure,
+    kCopy,
+    kMove
+};
+
+struct Result
+{
+    double messagesPerSec;
+    //Loop iterations per thousand messages, fewer when writes are batched
+    double iterationsPerKMessage;
+};
+
+Result run(Mode mode, int numThreads, int messagesPerThread, int messageBytes)
+{
+    auto loop = EventLoop::create();
+    TCPConnectionPtr server, client;
+    const uint64_t total = static_cast<uint64_t>(numThreads) * messagesPerThread * messageBytes;
+    uint64_t received = 0;
+    MonotonicTime start;
+    Result result = {0, 0};
+
+    loop->runInLoop([&]() {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+        server = TCPConnection::create(loop->handleIO(fds[0]));
+        client = TCPConnection::create(loop->handleIO(fds[1]));
+        client->setReadCompleteCallback([&](TCPConnectionPtr conn) {
+            received += conn->getReadBuffer().readableBytes();
+            conn->getReadBuffer().retrieveAll();
+            if (received == total)
+                loop->endLoop();
+        });
+        client->readRaw();
+    });
+
+    start = MonotonicTime::now();
+    uint64_t startIteration = loop->iteration();
+    std::vector<std::thread> producers;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        producers.emplace_back([&, mode]() {
+            for (int i = 0; i < messagesPerThread; ++i)
+            {
+                std::string message(messageBytes, static_cast<char>('a' + i % 26));
+                if (mode == kClosure)
+                {
+                    TCPConnectionPtr conn = server;
+                    loop->runInLoop([conn, message]() { conn->write(message); });
+                }
+                else if (mode == kCopy)
+                {
+                    server->write(message);
+                }
+                else
+                {
+                    server->write(std::move(message));
+                }
+            }
+        });
+    }
+    loop->loop();
+    double elapsed = timeDifference(MonotonicTime::now(), start);
+    for (auto &producer : producers)
+        producer.join();
+    result.messagesPerSec = numThreads * messagesPerThread / elapsed;
+    result.iterationsPerKMessage = (loop->iteration() - startIteration) * 1000.0 / (numThreads * messagesPerThread);
+    server.reset();
+    client.reset();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int numThreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    int messagesPerThread = argc > 2 ? std::atoi(argv[2]) : 200000;
+    int messageBytes = argc > 3 ? std::atoi(argv[3]) : 256;
+    if (numThreads <= 0 || messagesPerThread <= 0 || messageBytes <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [threads] [messages per thread] [message bytes]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%d threads writing %d messages of %d bytes each\n", numThreads, messagesPerThread, messageBytes);
+    std::printf("%-8s %14s %18s\n", "write", "messages/s", "iterations/k msg");
+    const char *names[] = {"closure", "copy", "move"};
+    //Twice in turns, the first rounds warm up
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            Result r = run(static_cast<Mode>(i), numThreads, messagesPerThread, messageBytes);
+            if (round == 1)
+                std::printf("%-8s %14.0f %18.1f\n", names[i], r.messagesPerSec, r.iterationsPerKMessage);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * Serving a file over a connection, read into user space and written against TCPConnection::sendFile.
+ * Every response is a header, the file and a trailer, the next one is sent on write complete. The client
+ * end is a TCPConnection over a socketpair in the same loop that drains what arrives, and checks the
+ * first response byte by byte, so the file is known to come out in order with the writes around it.
+ *
+ * Usage: sendfile_bench [file MB] [seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/net/TCPConnection.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double mbPerSec;
+    //CPU per GB received, where the copies through user space show up
+    double userMsPerGb;
+    double sysMsPerGb;
+    bool intact;
+};
+
+static void cpuSeconds(double *user, double *sys)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    *user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    *sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+Result run(bool useSendFile, int fileFd, const std::string &content, double seconds)
+{
+    const std::string header = "HEADER\r\n";
+    const std::string trailer = "\r\nTRAILER";
+    const std::string expected = header + content + trailer;
+    auto loop = EventLoop::create();
+    TCPConnectionPtr server, client;
+    std::string first;
+    uint64_t received = 0;
+    Result result = {0, 0, 0, false};
+
+    auto respond = [&, useSendFile](TCPConnectionPtr conn) {
+        conn->write(header);
+        if (useSendFile)
+        {
+            conn->sendFile(fileFd, 0, content.size());
+        }
+        else
+        {
+            std::string body(content.size(), '\0');
+            ssize_t n = ::pread(fileFd, &body[0], body.size(), 0);
+            if (n != static_cast<ssize_t>(body.size()))
+                std::abort();
+            conn->write(body);
+        }
+        conn->write(trailer);
+    };
+
+    loop->runInLoop([&]() {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+        server = TCPConnection::create(loop->handleIO(fds[0]));
+        client = TCPConnection::create(loop->handleIO(fds[1]));
+        server->setWriteCompleteCallback(respond);
+        client->setReadCompleteCallback([&](TCPConnectionPtr conn) {
+            Buffer &buffer = conn->getReadBuffer();
+            if (first.size() < expected.size())
+                first.append(buffer.peek(), std::min(buffer.readableBytes(), expected.size() - first.size()));
+            received += buffer.readableBytes();
+            buffer.retrieveAll();
+        });
+        client->readRaw();
+        respond(server);
+
+        MonotonicTime start = MonotonicTime::now();
+        double startUser, startSys;
+        cpuSeconds(&startUser, &startSys);
+        loop->addTimer([&, start, startUser, startSys]() {
+            double elapsed = timeDifference(MonotonicTime::now(), start);
+            double user, sys;
+            cpuSeconds(&user, &sys);
+            double gb = received / 1e9;
+            result.mbPerSec = received / 1e6 / elapsed;
+            result.userMsPerGb = (user - startUser) * 1e3 / gb;
+            result.sysMsPerGb = (sys - startSys) * 1e3 / gb;
+            result.intact = first == expected;
+            server->setWriteCompleteCallback([](TCPConnectionPtr) {});
+            loop->endLoop();
+        }, addTime(loop->now(), seconds));
+    });
+    loop->loop();
+    server.reset();
+    client.reset();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int fileMb = argc > 1 ? std::atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 3.0;
+    if (fileMb <= 0 || seconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [file MB] [seconds]\n", argv[0]);
+        return 1;
+    }
+    std::string content(static_cast<size_t>(fileMb) * 1024 * 1024, '\0');
+    for (size_t i = 0; i < content.size(); ++i)
+        content[i] = static_cast<char>('a' + i % 26);
+    char path[] = "/tmp/sendfile_benchXXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0 || ::write(fd, content.data(), content.size()) != static_cast<ssize_t>(content.size()))
+    {
+        std::perror("temp file");
+        return 1;
+    }
+    ::unlink(path);
+
+    std::printf("%d MB file per response, %gs each\n", fileMb, seconds);
+    std::printf("%-10s %10s %14s %14s %8s\n", "send", "MB/s", "user ms/GB", "sys ms/GB", "intact");
+    const char *names[] = {"write", "sendFile"};
+    //Twice in turns, the first rounds warm up
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            Result r = run(i == 1, fd, content, seconds);
+            if (round == 1)
+                std::printf("%-10s %10.0f %14.1f %14.1f %8s\n", names[i], r.mbPerSec, r.userMsPerGb, r.sysMsPerGb,
+                            r.intact ? "yes" : "NO");
+        }
+    }
+    ::close(fd);
+    return 0;
+}
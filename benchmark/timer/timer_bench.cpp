@@ -0,0 +1,112 @@
+/**
+ * Compare the heap and the timing wheel TimerQueue with many connection-style timeouts.
+ * Inserts timers spread over a minute, cancels half of them, then times the expiry of a
+ * burst of short timers while the long ones are still pending. The burst timers take the given
+ * slack, the timerfd_settime calls made and saved by it are counted.
+ *
+ * Usage: timer_bench [timers] [wheel tick in seconds] [slack in seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double insertNs;
+    double cancelNs;
+    double expireNs;
+    double maxLatenessMs;
+    uint64_t timerfdUpdates;
+    uint64_t timerfdUpdatesAvoided;
+};
+
+Result run(TimerBackend backend, int numTimers, double tick, double slack)
+{
+    EventLoop::Options options;
+    options.timers = backend;
+    options.timerTick = tick;
+    auto loop = EventLoop::create(options);
+    loop->setLoopStats(true);
+    Result result = {0, 0, 0, 0, 0, 0};
+    std::vector<std::shared_ptr<TimerHandler>> timers;
+    timers.reserve(numTimers);
+    int numShort = numTimers / 10;
+    int fired = 0;
+    Histogram::Snapshot ioBefore;
+    uint64_t updatesBefore = 0, avoidedBefore = 0;
+    std::mt19937 rng(42);
+
+    loop->queueInLoop([&]() {
+        std::uniform_real_distribution<double> timeout(1.0, 60.0);
+        MonotonicTime now = MonotonicTime::now();
+        MonotonicTime start = now;
+        for (int i = 0; i < numTimers; ++i)
+            timers.push_back(loop->addTimer([]() {}, addTime(now, timeout(rng))));
+        //Timers are put in the queue by the functors addTimer posted, this one runs after all of them
+        loop->queueInLoop([&, start]() {
+            result.insertNs = timeDifference(MonotonicTime::now(), start) * 1e9 / numTimers;
+
+            MonotonicTime cancelStart = MonotonicTime::now();
+            for (int i = 0; i < numTimers; i += 2)
+                timers[i]->disable();
+            result.cancelNs = timeDifference(MonotonicTime::now(), cancelStart) * 1e9 / ((numTimers + 1) / 2);
+
+            ioBefore = loop->loopStats().ioNs;
+            updatesBefore = loop->timerfdUpdates();
+            avoidedBefore = loop->timerfdUpdatesAvoided();
+            std::uniform_real_distribution<double> burst(0.02, 0.1);
+            MonotonicTime now = MonotonicTime::now();
+            for (int i = 0; i < numShort; ++i)
+            {
+                MonotonicTime when = addTime(now, burst(rng));
+                loop->addTimer([&, when]() {
+                    double lateness = timeDifference(MonotonicTime::now(), when) * 1e3;
+                    if (lateness > result.maxLatenessMs)
+                        result.maxLatenessMs = lateness;
+                    if (++fired == numShort)
+                        loop->endLoop();
+                }, when, 0.0, slack);
+            }
+        });
+    });
+    loop->loop();
+    //Handler time of the burst, mostly the timerfd handler
+    Histogram::Snapshot io = loop->loopStats().ioNs.since(ioBefore);
+    result.expireNs = static_cast<double>(io.sum) / numShort;
+    result.timerfdUpdates = loop->timerfdUpdates() - updatesBefore;
+    result.timerfdUpdatesAvoided = loop->timerfdUpdatesAvoided() - avoidedBefore;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int numTimers = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    double tick = argc > 2 ? std::atof(argv[2]) : 0.001;
+    double slack = argc > 3 ? std::atof(argv[3]) : 0.0;
+    if (numTimers < 10 || tick <= 0 || slack < 0)
+    {
+        std::fprintf(stderr, "Usage: %s [timers >= 10] [wheel tick in seconds] [slack in seconds]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%d timers over 1-60s, half cancelled, then %d timers over 20-100ms with %gs slack, wheel tick %gs\n",
+                numTimers, numTimers / 10, slack, tick);
+    std::printf("%-8s %14s %14s %14s %16s %14s %14s\n", "backend", "insert ns/op", "cancel ns/op", "expire ns/op",
+                "max late ms", "timerfd sets", "sets avoided");
+    const TimerBackend backends[] = {TimerBackend::Heap, TimerBackend::Wheel};
+    const char *names[] = {"heap", "wheel"};
+    for (int i = 0; i < 2; ++i)
+    {
+        Result r = run(backends[i], numTimers, tick, slack);
+        std::printf("%-8s %14.1f %14.1f %14.1f %16.3f %14llu %14llu\n", names[i], r.insertNs, r.cancelNs, r.expireNs,
+                    r.maxLatenessMs, static_cast<unsigned long long>(r.timerfdUpdates),
+                    static_cast<unsigned long long>(r.timerfdUpdatesAvoided));
+    }
+    return 0;
+}
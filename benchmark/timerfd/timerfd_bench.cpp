@@ -0,0 +1,138 @@
+/**
+ * Syscalls spent on timers, with a timerfd and with the poll timeout taken from the next deadline.
+ * Repeating 1ms timers are staggered so each one is due at a time of its own, the worst case for
+ * the timerfd which then goes off and is set again per timer. Syscalls are the poller's ones, reads
+ * from /proc/self/io and timerfd_settime calls.
+ *
+ * Usage: timerfd_bench [timers per second] [seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double firedPerSec;
+    double wakeupsPerSec;
+    double syscallsPerSec;
+    double cpuMsPerSec;
+    double meanLatenessUs;
+    double maxLatenessUs;
+};
+
+//Read syscalls made by the process so far
+static uint64_t readSyscalls()
+{
+    FILE *file = std::fopen("/proc/self/io", "r");
+    if (!file)
+        return 0;
+    char line[128];
+    unsigned long long count = 0;
+    while (std::fgets(line, sizeof line, file))
+    {
+        if (std::sscanf(line, "syscr: %llu", &count) == 1)
+            break;
+    }
+    std::fclose(file);
+    return count;
+}
+
+static double cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+Result run(TimerBackend backend, bool timerfd, int rate, double seconds)
+{
+    EventLoop::Options options;
+    options.timers = backend;
+    options.timerfd = timerfd;
+    auto loop = EventLoop::create(options);
+    const double interval = 0.001;
+    int numTimers = std::max(1, static_cast<int>(rate * interval));
+    std::vector<std::shared_ptr<TimerHandler>> timers(numTimers);
+    uint64_t fired = 0;
+    double latenessSum = 0, maxLateness = 0;
+    uint64_t pollBefore = 0, readsBefore = 0, setsBefore = 0, wakeupsBefore = 0;
+    double cpuStart = 0;
+    MonotonicTime start;
+
+    loop->runInLoop([&]() {
+        start = addTime(loop->now(), 0.01);
+        for (int i = 0; i < numTimers; ++i)
+        {
+            //Staggered over the interval
+            MonotonicTime first = addTime(start, interval * i / numTimers);
+            timers[i] = loop->addTimer([&, i]() {
+                double lateness = timeDifference(MonotonicTime::now(), timers[i]->expiration()) * 1e6;
+                latenessSum += lateness;
+                maxLateness = std::max(maxLateness, lateness);
+                ++fired;
+            }, first, interval);
+        }
+        loop->addTimer([&]() {
+            pollBefore = loop->pollStats().syscalls;
+            wakeupsBefore = loop->pollStats().blockingWaits;
+            readsBefore = readSyscalls();
+            setsBefore = loop->timerfdUpdates();
+            cpuStart = cpuSeconds();
+            fired = 0;
+            latenessSum = maxLateness = 0;
+        }, start);
+        loop->addTimer([&]() {
+            for (auto &timer : timers)
+                timer->cancel();
+            loop->endLoop();
+        }, addTime(start, seconds));
+    });
+    loop->loop();
+    uint64_t syscalls = (loop->pollStats().syscalls - pollBefore) + (readSyscalls() - readsBefore) +
+                        (loop->timerfdUpdates() - setsBefore);
+    Result result;
+    result.firedPerSec = fired / seconds;
+    result.wakeupsPerSec = (loop->pollStats().blockingWaits - wakeupsBefore) / seconds;
+    result.syscallsPerSec = syscalls / seconds;
+    result.cpuMsPerSec = (cpuSeconds() - cpuStart) * 1e3 / seconds;
+    result.meanLatenessUs = fired ? latenessSum / fired : 0;
+    result.maxLatenessUs = maxLateness;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int rate = argc > 1 ? std::atoi(argv[1]) : 100000;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+    if (rate <= 0 || seconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [timers per second] [seconds]\n", argv[0]);
+        return 1;
+    }
+    std::printf("%d timers/s by %d staggered 1ms repeating timers, for %gs\n", rate, std::max(1, rate / 1000), seconds);
+    std::printf("%-8s %-8s %10s %10s %12s %10s %12s %14s %14s\n", "backend", "wakeup", "fired/s", "wakeups/s",
+                "syscalls/s", "per wakeup", "cpu ms/s", "mean late us", "max late us");
+    const TimerBackend backends[] = {TimerBackend::Heap, TimerBackend::Wheel};
+    const char *names[] = {"heap", "wheel"};
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int timerfd = 1; timerfd >= 0; --timerfd)
+        {
+            Result r = run(backends[i], timerfd, rate, seconds);
+            std::printf("%-8s %-8s %10.0f %10.0f %12.0f %10.2f %12.1f %14.1f %14.1f\n", names[i],
+                        timerfd ? "timerfd" : "poll", r.firedPerSec, r.wakeupsPerSec, r.syscallsPerSec,
+                        r.wakeupsPerSec > 0 ? r.syscallsPerSec / r.wakeupsPerSec : 0.0, r.cpuMsPerSec,
+                        r.meanLatenessUs, r.maxLatenessUs);
+        }
+    }
+    return 0;
+}
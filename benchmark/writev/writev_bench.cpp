@@ -0,0 +1,128 @@
+/**
+ * HTTP like responses of a header, a body and a trailer, concatenated into one string and written, against
+ * the parts sent with TCPConnection::writev. The next response is sent on write complete. The client end is a
+ * TCPConnection over a socketpair in the same loop that drains what arrives, and checks the first response
+ * byte by byte.
+ *
+ * Usage: writev_bench [body KB] [seconds]
+ */
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/net/TCPConnection.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace Hohnor;
+
+struct Result
+{
+    double responsesPerSec;
+    //User CPU per GB received, where the concatenation shows up
+    double userMsPerGb;
+    bool intact;
+};
+
+static double userSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+}
+
+Result run(bool useWritev, const std::string &body, double seconds)
+{
+    std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: ";
+    header += std::to_string(body.size()) + "\r\n\r\n";
+    const std::string trailer = "\r\n";
+    const std::string expected = header + body + trailer;
+    auto loop = EventLoop::create();
+    TCPConnectionPtr server, client;
+    std::string first;
+    uint64_t received = 0;
+    uint64_t responses = 0;
+    Result result = {0, 0, false};
+
+    auto respond = [&, useWritev](TCPConnectionPtr conn) {
+        ++responses;
+        if (useWritev)
+        {
+            conn->writev({header, body, trailer});
+        }
+        else
+        {
+            std::string response;
+            response.reserve(header.size() + body.size() + trailer.size());
+            response += header;
+            response += body;
+            response += trailer;
+            conn->write(response);
+        }
+    };
+
+    loop->runInLoop([&]() {
+        int fds[2];
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, fds);
+        server = TCPConnection::create(loop->handleIO(fds[0]));
+        client = TCPConnection::create(loop->handleIO(fds[1]));
+        server->setWriteCompleteCallback(respond);
+        client->setReadCompleteCallback([&](TCPConnectionPtr conn) {
+            Buffer &buffer = conn->getReadBuffer();
+            if (first.size() < expected.size())
+                first.append(buffer.peek(), std::min(buffer.readableBytes(), expected.size() - first.size()));
+            received += buffer.readableBytes();
+            buffer.retrieveAll();
+        });
+        client->readRaw();
+        respond(server);
+
+        MonotonicTime start = MonotonicTime::now();
+        double startUser = userSeconds();
+        uint64_t startResponses = responses;
+        loop->addTimer([&, start, startUser, startResponses]() {
+            double elapsed = timeDifference(MonotonicTime::now(), start);
+            result.responsesPerSec = (responses - startResponses) / elapsed;
+            result.userMsPerGb = (userSeconds() - startUser) * 1e3 / (received / 1e9);
+            result.intact = first == expected;
+            server->setWriteCompleteCallback([](TCPConnectionPtr) {});
+            loop->endLoop();
+        }, addTime(loop->now(), seconds));
+    });
+    loop->loop();
+    server.reset();
+    client.reset();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int bodyKb = argc > 1 ? std::atoi(argv[1]) : 64;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 3.0;
+    if (bodyKb <= 0 || seconds <= 0)
+    {
+        std::fprintf(stderr, "Usage: %s [body KB] [seconds]\n", argv[0]);
+        return 1;
+    }
+    std::string body(static_cast<size_t>(bodyKb) * 1024, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = static_cast<char>('a' + i % 26);
+
+    std::printf("%d KB body per response, %gs each\n", bodyKb, seconds);
+    std::printf("%-8s %14s %14s %8s\n", "send", "responses/s", "user ms/GB", "intact");
+    const char *names[] = {"concat", "writev"};
+    //Twice in turns, the first rounds warm up
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            Result r = run(i == 1, body, seconds);
+            if (round == 1)
+                std::printf("%-8s %14.0f %14.1f %8s\n", names[i], r.responsesPerSec, r.userMsPerGb, r.intact ? "yes" : "NO");
+        }
+    }
+    return 0;
+}
@@ -6,12 +6,13 @@
 
 #include "hohnor/core/EventLoop.h"
 #include "hohnor/core/Signal.h"
-#include "hohnor/net/TCPAcceptor.h"
+#include "hohnor/net/TCPServer.h"
 #include "hohnor/net/InetAddress.h"
 #include "hohnor/net/TCPConnection.h"
 #include "hohnor/core/IOHandler.h"
 #include "hohnor/time/Timestamp.h"
 #include "hohnor/log/Logging.h"
+#include "hohnor/thread/Mutex.h"
 #include <iostream>
 #include <memory>
 #include <unordered_map>
@@ -40,10 +41,15 @@ struct ConnectionStats {
 class WrkHttpServer {
 private:
     EventLoopPtr loop_;
-    TCPAcceptorPtr listenSocket_;
+    TCPServerPtr server_;
+    // Connections live in different IO loops, the maps are shared among them
+    Mutex clientsLock_;
     std::unordered_map<int, TCPConnectionPtr> clients_;
-    std::unordered_map<int, ConnectionStats> clientStats_;
+    std::unordered_map<int, std::shared_ptr<ConnectionStats>> clientStats_;
     uint16_t port_;
+    size_t numLoops_;
+    int busyPollUsec_;
+    bool loopStats_;
     bool running_;
     std::atomic<uint64_t> totalRequests_;
     std::atomic<uint64_t> totalBytesReceived_;
@@ -58,8 +64,8 @@ private:
     static constexpr double REPORT_INTERVAL = 5.0; // Report every 5 seconds
 
 public:
-    WrkHttpServer(EventLoopPtr loop, uint16_t port) 
-        : loop_(loop), port_(port), running_(false), 
+    WrkHttpServer(EventLoopPtr loop, uint16_t port, size_t numLoops = 0, int busyPollUsec = 0, bool loopStats = false) 
+        : loop_(loop), port_(port), numLoops_(numLoops), busyPollUsec_(busyPollUsec), loopStats_(loopStats), running_(false), 
           totalRequests_(0), totalBytesReceived_(0), totalBytesSent_(0),
           serverStartTime_(Timestamp::now()) {
         
@@ -74,23 +80,30 @@ public:
         }
 
         try {
-            // Create TCP listen socket
-            listenSocket_ = TCPAcceptor::create(loop_);
+            // Create TCP server, connections are spread over numLoops_ IO loops
+            server_ = TCPServer::create(loop_, InetAddress(port_, false, false), "WrkServer"); // port, not loopback only, not ipv6
+            server_->setLoopNum(numLoops_);
+            if (busyPollUsec_ > 0 || loopStats_) {
+                // Every loop serving connections spins before blocking in epoll, and/or times its phases
+                int busyPollUsec = busyPollUsec_;
+                bool loopStats = loopStats_;
+                server_->setThreadInitCallback([busyPollUsec, loopStats](EventLoopPtr ioLoop) {
+                    ioLoop->setBusyPoll(busyPollUsec);
+                    ioLoop->setLoopStats(loopStats);
+                });
+            }
 
             // Set socket options for high performance
-            listenSocket_->setReuseAddr(true);
-            listenSocket_->setReusePort(true);
-            listenSocket_->setTCPNoDelay(true);  // Disable Nagle's algorithm
-            listenSocket_->setKeepAlive(true);   // Enable keep-alive
-            
-            // Bind to address and port
-            listenSocket_->bindAddress(port_, false, false); // port, not loopback only, not ipv6
-            
-            // Start listening
-            listenSocket_->listen();
+            server_->acceptor()->setReuseAddr(true);
+            server_->acceptor()->setReusePort(true);
+            server_->acceptor()->setTCPNoDelay(true);  // Disable Nagle's algorithm
+            server_->acceptor()->setKeepAlive(true);   // Enable keep-alive
             
-            // Set accept callback
-            listenSocket_->setAcceptCallback(std::bind(&WrkHttpServer::handleNewConnection, this, std::placeholders::_1));
+            // Set connection callback, it runs in the IO loop owning the connection
+            server_->setConnectionCallback(std::bind(&WrkHttpServer::handleNewConnection, this, std::placeholders::_1));
+
+            // Start IO loops and listening
+            server_->start();
 
             running_ = true;
             serverStartTime_ = Timestamp::now();
@@ -98,6 +111,11 @@ public:
             std::cout << "====================================================" << std::endl;
             std::cout << "wrk-compatible HTTP Server started" << std::endl;
             std::cout << "Listening on: http://localhost:" << port_ << std::endl;
+            std::cout << "IO loops: " << (numLoops_ ? numLoops_ : 1) << std::endl;
+            std::cout << "Poller backend: " << pollerBackendName(loop_->backend()) << std::endl;
+            if (busyPollUsec_ > 0) {
+                std::cout << "Busy poll: " << busyPollUsec_ << " usec" << std::endl;
+            }
             std::cout << "Ready for wrk benchmarking" << std::endl;
             std::cout << "====================================================" << std::endl;
             std::cout << "Example wrk command:" << std::endl;
@@ -122,15 +140,19 @@ public:
         printFinalStats();
         
         // Close all client connections
-        for (auto& pair : clients_) {
-            pair.second->forceClose();
+        {
+            MutexGuard guard(clientsLock_);
+            for (auto& pair : clients_) {
+                pair.second->forceClose();
+            }
+            clients_.clear();
+            clientStats_.clear();
         }
-        clients_.clear();
-        clientStats_.clear();
         
-        // Close listen socket
-        if (listenSocket_) {
-            listenSocket_.reset();
+        // Stop listening and end IO loops
+        if (server_) {
+            server_->stop();
+            server_.reset();
         }
         
         std::cout << "HTTP Server stopped." << std::endl;
@@ -176,14 +198,21 @@ private:
             
             // Set TCP options for performance
             clientConnection->setTCPNoDelay(true);
+            if (busyPollUsec_ > 0) {
+                clientConnection->setBusyPoll(busyPollUsec_);
+            }
             
             // Store client connection and initialize stats
-            clients_[clientFd] = clientConnection;
-            clientStats_[clientFd] = ConnectionStats();
+            auto stats = std::make_shared<ConnectionStats>();
+            {
+                MutexGuard guard(clientsLock_);
+                clients_[clientFd] = clientConnection;
+                clientStats_[clientFd] = stats;
+            }
 
-            // Set up client callbacks
-            clientConnection->setReadCompleteCallback([this, clientFd](TCPConnectionPtr conn) {
-                this->handleHttpRequest(clientFd);
+            // Set up client callbacks, the stats are captured so that requests do not touch the shared maps
+            clientConnection->setReadCompleteCallback([this, stats](TCPConnectionPtr conn) {
+                this->handleHttpRequest(conn, *stats);
             });
 
             clientConnection->setCloseCallback([this, clientFd]() {
@@ -202,15 +231,7 @@ private:
         }
     }
 
-    void handleHttpRequest(int clientFd) {
-        auto it = clients_.find(clientFd);
-        if (it == clients_.end()) {
-            return;
-        }
-
-        auto clientConnection = it->second;
-        auto& stats = clientStats_[clientFd];
-        
+    void handleHttpRequest(TCPConnectionPtr clientConnection, ConnectionStats& stats) {
         try {
             // Get data from the read buffer
             Buffer& readBuffer = clientConnection->getReadBuffer();
@@ -238,7 +259,7 @@ private:
             }
         } catch (const std::exception& e) {
             std::cerr << "Error handling HTTP request: " << e.what() << std::endl;
-            handleClientError(clientFd);
+            handleClientError(clientConnection->fd());
         }
     }
 
@@ -262,10 +283,10 @@ private:
     }
 
     void handleClientDisconnect(int clientFd) {
+        MutexGuard guard(clientsLock_);
         auto it = clientStats_.find(clientFd);
         if (it != clientStats_.end()) {
-            auto& stats = it->second;
-            stats.active = false;
+            it->second->active = false;
         }
         
         clients_.erase(clientFd);
@@ -294,6 +315,11 @@ private:
         uint64_t currentRequests = totalRequests_.load();
         uint64_t currentBytesReceived = totalBytesReceived_.load();
         uint64_t currentBytesSent = totalBytesSent_.load();
+        size_t connections = 0;
+        {
+            MutexGuard guard(clientsLock_);
+            connections = clients_.size();
+        }
         
         double requestsPerSec = currentRequests / totalDuration;
         double mbpsReceived = (currentBytesReceived * 8.0) / (totalDuration * 1000000.0);
@@ -302,7 +328,7 @@ private:
         std::cout << "[" << std::fixed << std::setprecision(1) << totalDuration << "s] "
                   << "Requests: " << currentRequests 
                   << " (" << std::setprecision(0) << requestsPerSec << " req/s), "
-                  << "Connections: " << clients_.size()
+                  << "Connections: " << connections
                   << ", RX: " << std::setprecision(1) << mbpsReceived << " Mbps"
                   << ", TX: " << mbpsSent << " Mbps" << std::endl;
     }
@@ -328,9 +354,52 @@ private:
         std::cout << "Total Bytes Sent: " << formatBytes(finalBytesSent) << std::endl;
         std::cout << "Average RX Throughput: " << std::setprecision(1) << avgMbpsReceived << " Mbps" << std::endl;
         std::cout << "Average TX Throughput: " << avgMbpsSent << " Mbps" << std::endl;
+        // Syscalls spent by the pollers of all IO loops, the figure to compare backends with
+        if (server_ && server_->threadPool()) {
+            uint64_t syscalls = 0;
+            for (auto &ioLoop : server_->threadPool()->getAllLoops()) {
+                syscalls += ioLoop->pollStats().syscalls;
+            }
+            std::cout << "Poller Syscalls: " << syscalls << std::endl;
+            if (finalRequests > 0) {
+                std::cout << "Poller Syscalls/Request: " << std::setprecision(3)
+                          << static_cast<double>(syscalls) / finalRequests << std::endl;
+            }
+            if (loopStats_) {
+                printLoopStats();
+            }
+        }
         std::cout << "====================================================" << std::endl;
     }
 
+    // Per-loop phase timing, the loop with the highest IO or pending time is the bottleneck
+    void printLoopStats() {
+        int index = 0;
+        std::cout << "Loop phases in usec (p50/p99/max), events and functors per iteration (mean):" << std::endl;
+        for (auto &ioLoop : server_->threadPool()->getAllLoops()) {
+            auto stats = ioLoop->loopStats();
+            std::cout << "  loop " << index++ << std::setprecision(1)
+                      << ": iterations " << stats.waitNs.count
+                      << ", wait " << formatPhase(stats.waitNs)
+                      << ", io " << formatPhase(stats.ioNs)
+                      << ", pending " << formatPhase(stats.pendingNs)
+                      << ", events " << stats.eventsPerWakeup.mean()
+                      << ", functors " << stats.functorsPerDrain.mean();
+            if (stats.slowestHandlerFd >= 0) {
+                std::cout << ", slowest handler fd " << stats.slowestHandlerFd
+                          << " " << stats.slowestHandlerNs / 1000.0 << " usec";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    static std::string formatPhase(const Histogram::Snapshot &ns) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(1) << ns.percentile(50) / 1000.0 << "/"
+            << ns.percentile(99) / 1000.0 << "/" << ns.max / 1000.0;
+        return oss.str();
+    }
+
     std::string formatBytes(uint64_t bytes) {
         if (bytes >= 1000000000) {
             return std::to_string(bytes / 1000000) + " MB";
@@ -346,10 +415,14 @@ void printUsage(const char* program) {
     std::cout << "Usage: " << program << " [options]" << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "  -p, --port <port>     Server port to listen on (default: 8080)" << std::endl;
+    std::cout << "  -l, --loops <num>     Number of IO loops, one thread each (default: 0, accept loop only)" << std::endl;
+    std::cout << "  -b, --busy-poll <us>  Spin this many microseconds in each IO loop before blocking (default: 0, off)" << std::endl;
+    std::cout << "  --backend <name>      Poller backend, epoll or io_uring (default: epoll)" << std::endl;
+    std::cout << "  -s, --loop-stats      Time phases of every IO loop and print them at exit" << std::endl;
     std::cout << "  -h, --help            Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Example:" << std::endl;
-    std::cout << "  " << program << " -p 8080" << std::endl;
+    std::cout << "  " << program << " -p 8080 --loops 4" << std::endl;
     std::cout << std::endl;
     std::cout << "Then test with wrk:" << std::endl;
     std::cout << "  wrk -t12 -c400 -d30s http://localhost:8080/" << std::endl;
@@ -357,6 +430,10 @@ void printUsage(const char* program) {
 
 int main(int argc, char* argv[]) {
     uint16_t port = 8080;  // Default port
+    size_t numLoops = 0;   // Default: serve connections in the accept loop
+    int busyPollUsec = 0;  // Default: always block in epoll
+    EventLoop::Options options;  // Default: epoll backend
+    bool loopStats = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -373,6 +450,46 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Option " << arg << " requires an argument" << std::endl;
                 return 1;
             }
+        } else if (arg == "-l" || arg == "--loops") {
+            if (i + 1 < argc) {
+                int loops = std::atoi(argv[++i]);
+                if (loops < 0) {
+                    std::cerr << "Invalid loop number: " << argv[i] << std::endl;
+                    return 1;
+                }
+                numLoops = static_cast<size_t>(loops);
+            } else {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-b" || arg == "--busy-poll") {
+            if (i + 1 < argc) {
+                busyPollUsec = std::atoi(argv[++i]);
+                if (busyPollUsec < 0) {
+                    std::cerr << "Invalid busy poll time: " << argv[i] << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--backend") {
+            if (i + 1 < argc) {
+                std::string backend = argv[++i];
+                if (backend == "epoll") {
+                    options.backend = PollerBackend::Epoll;
+                } else if (backend == "io_uring") {
+                    options.backend = PollerBackend::IOUring;
+                } else {
+                    std::cerr << "Invalid backend: " << backend << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-s" || arg == "--loop-stats") {
+            loopStats = true;
         } else if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
             return 0;
@@ -384,11 +501,11 @@ int main(int argc, char* argv[]) {
     }
 
     try {
-        // Create event loop
-        auto loop = EventLoop::create();
+        // Create event loop, IO loops are created with the same options
+        auto loop = EventLoop::create(options);
         
         // Create wrk HTTP server
-        WrkHttpServer server(loop, port);
+        WrkHttpServer server(loop, port, numLoops, busyPollUsec, loopStats);
 
         // Set up signal handling for graceful shutdown
         loop->handleSignal(SIGINT, SignalAction::Handled, [&]() {
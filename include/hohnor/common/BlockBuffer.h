@@ -0,0 +1,72 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "hohnor/common/NonCopyable.h"
+#include "hohnor/common/StringPiece.h"
+
+namespace Hohnor {
+/// A chain of fixed size blocks for data appended at the back and consumed from the front, such as the
+/// pending output of a connection. Growing never copies nor moves the bytes already in it, and a block is
+/// handed back as soon as it is consumed.
+///
+///  front block                                    back block
+/// +----------+----------+   +----------------+   +----------+----------+
+/// | consumed | readable |-->|    readable    |-->| readable | writable |
+/// +----------+----------+   +----------------+   +----------+----------+
+///            readIndex_                                     writeIndex_
+///
+/// Blocks come from a free list of the calling thread that keeps up to kMaxPooledBlocks. Not thread safe.
+class BlockBuffer : NonCopyable {
+public:
+    static const size_t kBlockSize = 16 * 1024;
+    static const size_t kMaxPooledBlocks = 64;
+
+    BlockBuffer() : blocks_(), readIndex_(0), writeIndex_(0), readable_(0) {}
+    ~BlockBuffer() { retrieveAll(); }
+
+    size_t readableBytes() const { return readable_; }
+    size_t numBlocks() const { return blocks_.size(); }
+
+    // --- Append Operations ---
+    void append(const char* data, size_t len);
+    void append(const StringPiece& str) { append(str.data(), str.size()); }
+    void append(const std::string& str) { append(str.data(), str.size()); }
+
+    // --- Read Operations ---
+    // Readable bytes of the front block, the rest follow in later blocks
+    StringPiece front() const {
+        return blocks_.empty() ? StringPiece() : StringPiece(blocks_.front() + readIndex_, static_cast<int>(frontBytes()));
+    }
+
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAllAsString();
+
+    // --- IO ---
+    // Write up to maxBytes readable bytes with one writev of up to IOV_MAX blocks and retrieve what was written
+    ssize_t writeFd(int fd, int* savedErrno, size_t maxBytes = SIZE_MAX);
+
+    // Blocks in the free list of the calling thread
+    static size_t pooledBlocks();
+
+private:
+    size_t frontBytes() const {
+        assert(!blocks_.empty());
+        return (blocks_.size() == 1 ? writeIndex_ : kBlockSize) - readIndex_;
+    }
+
+    std::deque<char*> blocks_;
+    // Offset of the first readable byte in the front block
+    size_t readIndex_;
+    // Offset of the first writable byte in the back block
+    size_t writeIndex_;
+    size_t readable_;
+};
+
+} // namespace
@@ -20,13 +20,56 @@ namespace Hohnor {
 /// +-------------------+------------------+------------------+
 /// |                   |                  |                  |
 /// 0      <=      readerIndex  <=      writerIndex     <=     size
+///
+/// Storage comes in size classes from a free list of the calling thread, and goes back there when the buffer
+/// grows out of it, is released or destroyed. A released buffer, or one constructed with initialSize 0, holds no
+/// storage until the next write.
 class Buffer {
 public:
+    // Storage sizes of the pooled classes are (kCheapPrepend + kInitialSize) << 2 * class
+    static const size_t kSizeClasses = 5;
+    // Storage the free list keeps per class
+    static const size_t kMaxPooledBytes = 1024 * 1024;
+
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize),
-          readerIndex_(kCheapPrepend),
-          writerIndex_(kCheapPrepend),
-          lastWriteBytes_(0) {}
+        : buffer_(),
+          readerIndex_(0),
+          writerIndex_(0),
+          lastWriteBytes_(0)
+    {
+        if (initialSize > 0) {
+            buffer_ = acquireStorage(kCheapPrepend + initialSize);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = kCheapPrepend;
+        }
+    }
+    Buffer(const Buffer&) = default;
+    Buffer& operator=(const Buffer&) = default;
+    // The moved from buffer is left released
+    Buffer(Buffer&& rhs)
+        : buffer_(),
+          readerIndex_(rhs.readerIndex_),
+          writerIndex_(rhs.writerIndex_),
+          lastWriteBytes_(rhs.lastWriteBytes_)
+    {
+        buffer_.swap(rhs.buffer_);
+        rhs.readerIndex_ = 0;
+        rhs.writerIndex_ = 0;
+    }
+    Buffer& operator=(Buffer&& rhs)
+    {
+        if (this != &rhs) {
+            releaseStorage(buffer_);
+            buffer_.swap(rhs.buffer_);
+            readerIndex_ = rhs.readerIndex_;
+            writerIndex_ = rhs.writerIndex_;
+            lastWriteBytes_ = rhs.lastWriteBytes_;
+            rhs.readerIndex_ = 0;
+            rhs.writerIndex_ = 0;
+        }
+        return *this;
+    }
+    ~Buffer() { releaseStorage(buffer_); }
 
     // --- Capacity and Index Info ---
     size_t readableBytes() const { return writerIndex_ - readerIndex_; }
@@ -64,8 +107,17 @@ public:
     }
 
     void retrieveAll() {
-        readerIndex_ = kCheapPrepend;
-        writerIndex_ = kCheapPrepend;
+        readerIndex_ = std::min(kCheapPrepend, buffer_.size());
+        writerIndex_ = readerIndex_;
+    }
+
+    // Hand the storage back to the free list if nothing is readable, e.g. when an idle connection drained it
+    void release() {
+        if (readableBytes() == 0) {
+            releaseStorage(buffer_);
+            readerIndex_ = 0;
+            writerIndex_ = 0;
+        }
     }
 
     std::string retrieveAllAsString() {
@@ -132,6 +184,10 @@ public:
 
     // --- Prepend Operations ---
     void prepend(const void* data, size_t len) {
+        // A buffer without storage takes it first, so that it has the cheap prepend again
+        if (buffer_.empty()) {
+            makeSpace(0);
+        }
         assert(len <= prependableBytes());
         readerIndex_ -= len;
         const char* d = static_cast<const char*>(data);
@@ -158,7 +214,8 @@ public:
     }
     
     void ensureWritable(size_t len) {
-        if (writableBytes() < len) {
+        // Also when len is 0, so that beginWrite() points into storage
+        if (writableBytes() < len || buffer_.empty()) {
             makeSpace(len);
         }
         assert(writableBytes() >= len);
@@ -183,23 +240,43 @@ public:
 
     void shrink(size_t reserve)
     {
-        // FIXME: use vector::shrink_to_fit() in C++ 11 if possible.
-        Buffer other;
-        other.ensureWritable(readableBytes()+reserve);
-        other.append(readableSlice());
-        swap(other);
+        if (readableBytes() + reserve == 0) {
+            release();
+        }
+        else {
+            moveToStorage(kCheapPrepend + readableBytes() + reserve);
+        }
     }
 
     ssize_t lastWriteBytes() const { return lastWriteBytes_; }
 
+    // Storage in the free list of the calling thread
+    static size_t pooledBytes();
+
 private:
-    char* begin() { return &*buffer_.begin(); }
-    const char* begin() const { return &*buffer_.begin(); }
+    char* begin() { return buffer_.data(); }
+    const char* begin() const { return buffer_.data(); }
+
+    // Pooled storage of the smallest class that fits size, or at least size bytes beyond the largest class
+    static std::vector<char> acquireStorage(size_t size);
+    // Leave storage empty, its bytes go to the free list if it is of a class that is not full
+    static void releaseStorage(std::vector<char>& storage);
+
+    // Readable bytes go right after the cheap prepend of new storage
+    void moveToStorage(size_t size) {
+        std::vector<char> storage = acquireStorage(size);
+        size_t readable = readableBytes();
+        std::copy(begin() + readerIndex_, begin() + writerIndex_, storage.data() + kCheapPrepend);
+        releaseStorage(buffer_);
+        buffer_.swap(storage);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend + readable;
+    }
 
     void makeSpace(size_t len) {
         if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-            // Grow the buffer
-            buffer_.resize(writerIndex_ + len);
+            // Grow at least twice, so appends beyond the pooled classes stay amortized
+            moveToStorage(std::max(kCheapPrepend + readableBytes() + len, buffer_.size() * 2));
         } else {
             // Move readable data to make space, preserve cheap prepend
             size_t readable = readableBytes();
@@ -4,17 +4,22 @@
 
 #pragma once
 #include <functional>
+#include "hohnor/common/InlineFunction.h"
+#include "hohnor/time/MonotonicTime.h"
 
 namespace Hohnor
 {
     typedef std::function<void()> Callback;
-    typedef std::function<void()> Functor;
-    typedef std::function<void()> ReadCallback;
-    typedef std::function<void()> WriteCallback;
-    typedef std::function<void()> CloseCallback;
-    typedef std::function<void()> ErrorCallback;
+    //Callbacks on hot paths are move-only and do not allocate for small closures
+    typedef InlineFunction<void()> Functor;
+    typedef InlineFunction<void()> ReadCallback;
+    typedef InlineFunction<void()> WriteCallback;
+    typedef InlineFunction<void()> CloseCallback;
+    typedef InlineFunction<void()> ErrorCallback;
     typedef std::function<void()> SignalCallback;
-    typedef std::function<void()> TimerCallback;
+    typedef InlineFunction<void()> TimerCallback;
     typedef std::function<void(char)> KeyboardCallback;
+    //Resumable task run in slices, each call should return by deadline, true if there is more work left
+    typedef InlineFunction<bool(MonotonicTime deadline)> SlicedTask;
 
 } // namespace Hohnor
@@ -0,0 +1,113 @@
+/**
+ * Histogram of unsigned values in power of 2 buckets, used for latency and size distributions.
+ * One thread records, any thread may take a snapshot without locking. A snapshot taken in the middle
+ * of record() may see the value in some fields only, which is acceptable for statistics.
+ */
+#pragma once
+#include "hohnor/common/NonCopyable.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace Hohnor
+{
+    class Histogram : NonCopyable
+    {
+    public:
+        //Bucket 0 counts value 0, bucket i counts values in [2^(i-1), 2^i)
+        static const int kBuckets = 65;
+
+        struct Snapshot
+        {
+            Snapshot() : count(0), sum(0), max(0)
+            {
+                for (int i = 0; i < kBuckets; ++i)
+                    buckets[i] = 0;
+            }
+            uint64_t count;
+            uint64_t sum;
+            uint64_t max;
+            uint64_t buckets[kBuckets];
+
+            double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+            //Upper bound of the bucket that holds the p-th percentile (0 < p <= 100), capped by max
+            uint64_t percentile(double p) const
+            {
+                if (count == 0)
+                    return 0;
+                uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+                if (rank == 0)
+                    rank = 1;
+                uint64_t seen = 0;
+                for (int i = 0; i < kBuckets; ++i)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank)
+                        return bucketUpperBound(i) < max ? bucketUpperBound(i) : max;
+                }
+                return max;
+            }
+            //Values recorded after earlier was taken, max can not be told apart and is kept from this one
+            Snapshot since(const Snapshot &earlier) const
+            {
+                Snapshot delta;
+                for (int i = 0; i < kBuckets; ++i)
+                {
+                    delta.buckets[i] = buckets[i] - earlier.buckets[i];
+                    delta.count += delta.buckets[i];
+                }
+                delta.sum = sum - earlier.sum;
+                delta.max = max;
+                return delta;
+            }
+        };
+
+        Histogram() : sum_(0), max_(0)
+        {
+            for (int i = 0; i < kBuckets; ++i)
+                buckets_[i].store(0, std::memory_order_relaxed);
+        }
+
+        //Recording thread only
+        void record(uint64_t value)
+        {
+            std::atomic<uint64_t> &bucket = buckets_[bucketOf(value)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            if (value > max_.load(std::memory_order_relaxed))
+                max_.store(value, std::memory_order_relaxed);
+        }
+
+        //Thread safe
+        Snapshot snapshot() const
+        {
+            Snapshot s;
+            for (int i = 0; i < kBuckets; ++i)
+            {
+                s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+                s.count += s.buckets[i];
+            }
+            s.sum = sum_.load(std::memory_order_relaxed);
+            s.max = max_.load(std::memory_order_relaxed);
+            return s;
+        }
+
+        static int bucketOf(uint64_t value)
+        {
+            return value == 0 ? 0 : 64 - __builtin_clzll(value);
+        }
+
+        static uint64_t bucketUpperBound(int bucket)
+        {
+            if (bucket == 0)
+                return 0;
+            if (bucket >= 64)
+                return UINT64_MAX;
+            return (static_cast<uint64_t>(1) << bucket) - 1;
+        }
+
+    private:
+        std::atomic<uint64_t> buckets_[kBuckets];
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+    };
+} // namespace Hohnor
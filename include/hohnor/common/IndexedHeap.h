@@ -0,0 +1,125 @@
+/**
+ * D-ary heap that tracks the position of its elements, so that any element can be removed or
+ * moved after its key changed in O(log n). Smallest-top according to LessThan.
+ */
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Hohnor
+{
+    /**
+     * LessThan is a functor type bool(const T &, const T &).
+     * SetIndex is a functor type void(T &, size_t) that the heap calls whenever an element lands at a
+     * new index, and with npos when it leaves the heap. The element keeps the index to pass to
+     * remove() and update().
+     */
+    template <class T, class LessThan, class SetIndex, size_t Arity = 4>
+    class IndexedHeap
+    {
+        static_assert(Arity >= 2, "Heap needs at least 2 children per node");
+
+    public:
+        static const size_t npos = static_cast<size_t>(-1);
+
+        IndexedHeap() : vec_(), lessThan_(), setIndex_() {}
+
+        size_t size() const { return vec_.size(); }
+        bool empty() const { return vec_.empty(); }
+        const T &top() const { return vec_[0]; }
+
+        void push(T item)
+        {
+            vec_.push_back(std::move(item));
+            siftUp(vec_.size() - 1);
+        }
+
+        T pop() { return remove(0); }
+
+        //Take out the element at index
+        T remove(size_t index)
+        {
+            assert(index < vec_.size() && "Removing out of the heap");
+            T res = std::move(vec_[index]);
+            setIndex_(res, npos);
+            if (index + 1 != vec_.size())
+            {
+                vec_[index] = std::move(vec_.back());
+                vec_.pop_back();
+                update(index);
+            }
+            else
+            {
+                vec_.pop_back();
+            }
+            return res;
+        }
+
+        //Restore the order after the key of element at index changed
+        void update(size_t index)
+        {
+            assert(index < vec_.size() && "Updating out of the heap");
+            if (index > 0 && lessThan_(vec_[index], vec_[parent(index)]))
+                siftUp(index);
+            else
+                siftDown(index);
+        }
+
+    private:
+        static size_t parent(size_t child) { return (child - 1) / Arity; }
+        static size_t firstChild(size_t parent) { return parent * Arity + 1; }
+
+        void siftUp(size_t index)
+        {
+            T save = std::move(vec_[index]);
+            while (index > 0)
+            {
+                size_t p = parent(index);
+                if (!lessThan_(save, vec_[p]))
+                    break;
+                place(index, std::move(vec_[p]));
+                index = p;
+            }
+            place(index, std::move(save));
+        }
+
+        void siftDown(size_t index)
+        {
+            T save = std::move(vec_[index]);
+            size_t size = vec_.size();
+            while (true)
+            {
+                size_t child = firstChild(index);
+                if (child >= size)
+                    break;
+                size_t last = child + Arity < size ? child + Arity : size;
+                size_t least = child;
+                for (++child; child < last; ++child)
+                {
+                    if (lessThan_(vec_[child], vec_[least]))
+                        least = child;
+                }
+                if (!lessThan_(vec_[least], save))
+                    break;
+                place(index, std::move(vec_[least]));
+                index = least;
+            }
+            place(index, std::move(save));
+        }
+
+        void place(size_t index, T &&item)
+        {
+            vec_[index] = std::move(item);
+            setIndex_(vec_[index], index);
+        }
+
+        std::vector<T> vec_;
+        LessThan lessThan_;
+        SetIndex setIndex_;
+    };
+
+    template <class T, class LessThan, class SetIndex, size_t Arity>
+    const size_t IndexedHeap<T, LessThan, SetIndex, Arity>::npos;
+} // namespace Hohnor
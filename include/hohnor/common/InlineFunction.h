@@ -0,0 +1,212 @@
+/**
+ * Move-only callable wrapper with inline storage, a replacement of std::function for callbacks in hot paths.
+ * Callables that fit in Capacity bytes and are nothrow movable live inside the object, so wrapping a lambda
+ * that captures a couple of shared_ptrs does not allocate. Bigger callables fall back to the heap.
+ * With the default capacity an InlineFunction takes exactly one cache line.
+ */
+#pragma once
+#include <cstddef>
+#include <functional> //std::bad_function_call
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Hohnor
+{
+    namespace detail
+    {
+        template <typename R, typename... Args>
+        struct FunctionOps
+        {
+            R (*invoke)(void *storage, Args &&...args);
+            //Move construct callable in dst from src, and destroy src
+            void (*move)(void *dst, void *src);
+            void (*destroy)(void *storage);
+        };
+
+        template <typename F, bool Inline, typename R, typename... Args>
+        struct FunctionModel;
+
+        //Callable stored in place
+        template <typename F, typename R, typename... Args>
+        struct FunctionModel<F, true, R, Args...>
+        {
+            static F *get(void *storage) { return static_cast<F *>(storage); }
+            static R invoke(void *storage, Args &&...args) { return (*get(storage))(std::forward<Args>(args)...); }
+            static void move(void *dst, void *src)
+            {
+                ::new (dst) F(std::move(*get(src)));
+                get(src)->~F();
+            }
+            static void destroy(void *storage) { get(storage)->~F(); }
+            static const FunctionOps<R, Args...> ops;
+        };
+        template <typename F, typename R, typename... Args>
+        const FunctionOps<R, Args...> FunctionModel<F, true, R, Args...>::ops = {&invoke, &move, &destroy};
+
+        //Callable on heap, storage keeps the pointer
+        template <typename F, typename R, typename... Args>
+        struct FunctionModel<F, false, R, Args...>
+        {
+            static F *get(void *storage) { return *static_cast<F **>(storage); }
+            static R invoke(void *storage, Args &&...args) { return (*get(storage))(std::forward<Args>(args)...); }
+            static void move(void *dst, void *src) { *static_cast<F **>(dst) = get(src); }
+            static void destroy(void *storage) { delete get(storage); }
+            static const FunctionOps<R, Args...> ops;
+        };
+        template <typename F, typename R, typename... Args>
+        const FunctionOps<R, Args...> FunctionModel<F, false, R, Args...>::ops = {&invoke, &move, &destroy};
+
+        template <typename F, typename... Args>
+        struct IsCallable
+        {
+            template <typename G>
+            static auto test(int) -> decltype(std::declval<G &>()(std::declval<Args>()...), std::true_type());
+            template <typename G>
+            static std::false_type test(...);
+            static const bool value = decltype(test<F>(0))::value;
+        };
+    } // namespace detail
+
+    template <typename Signature, size_t Capacity = 48>
+    class InlineFunction;
+
+    template <typename R, typename... Args, size_t Capacity>
+    class InlineFunction<R(Args...), Capacity>
+    {
+        typedef typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type Storage;
+        typedef detail::FunctionOps<R, Args...> Ops;
+
+        template <typename F>
+        struct FitsInline
+        {
+            static const bool value = sizeof(F) <= sizeof(Storage) && alignof(F) <= alignof(Storage) &&
+                                      std::is_nothrow_move_constructible<F>::value;
+        };
+
+        template <typename F>
+        using EnableIfCallable = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, InlineFunction>::value &&
+            detail::IsCallable<typename std::decay<F>::type, Args...>::value>::type;
+
+    public:
+        InlineFunction() noexcept : ops_(nullptr) {}
+        InlineFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+        template <typename F, typename = EnableIfCallable<F>>
+        InlineFunction(F &&f) : ops_(nullptr)
+        {
+            typedef typename std::decay<F>::type Callable;
+            //Null function pointers and empty std::functions make an empty InlineFunction, as std::function does
+            if (isEmpty(f))
+                return;
+            emplace<Callable>(std::forward<F>(f), std::integral_constant<bool, FitsInline<Callable>::value>());
+        }
+
+        InlineFunction(InlineFunction &&other) noexcept : ops_(other.ops_)
+        {
+            if (ops_)
+            {
+                ops_->move(&storage_, &other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+
+        InlineFunction &operator=(InlineFunction &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                if (other.ops_)
+                {
+                    other.ops_->move(&storage_, &other.storage_);
+                    ops_ = other.ops_;
+                    other.ops_ = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        InlineFunction &operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        template <typename F, typename = EnableIfCallable<F>>
+        InlineFunction &operator=(F &&f)
+        {
+            return *this = InlineFunction(std::forward<F>(f));
+        }
+
+        InlineFunction(const InlineFunction &) = delete;
+        InlineFunction &operator=(const InlineFunction &) = delete;
+
+        ~InlineFunction() { reset(); }
+
+        //Throw std::bad_function_call if empty, same as std::function
+        R operator()(Args... args) const
+        {
+            if (!ops_)
+                throw std::bad_function_call();
+            return ops_->invoke(const_cast<Storage *>(&storage_), std::forward<Args>(args)...);
+        }
+
+        explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+        void swap(InlineFunction &other) noexcept
+        {
+            InlineFunction tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+
+        //Whether a callable of type F is stored without heap allocation
+        template <typename F>
+        static constexpr bool storedInline() { return FitsInline<typename std::decay<F>::type>::value; }
+
+    private:
+        template <typename Callable, typename F>
+        void emplace(F &&f, std::true_type)
+        {
+            ::new (static_cast<void *>(&storage_)) Callable(std::forward<F>(f));
+            ops_ = &detail::FunctionModel<Callable, true, R, Args...>::ops;
+        }
+
+        template <typename Callable, typename F>
+        void emplace(F &&f, std::false_type)
+        {
+            ::new (static_cast<void *>(&storage_)) Callable *(new Callable(std::forward<F>(f)));
+            ops_ = &detail::FunctionModel<Callable, false, R, Args...>::ops;
+        }
+
+        void reset() noexcept
+        {
+            if (ops_)
+            {
+                ops_->destroy(&storage_);
+                ops_ = nullptr;
+            }
+        }
+
+        template <typename F>
+        static bool isEmpty(const F &) { return false; }
+        template <typename F>
+        static bool isEmpty(F *f) { return f == nullptr; }
+        template <typename Sig>
+        static bool isEmpty(const std::function<Sig> &f) { return !f; }
+
+        Storage storage_;
+        const Ops *ops_;
+    };
+
+    template <typename Signature, size_t Capacity>
+    bool operator==(const InlineFunction<Signature, Capacity> &f, std::nullptr_t) noexcept { return !f; }
+    template <typename Signature, size_t Capacity>
+    bool operator==(std::nullptr_t, const InlineFunction<Signature, Capacity> &f) noexcept { return !f; }
+    template <typename Signature, size_t Capacity>
+    bool operator!=(const InlineFunction<Signature, Capacity> &f, std::nullptr_t) noexcept { return static_cast<bool>(f); }
+    template <typename Signature, size_t Capacity>
+    bool operator!=(std::nullptr_t, const InlineFunction<Signature, Capacity> &f) noexcept { return static_cast<bool>(f); }
+
+} // namespace Hohnor
@@ -7,10 +7,16 @@
 #pragma once
 #include "hohnor/common/NonCopyable.h"
 #include "hohnor/common/Callbacks.h"
+#include "hohnor/common/Histogram.h"
 #include "hohnor/time/Timestamp.h"
+#include "hohnor/time/MonotonicTime.h"
+#include "hohnor/thread/MPSCQueue.h"
+#include "hohnor/io/Poller.h"
+#include "hohnor/core/Timer.h"
 #include "Signal.h"
 
 #include <atomic>
+#include <deque>
 #include <vector>
 #include <set>
 #include <unordered_map>
@@ -24,10 +30,9 @@ namespace Hohnor
     typedef std::shared_ptr<IOHandler> IOHandlerPtr;
     class TimerQueue;
     class TimerHandler;
+    class IdleReaper;
     class Timestamp;
     class SignalHandler;
-    class Mutex;
-    class Epoll;
     class ThreadPool;
     /**
      * 
@@ -35,33 +40,159 @@ namespace Hohnor
     class EventLoop : public NonCopyable, public std::enable_shared_from_this<EventLoop>
     {
         friend class IOHandler;
+    public:
+        //Options to create a loop with, default constructed ones give the classic epoll loop
+        struct Options
+        {
+            Options() : backend(PollerBackend::Epoll), timers(TimerBackend::Heap), timerTick(0.001), timerfd(true),
+                        coarseClock(false), idleTick(1.0), threadConfined(false) {}
+            //IO multiplexing backend, falls back to epoll if the kernel does not support it
+            PollerBackend backend;
+            //Data structure of timers, and tick in seconds of the wheel
+            TimerBackend timers;
+            double timerTick;
+            //Wake up for timers by a timerfd. If false, the poll waits no longer than the earliest timer deadline,
+            //by epoll_pwait2 to the microsecond if the kernel has it, and due timers run right after it. That saves
+            //the timerfd read and timerfd_settime calls, timerfdUpdates() stays 0
+            bool timerfd;
+            //Cache the time of each iteration from CLOCK_MONOTONIC_COARSE, cheaper to read but only as precise as
+            //the kernel tick (1-4ms). Timers still fire on time, now() and the timeouts taken from it are coarse
+            bool coarseClock;
+            //Precision in seconds of the idle timeouts of idleReaper()
+            double idleTick;
+            //The loop is created, used and run by one thread only, nothing is posted to it from others. It has no
+            //wake up eventfd, queues functors without atomic read-modify-writes and does not compare thread ids.
+            //"Thread safe" methods are then loop thread only, builds without NDEBUG abort on a call from another thread
+            bool threadConfined;
+        };
     private:
-        EventLoop();
+        explicit EventLoop(const Options &options);
     public:
-        static EventLoopPtr create();
+        static EventLoopPtr create(const Options &options = Options());
         ~EventLoop();
 
+        //Options this loop was created with
+        const Options &options() const { return options_; }
+        //Backend actually in use, may differ from options().backend after a fall back
+        PollerBackend backend() const { return poller_->backend(); }
+
         static EventLoop *loopOfCurrentThread();
 
         void setThreadPools(size_t size);
         void loop();
 
+        //Lanes of queued functors, drained in this order after IO handling
+        enum class Priority
+        {
+            //Drained completely every iteration, not limited by the pending budget
+            Urgent,
+            Normal,
+            //Runs on what is left of the budget after normal work, at least one per iteration so it can not starve
+            Background
+        };
+
         //If in the loop thread run immediatly, if not queue the callback in pending, thread safe
         void runInLoop(Functor callback);
         //Put callbacks in the pendingFunctors, thread safe
         void queueInLoop(Functor callback);
+        //Put callbacks in the lane of priority, thread safe
+        void queueInLoop(Functor callback, Priority priority);
+
+        //Limit normal and background functors run per iteration to maxFunctors and maxSeconds, 0 means no limit.
+        //Leftovers run in next iterations, meanwhile the loop polls without blocking so IO is still served, thread safe
+        void setPendingBudget(size_t maxFunctors, double maxSeconds = 0.0);
+        //Iterations that ran out of pending budget with work left, thread safe
+        uint64_t pendingBudgetExhausted() const { return pendingBudgetExhausted_.load(std::memory_order_relaxed); }
         //Put the callback into threadpool to run, thread safe
         void runInPool(Functor callback);
 
-        //Ask the loop to wake up from epoll immediately to deal with pending functors
+        //Run task in slices when the loop is idle: after IO and pending functors, on what is left of the idle budget
+        //of the iteration, or on a whole budget if the iteration had nothing else to do. Tasks take turns, one slice
+        //each, and the loop polls IO between slices without blocking until every task is done. A loop that is never
+        //idle starves them, thread safe
+        void runSliced(SlicedTask task);
+        //Run callback once when the loop is idle, before the slices, thread safe
+        void runWhenIdle(Functor callback);
+        //Time in seconds from poll return an iteration may spend up to on idle work, 1ms by default, thread safe
+        void setIdleBudget(double seconds);
+
+        //Ask the loop to wake up from epoll immediately to deal with pending functors, no-op for a thread confined loop
         void wakeUp();
         //End the loop
         void endLoop();
         //Get the iteration num
         int64_t iteration() { return iteration_; }
 
-        //Return timestamp of last poll_wait return
-        Timestamp pollReturnTime() { return pollReturnTime_; }
+        //Before blocking in epoll, spin on non-blocking epoll_wait for up to usec microseconds, 0 disables, thread safe
+        //It trades one busy core for lower latency, pair it with TCPConnection::setBusyPoll() to busy poll NIC queues as well
+        void setBusyPoll(int64_t usec) { busyPollUsec_ = usec; }
+        int64_t busyPoll() const { return busyPollUsec_; }
+
+        struct PollStats
+        {
+            //Blocking mode, epoll_wait that may sleep
+            uint64_t blockingWaits;
+            //Busy poll mode, epoll_wait(0) calls, budgets that ended with events, and budgets ran out before blocking
+            uint64_t busyPolls;
+            uint64_t busyPollHits;
+            uint64_t busyPollMisses;
+            //Total events returned by epoll
+            uint64_t events;
+            //Syscalls made by the poller, including epoll_ctl or io_uring_enter
+            uint64_t syscalls;
+            //Current size of epoll events array
+            size_t eventsSize;
+            //Events dropped because their handler was removed after the poll returned them
+            uint64_t staleEvents;
+        };
+        //Snapshot of polling statistics, thread safe
+        PollStats pollStats() const;
+
+        //Per-phase timing of loop iterations, off by default since it reads the clock around every handler.
+        //The slowest handler is reported per interval seconds, an interval ends at the first iteration after
+        //it elapsed, thread safe
+        void setLoopStats(bool on, double interval = 1.0);
+        bool loopStatsEnabled() const { return loopStatsEnabled_.load(std::memory_order_relaxed); }
+
+        struct LoopStats
+        {
+            //Nanoseconds blocked (or spinning) in the poller per iteration
+            Histogram::Snapshot waitNs;
+            //Nanoseconds running IO handlers per iteration
+            Histogram::Snapshot ioNs;
+            //Nanoseconds running pending functors per iteration
+            Histogram::Snapshot pendingNs;
+            //Events returned by each poll
+            Histogram::Snapshot eventsPerWakeup;
+            //Functors run by each drain of pending functors
+            Histogram::Snapshot functorsPerDrain;
+            //Slowest single IO handler run in the last full interval, 0 and -1 if there was none.
+            //Saturates at about 4.29 seconds
+            uint64_t slowestHandlerNs;
+            int slowestHandlerFd;
+        };
+        //Snapshot of loop statistics recorded since they were enabled, thread safe without locking the loop
+        LoopStats loopStats() const;
+
+        //Number of live IOHandlers created by this loop, including the loop's internal ones, thread safe
+        size_t ioHandlerCount() const { return ioHandlerCount_; }
+
+        //Number of epoll interest changes requested by IOHandlers, and number of epoll_ctl calls actually made
+        //to apply them. Changes are collapsed per handler and applied once per iteration, thread safe
+        uint64_t interestUpdatesRequested() const { return interestUpdatesRequested_.load(std::memory_order_relaxed); }
+        uint64_t interestUpdatesApplied() const { return interestUpdatesApplied_.load(std::memory_order_relaxed); }
+
+        //Number of timerfd_settime calls made, and number saved: timers due at different times that run in one
+        //wakeup, which slack makes common, and new timers for which the timerfd already goes off early enough, thread safe
+        uint64_t timerfdUpdates() const { return timers_->timerfdUpdates(); }
+        uint64_t timerfdUpdatesAvoided() const { return timers_->timerfdUpdatesAvoided(); }
+
+        //Time of the current iteration, read once when poll returns so hot paths of the loop thread do not read
+        //the clock each time. It is behind by the time spent in the iteration so far. Other threads get the clock
+        //read, a timeout from now() is never earlier than it should be
+        MonotonicTime now();
+        //Return timestamp of last poll_wait return, converted from the time of the iteration, thread safe
+        Timestamp pollReturnTime() { return now_.load(std::memory_order_relaxed).toTimestamp(); }
 
         //Assert that a thread that calls this method is the same thread as the loop
         void assertInLoopThread();
@@ -71,7 +202,25 @@ namespace Hohnor
 
         //Add timer event, threadsafe
         //If interval > 0, it is a repeated timer
-        std::shared_ptr<TimerHandler> addTimer(TimerCallback cb, Timestamp when, double interval = 0.0f);
+        //The timer may run up to slack seconds after when, timers whose windows overlap run in one wakeup
+        std::shared_ptr<TimerHandler> addTimer(TimerCallback cb, MonotonicTime when, double interval = 0.0f, double slack = 0.0);
+        //Same as above, when is converted by its distance from now, so the timer is not affected by later changes
+        //of the wall clock
+        std::shared_ptr<TimerHandler> addTimer(TimerCallback cb, Timestamp when, double interval = 0.0f, double slack = 0.0);
+        //Add timer for pacing that runs within microseconds of when, threadsafe.
+        //The loop wakes up spin seconds early and spins till when, so it is busy for up to spin per run. The first
+        //one lowers the timer slack of the loop thread to 1ns (PR_SET_TIMERSLACK). It is kept in a heap whatever
+        //the timer backend is. If interval > 0, it is a repeated timer
+        std::shared_ptr<TimerHandler> addPrecisionTimer(TimerCallback cb, MonotonicTime when, double interval = 0.0,
+                                                        double spin = 0.00005);
+        //Nanoseconds from expiration to run of timers, ordinary ones by the time the loop woke up and precision
+        //ones by the clock read right before their callbacks, thread safe
+        Histogram::Snapshot timerLateness() const { return timers_->lateness(); }
+        Histogram::Snapshot precisionTimerLateness() const { return timers_->preciseLateness(); }
+
+        //Reaper of idle timeouts of this loop, e.g. TCPConnection::setIdleTimeout(), created at first use.
+        //Loop thread only, nullptr after the loop ended
+        IdleReaper *idleReaper();
 
         //Handle a signal in a way you expect, thread safe
         void handleSignal(int signal, SignalAction action, SignalCallback cb = nullptr);
@@ -88,6 +237,7 @@ namespace Hohnor
             Polling,
             IOHandling,
             PendingHandling,
+            IdleHandling,
             End
         };
 
@@ -98,8 +248,9 @@ namespace Hohnor
         bool isQuited() const { return quit_; }
 
     private:
+        Options options_;
         //The essential of eventloop
-        Epoll * poller_;
+        Poller * poller_;
 
         std::atomic<bool> quit_;
         pid_t threadId_;
@@ -109,39 +260,141 @@ namespace Hohnor
         std::atomic<LoopState> state_;
 
         //Time when epoll returns
-        std::atomic<Timestamp> pollReturnTime_;
+        std::atomic<MonotonicTime> now_;
 
-        //Real time wakeup pipe, wakeup the loop from epoll to deal with pending Functors
+        //Real time wakeup pipe, wakeup the loop from epoll to deal with pending Functors, none if thread confined
         IOHandlerPtr wakeUpHandler_;
 
         TimerQueue * timers_;
+        std::unique_ptr<IdleReaper> idleReaper_;
 
-        //used for protecting pending Functors in mult-threading, change of evenloop data
-        //from other threads are only allowed to commit their change into pendingFunctors,
+        //Change of evenloop data from other threads are only allowed to commit their change into pendingFunctors,
         //And let the loop thread to actually run these changes, In this way we only need to
-        //mantain pendingFunctors to be thread-safe
-        Mutex * pendingFunctorsLock_;
-        //priorty map to functor
-        std::vector<Functor> pendingFunctors_;
+        //mantain pendingFunctors to be thread-safe. Lock free, any thread pushes, only loop thread pops.
+        //One queue per Priority
+        MPSCQueue<Functor> pendingFunctors_[3];
+        //Budget of normal and background functors per iteration, 0 means no limit
+        std::atomic<size_t> pendingBudgetFunctors_;
+        std::atomic<int64_t> pendingBudgetNs_;
+        //Loop thread only, functors are left over by the budget, so next poll must not block
+        bool pendingLeft_;
+        //Written by loop thread only
+        std::atomic<uint64_t> pendingBudgetExhausted_;
+        //Idle work, loop thread only
+        std::deque<SlicedTask> slicedTasks_;
+        std::vector<Functor> idleCallbacks_;
+        //Swapped with idleCallbacks_ while running, kept to reuse its capacity
+        std::vector<Functor> runningIdleCallbacks_;
+        std::atomic<int64_t> idleBudgetUs_;
+        //Set by the first post that needs a wake up and cleared by the loop before draining pendingFunctors,
+        //so a burst of posts writes the eventfd only once
+        std::atomic<bool> wakeUpPending_;
 
         std::unordered_map<int, std::shared_ptr<SignalHandler>> signalMap_;
 
         //ThreadPool for running tasks in background threads
         std::unique_ptr<ThreadPool> threadPool_;
 
+        //Maintained by IOHandler's ctor and dtor, used to balance connections among loops
+        std::atomic<size_t> ioHandlerCount_;
+
+        //Busy poll budget in microseconds
+        std::atomic<int64_t> busyPollUsec_;
+        //Written by loop thread only
+        std::atomic<uint64_t> blockingWaits_;
+        std::atomic<uint64_t> busyPolls_;
+        std::atomic<uint64_t> busyPollHits_;
+        std::atomic<uint64_t> busyPollMisses_;
+        std::atomic<uint64_t> polledEvents_;
+        std::atomic<size_t> eventsSize_;
+
+        //Handlers whose status or events changed in this iteration, applied to epoll right before polling
+        std::vector<IOHandlerPtr> pendingIOUpdates_;
+        //Swapped with pendingIOUpdates_ while applying, kept to reuse its capacity
+        std::vector<IOHandlerPtr> applyingIOUpdates_;
+
+        //Record of the handler polled on a fd, indexed by fd. Polled events carry (generation << 32 | fd),
+        //the generation changes whenever the fd is removed, so events that outlive their handler are dropped
+        struct IOSlot
+        {
+            IOSlot() : handler(NULL), generation(0) {}
+            IOHandler *handler;
+            uint32_t generation;
+        };
+        //Loop thread only
+        std::vector<IOSlot> ioSlots_;
+        //Written by loop thread only
+        std::atomic<uint64_t> staleEvents_;
+        //Written by loop thread only
+        std::atomic<uint64_t> interestUpdatesRequested_;
+        std::atomic<uint64_t> interestUpdatesApplied_;
+
+        std::atomic<bool> loopStatsEnabled_;
+        std::atomic<int64_t> loopStatsIntervalNs_;
+        //Written by loop thread only
+        Histogram waitNs_;
+        Histogram ioNs_;
+        Histogram pendingNs_;
+        Histogram eventsPerWakeup_;
+        Histogram functorsPerDrain_;
+        //Slowest handler of the interval in progress and of the last full one, packed as (nanoseconds << 32 | fd)
+        uint64_t slowestHandler_;
+        int64_t slowestIntervalStartNs_;
+        //Iteration last recorded, tells when stats have just been turned on
+        uint64_t lastTimedIteration_;
+        std::atomic<uint64_t> lastSlowestHandler_;
+
         static IOHandlerPtr interactiveIOHandler_;
 
         //To bind for wake up event
         void handleWakeUp();
 
+        //Always true for a thread confined loop, which checks it only in builds without NDEBUG
         bool isLoopThread();
+        //Phase changes are seen by other threads deciding to wake up the loop, not needed if thread confined
+        void setState(LoopState state)
+        {
+            state_.store(state, options_.threadConfined ? std::memory_order_relaxed : std::memory_order_seq_cst);
+        }
+        bool hasPendingFunctors() const
+        {
+            return !pendingFunctors_[0].empty() || !pendingFunctors_[1].empty() || !pendingFunctors_[2].empty();
+        }
+
+        //Wait for IO events, spinning first if busy poll is on
+        int poll(PollEvent **events);
+        //Drain the lanes of pending functors within the budget, return number of functors run
+        size_t runPendingFunctors();
+        //Run idle callbacks and slices of tasks, idle is true if the iteration had no events nor functors
+        void runIdleWork(bool idle);
+        bool hasIdleWork() const { return !slicedTasks_.empty() || !idleCallbacks_.empty(); }
+        void addSlicedTaskInLoop(SlicedTask &task);
+        void addIdleCallbackInLoop(Functor &callback);
+        //Dispatch polled events to their handlers. If timed, time each of them and return the slowest one packed
+        uint64_t handleEvents(PollEvent *events, int numEvents, bool timed);
+        //Record phases of an iteration, times are CLOCK_MONOTONIC nanoseconds
+        void recordLoopStats(int64_t pollStart, int64_t pollEnd, int64_t ioEnd, int64_t pendingEnd,
+                             int numEvents, size_t numFunctors, uint64_t slowestHandler);
 
-        //modify or remove existing IO event in the epoll
-        void updateIOHandler(IOHandlerPtr handler, bool addNew);
+        //Record that handler's status or events changed, the net change is applied to epoll before next poll
+        void updateIOHandler(IOHandler *handler);
+        //Add, modify or remove fds in epoll according to the recorded changes, skip those end up unchanged
+        void applyIOHandlerUpdates();
+
+        //Put handler in the slot of its fd, return the data its events are polled with
+        PollData bindIOSlot(IOHandler *handler);
+        //Release the slot of fd if it is still of generation, return false if it is not
+        bool unbindIOSlot(int fd, uint32_t generation);
+        static PollData ioSlotData(int fd, uint32_t generation)
+        {
+            PollData data;
+            data.u64 = (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+            return data;
+        }
 
-        //Remove a fd from epoll, 
+        //Remove a fd from epoll if its slot is still of generation,
         //used by IOHandler's destructor because 
         //in dtor we can not take out smart ptr to pass into function closure.
-        void removeFd(int fd);
+        void removeFd(int fd, uint32_t generation);
     };
 } // namespace Hohnor
@@ -0,0 +1,105 @@
+/**
+ * Threads that each own and run an EventLoop, and a pool of them for the multi-reactor model
+ */
+
+#pragma once
+#include "hohnor/common/NonCopyable.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/thread/Thread.h"
+#include "hohnor/thread/Mutex.h"
+#include "hohnor/thread/Condition.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Hohnor
+{
+    /**
+     * A thread that creates an EventLoop inside itself and runs it until stopLoop() is called.
+     * The loop is created in the new thread so that it is bound to that thread from the beginning.
+     */
+    class EventLoopThread : NonCopyable
+    {
+    public:
+        //Called in the new thread with the new loop, before the loop starts running
+        typedef std::function<void(EventLoopPtr)> ThreadInitCallback;
+
+        explicit EventLoopThread(ThreadInitCallback cb = nullptr, const std::string &name = std::string(),
+                                 const EventLoop::Options &options = EventLoop::Options());
+        ~EventLoopThread();
+
+        //Start the thread and block until its loop is running, return the loop
+        EventLoopPtr startLoop();
+        //End the loop and join the thread, safe to call multiple times
+        void stopLoop();
+        //Get the loop, nullptr before startLoop()
+        EventLoopPtr loop();
+
+    private:
+        void threadFunc();
+
+        EventLoopPtr loop_;
+        bool started_;
+        bool stopped_;
+        Mutex mutex_;
+        Condition cond_;
+        ThreadInitCallback callback_;
+        EventLoop::Options options_;
+        Thread thread_;
+    };
+
+    /**
+     * Pool of EventLoopThreads, one loop per thread. The base loop (usually the acceptor's loop)
+     * is not part of the pool, it is only used as fallback when the pool has no thread.
+     * Loops of the pool are created with the options of the base loop.
+     *
+     * Loops are handed out either round-robin or by the least number of live IOHandlers,
+     * which is a good approximation of the number of connections a loop serves.
+     */
+    class EventLoopThreadPool : NonCopyable
+    {
+    public:
+        typedef EventLoopThread::ThreadInitCallback ThreadInitCallback;
+        enum Distribution
+        {
+            RoundRobin,
+            LeastConnections
+        };
+
+        explicit EventLoopThreadPool(EventLoopPtr baseLoop, const std::string &name = std::string("EventLoopThreadPool"));
+        ~EventLoopThreadPool();
+
+        //Set function runs in every loop thread before its loop starts, must be set before start()
+        void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+        //Start threads and block until all loops are running
+        void start(size_t numThreads);
+        //End all loops and join their threads
+        void stop();
+
+        //Get next loop in round-robin order, thread safe
+        EventLoopPtr getNextLoop();
+        //Get the loop with least live IOHandlers, thread safe
+        EventLoopPtr getLeastLoadedLoop();
+        //Get a loop according to the distribution policy, thread safe
+        EventLoopPtr getLoop(Distribution distribution);
+        //Get all loops in the pool, or the base loop if the pool has no thread
+        std::vector<EventLoopPtr> getAllLoops();
+
+        EventLoopPtr baseLoop() { return baseLoop_; }
+        const std::string &name() const { return name_; }
+        //Number of loop threads
+        size_t size() const { return loops_.size(); }
+        bool started() const { return started_; }
+
+    private:
+        EventLoopPtr baseLoop_;
+        std::string name_;
+        bool started_;
+        std::atomic<size_t> next_;
+        ThreadInitCallback threadInitCallback_;
+        std::vector<std::unique_ptr<EventLoopThread>> threads_;
+        std::vector<EventLoopPtr> loops_;
+    };
+} // namespace Hohnor
@@ -6,6 +6,7 @@
 #include "hohnor/io/FdUtils.h"
 #include <memory>
 #include <atomic>
+#include <sys/epoll.h>
 
 namespace Hohnor
 {
@@ -39,13 +40,27 @@ namespace Hohnor
         int events_;
         int revents_;
         Status status_;
+        //Whether the fd is in epoll and with which events, only the loop updates them when it applies interest changes
+        bool registered_;
+        int registeredEvents_;
+        //Whether this handler is waiting in the loop's list of interest changes
+        bool updatePending_;
+        //Generation of the loop's slot of this fd while registered
+        uint32_t slotGeneration_;
         ReadCallback readCallback_;
         WriteCallback writeCallback_;
         CloseCallback closeCallback_;
         ErrorCallback errorCallback_;
         //update EPOLL in the loop
-        void updateInLoop(IOHandlerPtr handler, Status nextStatus);
+        void updateInLoop(Status nextStatus);
         void update(Status nextStatus);
+        void updateStatusInLoop(Status nextStatus);
+        //Turn event bits of mask on or off, the change reaches epoll before the loop polls again
+        void updateEvents(int mask, bool on);
+        void updateEventsInLoop(int mask, bool on);
+        //Move cb into slot and turn the event on if cb is set, in loop
+        void setCallback(ReadCallback IOHandler::*slot, int event, ReadCallback cb);
+        void setCallbackInLoop(ReadCallback IOHandler::*slot, int event, ReadCallback &cb);
         
         //Run the events according to revents
         void run();
@@ -90,6 +105,11 @@ namespace Hohnor
         void setWriteEvent(bool on);
         void setCloseEvent(bool on);
         void setErrorEvent(bool on);
+        //EPOLLET, events are reported once per change of readiness, the callbacks must then read or write
+        //until EAGAIN. Backends without edge-triggered mode keep reporting level-triggered, which is also correct
+        void setEdgeTriggered(bool on);
+        //this is not thread safe
+        bool isEdgeTriggered() { return events_ & EPOLLET; }
 
         void cleanCallbacks()
         {
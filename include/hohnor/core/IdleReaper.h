@@ -0,0 +1,92 @@
+/**
+ * Idle timeouts of many objects with one timer per loop. Objects record their last activity with a plain
+ * store, the reaper checks them in coarse buckets once per tick and calls back the ones idle for too long.
+ */
+#pragma once
+#include "hohnor/common/NonCopyable.h"
+#include "hohnor/common/Callbacks.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <memory>
+#include <vector>
+
+namespace Hohnor
+{
+    class EventLoop;
+    class TimerHandler;
+
+    /**
+     * An entry is owned by the object it tracks, the reaper only keeps weak references in the bucket of the
+     * tick its deadline falls in. Activity does not move it; when its bucket comes up an entry that was active
+     * meanwhile goes to the bucket of its new deadline. The buckets grow to span the longest timeout, so each
+     * entry is met at most once per timeout period.
+     * Releasing the entry stops tracking, the reaper drops the reference when it meets it. Loop thread only.
+     */
+    class IdleReaper : NonCopyable
+    {
+    public:
+        static const size_t kMinBuckets = 64;
+
+        class Entry : NonCopyable
+        {
+            friend class IdleReaper;
+        public:
+            //onIdle is called once in the loop thread when the entry has been idle for its timeout
+            explicit Entry(Functor onIdle);
+            //Record activity at now
+            void touch(MonotonicTime now) { lastActive_ = now; }
+            MonotonicTime lastActive() const { return lastActive_; }
+            double timeout() const { return static_cast<double>(timeoutUs_) / MonotonicTime::kMicroSecondsPerSecond; }
+            MonotonicTime deadline() const { return MonotonicTime(lastActive_.microSeconds() + timeoutUs_); }
+
+        private:
+            MonotonicTime lastActive_;
+            int64_t timeoutUs_;
+            Functor onIdle_;
+            //Tick of the bucket that holds the live reference
+            int64_t tick_;
+            //Bumped by each insert, references with another generation are left over by a move
+            uint64_t generation_;
+        };
+        typedef std::shared_ptr<Entry> EntryPtr;
+
+        //tick is the precision of timeouts in seconds, an entry is reaped up to one tick after its deadline
+        IdleReaper(EventLoop *loop, double tick);
+        ~IdleReaper();
+
+        //Track entry from now with timeout in seconds, or move it if it is tracked already
+        void add(const EntryPtr &entry, double timeout);
+        //References in buckets, including released entries not met yet
+        size_t size() const { return size_; }
+        //Entries reaped since created
+        uint64_t reaped() const { return reaped_; }
+        double tick() const { return static_cast<double>(tickUs_) / MonotonicTime::kMicroSecondsPerSecond; }
+
+    private:
+        int64_t tickOf(MonotonicTime time) const;
+        void insert(const EntryPtr &entry);
+        //Make the buckets span timeoutUs from the current tick
+        void reserve(int64_t timeoutUs);
+        //Called by the timer every tick
+        void handleTick();
+        void processBucket(int64_t tick, MonotonicTime now);
+
+        EventLoop *loop_;
+        const int64_t tickUs_;
+        const MonotonicTime start_;
+        //Last tick processed
+        int64_t currentTick_;
+        size_t size_;
+        uint64_t reaped_;
+        struct Ref
+        {
+            std::weak_ptr<Entry> entry;
+            uint64_t generation;
+        };
+        //Ring of ticks, size is a power of 2
+        std::vector<std::vector<Ref>> buckets_;
+        //Bucket being processed, kept to reuse its capacity
+        std::vector<Ref> processing_;
+        //Runs only while there are references
+        std::shared_ptr<TimerHandler> timer_;
+    };
+} // namespace Hohnor
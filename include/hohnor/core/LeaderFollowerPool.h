@@ -0,0 +1,99 @@
+/**
+ * Leader/follower IO dispatch, threads of the pool share one epoll instead of owning a loop each
+ */
+
+#pragma once
+#include "hohnor/common/NonCopyable.h"
+#include "hohnor/common/InlineFunction.h"
+#include "hohnor/io/FdUtils.h"
+#include "hohnor/thread/Thread.h"
+#include "hohnor/thread/Mutex.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Hohnor
+{
+    /**
+     * Threads of the pool all wait in one epoll, each takes one event at a time so the others stay free for the
+     * next ones. Fds are armed with EPOLLONESHOT and re-armed after their callback returns, so callbacks of one fd
+     * never run at the same time, while different fds run in whichever thread is free. Uneven connections are
+     * spread by load instead of staying on the thread they were assigned to, which suits heavy work per event.
+     *
+     * State touched only by the callback of its fd needs no lock, e.g. the buffers of a connection. Anything else,
+     * like writes from other threads, needs its own. It has no timers nor pending functors, TCPConnection and
+     * the rest of the EventLoop world stay in the multi-reactor model.
+     */
+    class LeaderFollowerPool : NonCopyable
+    {
+    public:
+        //Called with the ready events of the fd, EPOLLIN etc.
+        typedef InlineFunction<void(uint32_t events)> EventCallback;
+
+        explicit LeaderFollowerPool(const std::string &name = std::string("LeaderFollowerPool"));
+        //Stop the threads and close the fds still added
+        ~LeaderFollowerPool();
+
+        //Start threads waiting in the epoll
+        void start(size_t numThreads);
+        //Wake up every thread and join them, callbacks running finish first
+        void stop();
+
+        //Take over fd and track events (EPOLLONESHOT is implied), fd is set non-blocking. Return 0 on success, the fd
+        //is closed on failure as well, thread safe
+        int add(int fd, uint32_t events, EventCallback callback);
+        //Change tracked events, applied at once or when the running callback returns, thread safe
+        int modify(int fd, uint32_t events);
+        //Stop tracking fd, it is closed once its callback is not running. Thread safe, also from its own callback
+        int remove(int fd);
+
+        size_t size() const { return threads_.size(); }
+        const std::string &name() const { return name_; }
+        //Events dispatched by each thread, tells how the load is spread, thread safe
+        std::vector<uint64_t> dispatched() const;
+
+    private:
+        struct Entry
+        {
+            Entry(int fd, uint32_t generation, uint32_t events, EventCallback callback)
+                : guard(fd), generation(generation), events(events), callback(std::move(callback)),
+                  mutex(), running(false), removed(false), missed(0) {}
+            //Closes the fd when the last thread holding the entry lets it go
+            FdGuard guard;
+            //Of the slot while the entry is in it
+            const uint32_t generation;
+            uint32_t events;
+            EventCallback callback;
+            //Guards the fields below and events
+            Mutex mutex;
+            bool running;
+            bool removed;
+            //Events taken by another thread while the callback was running, run by that callback's thread
+            uint32_t missed;
+        };
+        typedef std::shared_ptr<Entry> EntryPtr;
+        struct Slot
+        {
+            Slot() : entry(), generation(0) {}
+            EntryPtr entry;
+            uint32_t generation;
+        };
+
+        void threadFunc(size_t index);
+        void dispatch(const EntryPtr &entry, uint32_t events);
+        //epoll_ctl with the data of the entry's slot and EPOLLONESHOT
+        int arm(int op, const Entry &entry);
+
+        std::string name_;
+        FdGuard epollFd_;
+        //Level-triggered and never read, once written it wakes up every thread to quit
+        FdGuard stopFd_;
+        std::atomic<bool> quit_;
+        //Guards slots_
+        mutable Mutex mutex_;
+        std::vector<Slot> slots_;
+        std::vector<std::unique_ptr<Thread>> threads_;
+        std::unique_ptr<std::atomic<uint64_t>[]> dispatched_;
+    };
+} // namespace Hohnor
@@ -28,7 +28,7 @@ namespace Hohnor
         int signal_;
         IOHandlerPtr ioHandler_;
         EventLoopPtr loop_;
-        void createIOHandler(int fd, Functor cb);
+        void createIOHandler(int fd, SignalCallback cb);
     protected:
         SignalHandler(EventLoopPtr loop, int signal, SignalAction action, SignalCallback cb = nullptr);
     public:
@@ -3,10 +3,11 @@
  */
 
 #pragma once
-#include "hohnor/time/Timestamp.h"
+#include "hohnor/time/MonotonicTime.h"
 #include "hohnor/common/NonCopyable.h"
 #include "hohnor/common/Callbacks.h"
-#include "hohnor/common/BinaryHeap.h"
+#include "hohnor/common/IndexedHeap.h"
+#include "hohnor/common/Histogram.h"
 #include "hohnor/io/FdUtils.h"
 #include <atomic>
 #include <memory>
@@ -18,30 +19,89 @@ namespace Hohnor
     class EventLoop;
     typedef std::shared_ptr<EventLoop> EventLoopPtr;
     class TimerQueue;
-    class TimerHandler : NonCopyable, public std::enable_shared_from_this<TimerHandler> 
+    class TimerWheel;
+
+    //Node of the intrusive lists of TimerWheel, a list is a circular one headed by a node not in any timer
+    struct TimerWheelLink
+    {
+        TimerWheelLink() : prev(this), next(this) {}
+        bool linked() const { return next != this; }
+        //Insert this node before head, that is at the back of head's list
+        void linkBefore(TimerWheelLink *head)
+        {
+            prev = head->prev;
+            next = head;
+            head->prev->next = this;
+            head->prev = this;
+        }
+        void unlink()
+        {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+        TimerWheelLink *prev;
+        TimerWheelLink *next;
+    };
+
+    class TimerHandler : NonCopyable, private TimerWheelLink, public std::enable_shared_from_this<TimerHandler> 
     {
         friend class TimerQueue;
+        friend class TimerWheel;
     private:
         TimerCallback callback_;
-        Timestamp expiration_;
+        MonotonicTime expiration_;
         //if greater than 0 means it is a repeated event
         double interval_;
+        //How late the timer may fire, lets the queue fire timers close to each other in one wakeup
+        int64_t slackUs_;
+        //Precision timers only, how early the loop wakes up to spin till the expiration
+        int64_t spinUs_;
         std::atomic<bool> disabled_;
+        //Rescheduled from its own callback, the new expiration replaces the reload after the run
+        bool rescheduled_;
         const int64_t sequence_;
         EventLoop *loop_;
+        TimerQueue *queue_;
+        //Position in the queue's heap, npos if it is not there
+        size_t heapIndex_;
+        //Set while the timer is in a wheel, the wheel's reference keeps the timer alive
+        TimerWheel *wheel_;
+        std::shared_ptr<TimerHandler> wheelRef_;
+        //Tick the timer expires at and level * TimerWheel::kSlots + slot it is in, kDueSlot if it is due already
+        uint64_t wheelTick_;
+        int wheelSlot_;
         static std::atomic<uint64_t> s_numCreated_;
     protected:
-        TimerHandler(EventLoop *loop, TimerCallback callback, Timestamp when, double interval);
+        TimerHandler(EventLoop *loop, TimerCallback callback, MonotonicTime when, double interval, double slack, double spin);
+        //Time the queue has to wake up for this timer
+        int64_t wakeTimeUs() const { return expiration_.microSeconds() + slackUs_ - spinUs_; }
         void run();
         //Reload expiration with interval, so that timer run next loop
         void reloadInLoop();
+        void updateCallbackInLoop(TimerCallback &callback);
+        void cancelInLoop();
     public:
         //Update callback, thread safe
         void updateCallback(TimerCallback callback);
-        //Disable the timer, thread safe
-        void disable();
+        //Stop the timer and take it out of the queue in O(log n), releasing its callback, thread safe
+        void cancel();
+        //Same as cancel()
+        void disable() { cancel(); }
+        //Move the expiration to when, keeping the interval, thread safe.
+        //No effect on a timer that is cancelled, or a one-shot timer that has started running
+        void reschedule(MonotonicTime when);
+        //Same as above, when is converted by its distance from now
+        void reschedule(Timestamp when) { reschedule(MonotonicTime::fromTimestamp(when)); }
         //Get expiration time
-        Timestamp expiration() const { return expiration_; }
+        MonotonicTime expiration() const { return expiration_; }
+        //Latest time the timer fires at, expiration plus slack
+        MonotonicTime deadline() const { return MonotonicTime(expiration_.microSeconds() + slackUs_); }
+        //Get slack in seconds
+        double slack() const { return static_cast<double>(slackUs_) / MonotonicTime::kMicroSecondsPerSecond; }
+        //Get spin in seconds, 0 unless it is a precision timer
+        double spin() const { return static_cast<double>(spinUs_) / MonotonicTime::kMicroSecondsPerSecond; }
+        bool isPrecise() const { return spinUs_ > 0; }
         //Get repeat interval
         double getRepeatInterval() const { return interval_; }
         //Check if it is a repeat timer
@@ -52,31 +112,156 @@ namespace Hohnor
         ~TimerHandler() = default;
     };
 
+    /**
+     * Hierarchical timing wheel, kLevels wheels of kSlots slots, a slot of level L spans kSlots^L ticks.
+     * Insert and remove are O(1). A timer first goes to the level whose span covers its distance, and
+     * cascades down to finer levels as the wheel turns, so it fires in the first tick at or after its
+     * expiration, never earlier. A timer inserted with its tick passed already fires at the next advance.
+     * Loop thread only.
+     */
+    class TimerWheel : NonCopyable
+    {
+    public:
+        static const int kLevelBits = 8;
+        static const int kSlots = 1 << kLevelBits;
+        static const int kLevels = 4;
+        //wheelSlot_ of a timer in the due list
+        static const int kDueSlot = -1;
+
+        //Tick 0 starts at start, tick is in seconds
+        TimerWheel(MonotonicTime start, double tick);
+        //Release all timers, they are disabled
+        ~TimerWheel();
+
+        void insert(const std::shared_ptr<TimerHandler> &timer);
+        //Take the timer out, nothing happens if it is not in this wheel
+        void remove(TimerHandler *timer);
+        //Turn the wheel to now, append expired timers to expired in order of expiration
+        void advance(MonotonicTime now, std::vector<std::shared_ptr<TimerHandler>> &expired);
+        //Time the wheel has to be advanced at next, a tick that fires timers or cascades them.
+        //Invalid if the wheel is empty
+        MonotonicTime nextAdvance() const;
+
+        size_t size() const { return size_; }
+        double tick() const { return tickUs_ / static_cast<double>(MonotonicTime::kMicroSecondsPerSecond); }
+
+    private:
+        void link(TimerHandler *timer);
+        //Fire or cascade the slots of tick
+        void processTick(uint64_t tick, std::vector<std::shared_ptr<TimerHandler>> &expired);
+        //Tick at which the first occupied slot of level is processed, UINT64_MAX if none
+        uint64_t nextTickOfLevel(int level) const;
+        bool occupied(int slot) const { return occupied_[slot >> 6] & (1ULL << (slot & 63)); }
+
+        MonotonicTime start_;
+        int64_t tickUs_;
+        //Last tick processed
+        uint64_t currentTick_;
+        size_t size_;
+        TimerWheelLink slots_[kLevels * kSlots];
+        //Bit per slot of slots_, set if it may hold timers
+        uint64_t occupied_[kLevels * kSlots / 64];
+        //Timers inserted after their tick was processed
+        TimerWheelLink due_;
+    };
+
+    //Data structure of a loop's timers
+    enum class TimerBackend
+    {
+        //Binary heap with a precise timerfd deadline per earliest timer, suits few timers
+        Heap,
+        //Hierarchical timing wheel rounding expirations up to its tick, suits millions of timeouts
+        Wheel
+    };
+
     class IOHandler;
     typedef std::shared_ptr<IOHandler> IOHandlerPtr;
-    class Timestamp;
     class TimerQueue : public NonCopyable
     {
     friend class EventLoop;
+    friend class TimerHandler;
     public:
         ~TimerQueue();
+        uint64_t timerfdUpdates() const { return timerfdUpdates_.load(std::memory_order_relaxed); }
+        uint64_t timerfdUpdatesAvoided() const { return timerfdUpdatesAvoided_.load(std::memory_order_relaxed); }
+        //Nanoseconds from expiration to run of ordinary timers, by the time of the wakeup, and of precision
+        //timers, by the clock read right before their callbacks, thread safe
+        Histogram::Snapshot lateness() const { return lateness_.snapshot(); }
+        Histogram::Snapshot preciseLateness() const { return preciseLateness_.snapshot(); }
     protected:
-        explicit TimerQueue(EventLoop *loop);
+        //tick is the wheel's tick in seconds, unused by the heap. Without timerfd the loop waits for
+        //nextExpiration() in its poll and calls runExpired() after it
+        TimerQueue(EventLoop *loop, TimerBackend backend, double tick, bool timerfd);
     private:
         ///
         /// Schedules the callback to be run at given time,
-        /// repeats if @c interval > 0.0.
+        /// repeats if @c interval > 0.0, may be run up to @c slack seconds late.
+        /// A precision timer has @c spin > 0, it is woken up for that early and spun till @c when,
+        /// it always goes in the heap.
         ///
         /// Must be thread safe. Usually be called from other threads.
         std::shared_ptr<TimerHandler> addTimer(TimerCallback cb,
-                         Timestamp when,
-                         double interval);
+                         MonotonicTime when,
+                         double interval,
+                         double slack,
+                         double spin = 0.0);
         void addTimerInLoop(std::shared_ptr<TimerHandler> timerHandler);
+        //Put the timer in the heap or the wheel, arm timerfd if it is the earliest one
+        void insertInLoop(const std::shared_ptr<TimerHandler> &timerHandler);
+        //Put a timer that has run back by its next expiration, the timerfd is armed afterwards
+        void requeueInLoop(const std::shared_ptr<TimerHandler> &timerHandler);
+        void removeInLoop(TimerHandler *timerHandler);
+        void rescheduleInLoop(const std::shared_ptr<TimerHandler> &timerHandler, MonotonicTime when);
         // called when timerfd alarms
         void handleRead();
+        //Run the timers due at now, and arm timerfd for the rest
+        void runExpired(MonotonicTime now);
+        //Time timers have to be run at next, invalid if there are none
+        MonotonicTime nextExpiration() const;
+        //Set timerfd to when unless it is already set to go off earlier. It is set no sooner than 100us from now
+        //unless precise, then the wake up for a precision timer is not delayed past its expiration
+        void armTimerfd(MonotonicTime when, bool precise = false);
+        //Arm timerfd for nextExpiration()
+        void armNext();
+
+        struct TimerLessThan
+        {
+            bool operator()(const std::shared_ptr<TimerHandler> &lhs, const std::shared_ptr<TimerHandler> &rhs) const
+            {
+                //Ordered by deadline, the earliest time one of the timers must fire, precision timers by the
+                //time they must be woken up to spin
+                int64_t l = lhs->wakeTimeUs();
+                int64_t r = rhs->wakeTimeUs();
+                if (l != r)
+                    return l < r;
+                return lhs->sequence_ < rhs->sequence_;
+            }
+        };
+        struct TimerSetIndex
+        {
+            void operator()(const std::shared_ptr<TimerHandler> &timer, size_t index) const { timer->heapIndex_ = index; }
+        };
+        typedef IndexedHeap<std::shared_ptr<TimerHandler>, TimerLessThan, TimerSetIndex> TimerHeap;
+
+        //Null if the loop runs timers without timerfd
         IOHandlerPtr timerFdIOHandle_;
         EventLoop *loop_;
-        BinaryHeap<std::shared_ptr<TimerHandler>> heap_;
+        TimerHeap heap_;
+        //Null unless the backend is Wheel, precision timers are in the heap still
+        std::unique_ptr<TimerWheel> wheel_;
+        //Time the timerfd is set to, invalid if it is not set
+        MonotonicTime armed_;
+        //timerfd_settime calls made, and saved by running timers due at different times in one wakeup or
+        //finding the timerfd already set early enough
+        std::atomic<uint64_t> timerfdUpdates_;
+        std::atomic<uint64_t> timerfdUpdatesAvoided_;
+        //Expired timers being run, kept to reuse its capacity
+        std::vector<std::shared_ptr<TimerHandler>> expired_;
+        //Written by loop thread only
+        Histogram lateness_;
+        Histogram preciseLateness_;
+        //PR_SET_TIMERSLACK is lowered by the first precision timer
+        bool timerSlackLowered_;
     };
 
 } // namespace Hohnor
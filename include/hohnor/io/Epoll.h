@@ -8,6 +8,7 @@
 #include "hohnor/common/NonCopyable.h"
 #include "hohnor/log/Logging.h"
 #include "hohnor/io/FdUtils.h"
+#include "hohnor/io/Poller.h"
 
 namespace Hohnor
 {
@@ -15,16 +16,29 @@ namespace Hohnor
      * Wrapper for ::epoll(2) in linux, 
      * kindly reminder that ctl Ops are safe while another thread is waiting.
      */
-    class Epoll : public FdGuard  //Inherited as FD holder class
+    class Epoll : public Poller, public FdGuard  //Inherited as FD holder class
     {
     private:
         typedef struct epoll_event epoll_event;
         //events for epoll_wait to pass results
         std::unique_ptr<epoll_event[]> events_;
-        //max size of events
+        //max size of events, adapted by wait() between minEventsSize_ and kMaxEventsSize
         size_t maxEventsSize_;
+        size_t minEventsSize_;
         //ready events after epoll_wait
         size_t readyEvents_;
+        //ready events of last epoll_wait, kept after Iter is gone
+        size_t lastReadyEvents_;
+        //Consecutive waits that used less than a quarter of events
+        size_t idleWaits_;
+        //Resize events before next epoll_wait, never while an Iter may be reading them
+        void adaptEventsSize();
+        //epoll_wait(2) or epoll_pwait(2) into events_
+        int waitEvents(int timeout, const sigset_t *sigmask);
+        //epoll_pwait2(2) into events_ with timeout in microseconds, epoll_wait(2) rounded up if the kernel lacks it
+        int waitEventsMicros(int64_t timeout);
+
+    public:
         class Iter
         {
         private:
@@ -33,6 +47,10 @@ namespace Hohnor
 
         public:
             Iter(Epoll *ptr) : ptr_(ptr), position_(0) {}
+            //Only one Iter owns the ready events, so that returning it from a function does not drop them
+            Iter(Iter &&other) : ptr_(other.ptr_), position_(other.position_) { other.ptr_ = NULL; }
+            Iter(const Iter &) = delete;
+            Iter &operator=(const Iter &) = delete;
             bool hasNext() { return position_ < size(); }
             ssize_t size() { return ptr_->readyEvents_; }
             epoll_event &next()
@@ -40,21 +58,40 @@ namespace Hohnor
                 HCHECK(position_ < ptr_->readyEvents_) << " Hohnor::Epoll::Iter::next() error";
                 return ptr_->events_[position_++];
             }
-            ~Iter() { ptr_->readyEvents_ = 0; }
+            ~Iter()
+            {
+                if (ptr_)
+                    ptr_->readyEvents_ = 0;
+            }
         };
 
-    public:
+        //Upper bound of the adaptive events array
+        static const size_t kMaxEventsSize = 65536;
+        //Shrink events array after this many consecutive waits that used less than a quarter of it
+        static const size_t kShrinkAfterIdleWaits = 64;
+
+        //maxEventsSize is the initial and smallest size of events array,
+        //it doubles when a wait fills it up and halves back when it stays mostly unused
         explicit Epoll(size_t maxEventsSize = 1024, bool closeOnExec = true);
         //epoll_ctl(2) interface
         int ctl(int cmd, int fd, epoll_event *event);
         //add fd to the RB tree, by default specify data as fd itself, if ptr is specified, then use the ptr
-        int add(int fd, int trackEvents, void *ptr = NULL);
+        int add(int fd, int trackEvents, void *ptr = NULL) override;
         //same as add interface but only modify existing fd in the RB tree
-        int modify(int fd, int trackEvents, void *ptr = NULL);
+        int modify(int fd, int trackEvents, void *ptr = NULL) override;
+        //add and modify with data reported as is
+        int add(int fd, int trackEvents, PollData data) override;
+        int modify(int fd, int trackEvents, PollData data) override;
         //remove a fd from RB tree
-        int remove(int fd);
+        int remove(int fd) override;
 
         Iter wait(int timeout = -1, const sigset_t *sigmask = NULL);
+        //Poller interface of wait()
+        int poll(int timeout, PollEvent **events) override;
+        int pollMicros(int64_t timeout, PollEvent **events) override;
+        //Current size of events array
+        size_t eventsSize() const override { return maxEventsSize_; }
+        PollerBackend backend() const override { return PollerBackend::Epoll; }
         ~Epoll() = default;
     };
 
@@ -0,0 +1,97 @@
+/**
+ * io_uring(7) backed poller, talks to the kernel with raw syscalls, liburing is not required
+ */
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "hohnor/io/FdUtils.h"
+#include "hohnor/io/Poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace Hohnor
+{
+    /**
+     * Readiness poller on io_uring. Every tracked fd has one IORING_OP_POLL_ADD in flight; a completed poll is
+     * re-armed at the next poll(), after the loop has handled the event, which keeps epoll's level-triggered
+     * semantics. Arming, re-arming and removing polls only queue SQEs, they are all submitted together with
+     * the wait in a single io_uring_enter(2), so interest changes cost no extra syscall.
+     */
+    class IOUring : public Poller, public FdGuard //Inherited as FD holder class
+    {
+    public:
+        //entries is size of submission queue, maxEventsSize is the initial capacity of ready events
+        explicit IOUring(unsigned entries = 1024, size_t maxEventsSize = 1024);
+        ~IOUring();
+
+        //Whether the ring is set up, false if kernel does not support io_uring (or forbids it) or lacks features we need
+        bool valid() const { return fd() >= 0 && sqes_ != NULL; }
+
+        int add(int fd, int trackEvents, void *ptr = NULL) override;
+        int modify(int fd, int trackEvents, void *ptr = NULL) override;
+        int add(int fd, int trackEvents, PollData data) override;
+        int modify(int fd, int trackEvents, PollData data) override;
+        int remove(int fd) override;
+        int poll(int timeout, PollEvent **events) override;
+        int pollMicros(int64_t timeout, PollEvent **events) override;
+        size_t eventsSize() const override { return events_.capacity(); }
+        PollerBackend backend() const override { return PollerBackend::IOUring; }
+
+    private:
+        struct Entry
+        {
+            Entry() : events(0), generation(0), tracked(false), armed(false) { data.u64 = 0; }
+            PollData data;
+            uint32_t events;
+            //Bumped whenever the poll of this fd is replaced, completions of older polls are ignored
+            uint32_t generation;
+            bool tracked;
+            //A poll is queued or in flight in kernel
+            bool armed;
+        };
+
+        //Get a free SQE, submit queued ones first if the submission queue is full
+        struct io_uring_sqe *getSqe();
+        void armPoll(int fd, Entry &entry);
+        void cancelPoll(int fd, Entry &entry);
+        //io_uring_enter(2), submit all queued SQEs, wait for at least one completion if wait is true,
+        //up to timeout microseconds
+        int enter(bool wait, int64_t timeout);
+        //Move completions into events_
+        void reapCompletions();
+
+        static uint64_t userData(int fd, uint32_t generation)
+        {
+            return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+        }
+
+        //Rings shared with kernel
+        void *sqRing_;
+        size_t sqRingSize_;
+        void *cqRing_;
+        size_t cqRingSize_;
+        struct io_uring_sqe *sqes_;
+        size_t sqesSize_;
+        unsigned *sqHead_;
+        unsigned *sqTail_;
+        unsigned *sqRingMask_;
+        unsigned *sqArray_;
+        unsigned sqEntries_;
+        unsigned *cqHead_;
+        unsigned *cqTail_;
+        unsigned *cqRingMask_;
+        struct io_uring_cqe *cqes_;
+        //Local tail of submission queue, published to kernel on enter
+        unsigned sqTailLocal_;
+        //SQEs queued but not consumed by kernel yet
+        unsigned toSubmit_;
+
+        //Indexed by fd
+        std::vector<Entry> entries_;
+        //fds whose poll completed in last poll(), re-armed in next poll()
+        std::vector<int> fired_;
+        std::vector<PollEvent> events_;
+    };
+
+} // namespace Hohnor
@@ -0,0 +1,74 @@
+/**
+ * IO multiplexing backend of an event loop
+ */
+#pragma once
+#include <cstddef> // NULL
+#include <atomic>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include "hohnor/common/NonCopyable.h"
+
+namespace Hohnor
+{
+    enum class PollerBackend
+    {
+        Epoll,
+        IOUring
+    };
+
+    //Readiness event, same layout and bits for every backend (EPOLLIN == POLLIN, etc.)
+    typedef struct epoll_event PollEvent;
+    //User data reported with events of a fd
+    typedef epoll_data_t PollData;
+
+    /**
+     * Readiness-based poller interface, tracked fds are reported with the ptr or data they were added with.
+     * Only the loop thread that owns the poller may call it.
+     */
+    class Poller : NonCopyable
+    {
+    public:
+        virtual ~Poller() {}
+
+        //Start tracking fd, fd is set to be non-blocking, return 0 on success
+        virtual int add(int fd, int trackEvents, void *ptr = NULL) = 0;
+        //Change tracked events of fd, return 0 on success
+        virtual int modify(int fd, int trackEvents, void *ptr = NULL) = 0;
+        //Same as above, but events of fd are reported with data instead of ptr
+        virtual int add(int fd, int trackEvents, PollData data) = 0;
+        virtual int modify(int fd, int trackEvents, PollData data) = 0;
+        //Stop tracking fd, return 0 on success
+        virtual int remove(int fd) = 0;
+
+        //Wait up to timeout milliseconds (-1 forever, 0 returns immediately), return number of ready events,
+        //which are put in *events and stay valid until next poll()
+        virtual int poll(int timeout, PollEvent **events) = 0;
+        //Same as poll() with timeout in microseconds (-1 forever). Backends that can not wait that precisely round
+        //it up to milliseconds, so the wait never ends early
+        virtual int pollMicros(int64_t timeout, PollEvent **events)
+        {
+            return poll(timeout < 0 ? -1 : static_cast<int>((timeout + 999) / 1000), events);
+        }
+
+        //Current capacity of ready events
+        virtual size_t eventsSize() const = 0;
+        virtual PollerBackend backend() const = 0;
+
+        //Number of syscalls made by this poller, used to compare backends, thread safe
+        uint64_t syscalls() const { return syscalls_.load(std::memory_order_relaxed); }
+
+        //Create a poller of the backend, fall back to epoll if the backend is not supported by the kernel
+        static Poller *create(PollerBackend backend);
+
+    protected:
+        Poller() : syscalls_(0) {}
+        //Called by the owner thread only
+        void incSyscalls() { syscalls_.store(syscalls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> syscalls_;
+    };
+
+    const char *pollerBackendName(PollerBackend backend);
+
+} // namespace Hohnor
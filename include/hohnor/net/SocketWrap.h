@@ -80,6 +80,8 @@ namespace Hohnor
         constexpr auto readv = ::readv;
         //Direct use for writev(2)
         constexpr auto writev = ::writev;
+        //Direct use for sendfile(2)
+        constexpr auto sendfile = ::sendfile;
 
         //Direct use for recv(2)
         constexpr auto recv = ::recv;
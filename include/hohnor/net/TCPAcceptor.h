@@ -24,6 +24,8 @@ namespace Hohnor
     public:
         //Accept callback should take care if the handler is nullptr
         typedef std::function<void (TCPConnectionPtr)> AcceptCallback;
+        //Choose the loop that a newly accepted connection should live in
+        typedef std::function<EventLoopPtr ()> LoopSelector;
         
         // Static factory method to create shared_ptr instances
         static TCPAcceptorPtr create(EventLoopPtr loop, int options = SOCK_STREAM, bool ipv6 = false)
@@ -54,6 +56,11 @@ namespace Hohnor
 
         void setAcceptCallback(AcceptCallback cb);
 
+        //Hand accepted connections to the loops chosen by selector, thread safe.
+        //The connection is created and the accept callback is run in the chosen loop's thread.
+        //Put nullptr to keep connections in the acceptor's loop, which is the default
+        void setLoopSelector(LoopSelector selector);
+
         //Shutdown writing of the socket
         void shutdownWrite() { SocketFuncs::shutdownWrite(fd()); }
 
@@ -68,8 +75,12 @@ namespace Hohnor
             : ListenSocket(loop, ipv6 ? AF_INET6 : AF_INET, options | SOCK_STREAM, 0) {}
             
     private:
+        LoopSelector loopSelector_;
+
         //Actively accept a connection, return IOHandler
         IOHandlerPtr accept();
+        //Accept a connection and run cb with it in the loop chosen by loopSelector_
+        void acceptToSelectedLoop(const AcceptCallback &cb);
 
         //Hide setCallbacks from Socket into private, we don't need them
         using Socket::setReadCallback;
@@ -3,11 +3,18 @@
 #include "hohnor/common/NonCopyable.h"
 #include "hohnor/common/Callbacks.h"
 #include "hohnor/common/Buffer.h"
+#include "hohnor/common/BlockBuffer.h"
+#include "hohnor/core/IdleReaper.h"
 #include "hohnor/net/InetAddress.h"
 #include "hohnor/net/Socket.h"
+#include "hohnor/thread/MPSCQueue.h"
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
 #include <functional>
+#include <initializer_list>
+#include <vector>
 
 namespace Hohnor
 {
@@ -15,6 +22,7 @@ namespace Hohnor
     typedef std::shared_ptr<EventLoop> EventLoopPtr;
     class IOHandler;
     typedef std::shared_ptr<IOHandler> IOHandlerPtr;
+    class FdGuard;
     class TCPConnection;
     // Forward declaration for callback types
     typedef std::shared_ptr<TCPConnection> TCPConnectionPtr;
@@ -42,8 +50,8 @@ namespace Hohnor
         void setHighWaterMarkCallback(size_t highWaterMark, const HighWaterMarkCallback& cb);
         void setReadCompleteCallback(const ReadCompleteCallback& cb);
         void setWriteCompleteCallback(const WriteCompleteCallback& cb);
-        void setCloseCallback(const CloseCallback& cb);
-        void setErrorCallback(const ErrorCallback& cb);
+        void setCloseCallback(CloseCallback cb);
+        void setErrorCallback(ErrorCallback cb);
 
         // --- Connection Management ---
 
@@ -53,14 +61,28 @@ namespace Hohnor
         void readUntil(const std::string& delimiter);      // read until delimiter
         void readBytes(size_t length);                    // read specified number of bytes
         void readUntilCondition(ReadStopCondition condition); // read until condition is met
-        // Send data, copy provided data to write buffer
+        // Send data, called from another thread the bytes are copied before returning - thread safe
         void write(const void* data, int len);
         void write(const StringPiece message);
         void write(const std::string& message);
         void write(Buffer* buffer);
+        // Send data owned by the connection from now on, never copied to be handed to the loop - thread safe
+        void write(std::string&& message);
+        void write(Buffer&& buffer);
+        // Send shared bytes, e.g. one message to many connections, kept alive until written - thread safe
+        void write(const std::shared_ptr<const std::string>& message);
+        // Send the parts back to back with one writev(2), only the part the socket did not take is copied. Called
+        // from another thread, the parts are gathered into one string first - thread safe
+        void writev(const StringPiece* parts, size_t n);
+        void writev(std::initializer_list<StringPiece> parts) { writev(parts.begin(), parts.size()); }
+        // Send what was appended to getWriteBuffer(), after everything written before
         void write();
+        // Send length bytes of file fd from offset by sendfile(2), in order with the data written before and after,
+        // without copying them to user space. fd is duplicated, the caller may close it at once - thread safe
+        void sendFile(int fd, off_t offset, size_t length);
 
-        //Buffers
+        //Buffers, the write buffer only stages bytes for write(), pending output is kept in a chain of blocks.
+        //Both hold storage of the loop's pool only while bytes are in them
         Buffer& getReadBuffer() { return readBuffer_; }
         Buffer& getWriteBuffer() { return writeBuffer_; }
 
@@ -70,6 +92,9 @@ namespace Hohnor
         void forceClose();
         // Force close connection after delay - thread safe
         void forceCloseWithDelay(double seconds);
+        // Close the connection as if the peer closed it after no byte is read or written for seconds, 0 disables.
+        // Activity costs no timer operation, the loop's IdleReaper checks timeouts once per tick - thread safe
+        void setIdleTimeout(double seconds);
 
         bool isClosed() const{
             return getSocketHandler() == nullptr;
@@ -77,6 +102,13 @@ namespace Hohnor
 
         // --- Flow Control ---
         void setTCPNoDelay(bool on);
+        // SO_BUSY_POLL, let reads busy poll the device queue for up to usec microseconds, 0 disables
+        void setBusyPoll(int usec);
+        // Edge-triggered mode, every read or write event drains the socket until EAGAIN - thread safe
+        void setEdgeTriggered(bool on);
+        // Bytes read or written per event in edge-triggered mode, the rest is continued after other
+        // ready handlers had their turn - thread safe
+        void setEventBudget(size_t bytes);
 
         // --- TCP Info ---
         struct tcp_info getTCPInfo() const;
@@ -88,15 +120,60 @@ namespace Hohnor
         TCPConnection(IOHandlerPtr handler);
 
     private:
+        static const size_t kDefaultEventBudget = 256 * 1024;
+        // Queued writes flushOutbound() takes per iteration, the parts of one writev at most
+        static const size_t kOutboundBatch = 1024;
+
         bool isReadingUntilCondition() const { return readStopCondition_ != nullptr; }
         bool writing_;
+        bool edgeTriggered_;
+        size_t eventBudget_;
         
         // Buffers for I/O
         Buffer readBuffer_;
         Buffer writeBuffer_;
+        // Output the socket did not take yet, flushed by writev
+        BlockBuffer outputBuffer_;
+        // Files queued by sendFile(), each after the bytes of outputBuffer_ appended before it
+        struct FileSegment
+        {
+            std::shared_ptr<FdGuard> file;
+            off_t offset;
+            size_t remaining;
+            // Bytes of outputBuffer_ between the segment ahead, or the front, and this one
+            size_t bytesBefore;
+        };
+        std::deque<FileSegment> fileSegments_;
+        // Bytes appended to outputBuffer_ after the last file segment
+        size_t bytesAfterSegments_;
+
+        // Write or sendFile from another thread, owning what it sends
+        struct OutboundMessage
+        {
+            OutboundMessage() : offset(0), length(0) {}
+            std::string owned;
+            std::shared_ptr<const std::string> shared;
+            std::unique_ptr<Buffer> buffer;
+            // A file segment instead of bytes if set
+            std::shared_ptr<FdGuard> file;
+            off_t offset;
+            size_t length;
+
+            StringPiece bytes() const;
+        };
+        // Other threads push, the loop takes up to kOutboundBatch of them with one functor per iteration
+        MPSCQueue<OutboundMessage> outbound_;
+        // Set while a flushOutbound() is queued in the loop
+        std::atomic<bool> outboundScheduled_;
+        // Reused by flushOutbound()
+        std::vector<OutboundMessage> flushing_;
+        std::vector<StringPiece> flushingParts_;
 
         // High water mark for output buffer
         size_t highWaterMark_;
+
+        // Set while an idle timeout is set
+        IdleReaper::EntryPtr idleEntry_;
         
         // User callbacks
         HighWaterMarkCallback highWaterMarkCallback_;
@@ -113,9 +190,35 @@ namespace Hohnor
         void handleError();
         
         // --- Internal Helper Methods ---
+        // Pass n newly read bytes to the user according to the read mode
+        void handleReadBytes(ssize_t n);
+        void drainRead();
+        void flushWrite();
+        // Run handler again in the pending phase, edge will not come again for what the budget left
+        void continueInLoop(void (TCPConnection::*handler)());
         void writeInLoop(const StringPiece& message);
         void writeInLoop(const void* data, size_t len);
+        void writevInLoop(const StringPiece* parts, size_t n);
+        bool isInLoopThread();
+        // Write in the loop thread unless the connection is closed
+        void writeFromLoop(const StringPiece* parts, size_t n);
+        void queueOutbound(OutboundMessage&& message);
+        // Write a batch of what other threads queued and stay scheduled while more is left
+        void flushOutbound();
+        // Write what other threads queued before the call, one batch unless all is set
+        void writeOutbound(bool all);
+        // Write the messages taken into flushing_, runs of bytes with one writev
+        void writeFlushing();
+        void sendFileInLoop(const std::shared_ptr<FdGuard>& file, off_t offset, size_t length);
+        bool hasOutput() const { return outputBuffer_.readableBytes() > 0 || !fileSegments_.empty(); }
+        void appendOutput(const char* data, size_t len);
+        // One sendfile(2) of the front segment, which must be next in the output
+        ssize_t sendFileSegment(int* savedErrno);
         void setWriteEvent(bool on);
+        void setIdleTimeoutInLoop(double seconds);
+        void touch();
+        void setCloseCallbackInLoop(CloseCallback& cb) { closeCallback_ = std::move(cb); }
+        void setErrorCallbackInLoop(ErrorCallback& cb) { errorCallback_ = std::move(cb); }
 
         //Hide methods
         using Socket::setReadCallback;
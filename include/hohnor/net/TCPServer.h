@@ -0,0 +1,81 @@
+/**
+ * Multi-reactor TCP server: one acceptor loop and a pool of IO loops, one per thread
+ */
+#pragma once
+#include "hohnor/common/NonCopyable.h"
+#include "hohnor/core/EventLoopThreadPool.h"
+#include "hohnor/net/InetAddress.h"
+#include "hohnor/net/TCPAcceptor.h"
+#include "hohnor/net/TCPConnection.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace Hohnor
+{
+    class EventLoop;
+    typedef std::shared_ptr<EventLoop> EventLoopPtr;
+    class TCPServer;
+    typedef std::shared_ptr<TCPServer> TCPServerPtr;
+
+    /**
+     * TCPServer accepts connections in its base loop and hands each accepted fd to one of its IO loops.
+     * The IOHandler and TCPConnection are created in the chosen loop, and the connection callback
+     * runs in that loop's thread, so a connection never migrates between threads.
+     * With loop number 0 (the default) every connection stays in the base loop, same as a bare TCPAcceptor.
+     */
+    class TCPServer : public NonCopyable, public std::enable_shared_from_this<TCPServer>
+    {
+    public:
+        typedef std::function<void (TCPConnectionPtr)> ConnectionCallback;
+        typedef EventLoopThreadPool::ThreadInitCallback ThreadInitCallback;
+
+        // Static factory method to create shared_ptr instances
+        static TCPServerPtr create(EventLoopPtr loop, const InetAddress &listenAddr,
+                                   const std::string &name = std::string("TCPServer"))
+        {
+            return TCPServerPtr(new TCPServer(loop, listenAddr, name));
+        }
+
+        TCPServer() = delete;
+        ~TCPServer();
+
+        //Set number of IO loops, must be called before start()
+        void setLoopNum(size_t numLoops) { numLoops_ = numLoops; }
+        //Set how connections are distributed among IO loops, RoundRobin by default
+        void setDistribution(EventLoopThreadPool::Distribution distribution) { distribution_ = distribution; }
+        //Set function runs in every IO loop thread before its loop starts, must be called before start()
+        void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+        //Called in the connection's own loop for every accepted connection, must be called before start()
+        void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+
+        //Start IO loops and listening, thread safe, only the first call takes effect
+        void start();
+        //Stop listening and end all IO loops, established connections' loops are ended as well
+        void stop();
+
+        //The acceptor, can be used to tune socket options before start()
+        TCPAcceptorPtr acceptor() { return acceptor_; }
+        //The base loop that accepts connections
+        EventLoopPtr loop() { return loop_; }
+        //Valid after start()
+        EventLoopThreadPool *threadPool() { return threadPool_.get(); }
+        const std::string &name() const { return name_; }
+        InetAddress listenAddress() const { return listenAddr_; }
+
+    protected:
+        TCPServer(EventLoopPtr loop, const InetAddress &listenAddr, const std::string &name);
+
+    private:
+        EventLoopPtr loop_;
+        InetAddress listenAddr_;
+        std::string name_;
+        TCPAcceptorPtr acceptor_;
+        std::unique_ptr<EventLoopThreadPool> threadPool_;
+        size_t numLoops_;
+        EventLoopThreadPool::Distribution distribution_;
+        ThreadInitCallback threadInitCallback_;
+        ConnectionCallback connectionCallback_;
+        std::atomic<bool> started_;
+    };
+} // namespace Hohnor
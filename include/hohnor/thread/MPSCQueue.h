@@ -0,0 +1,143 @@
+/**
+ * Lock-free multi-producer single-consumer queue.
+ * Any thread can push, but only one thread (the owner, e.g. a loop thread) may pop.
+ * Based on Dmitry Vyukov's intrusive MPSC node-based queue:
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+ * Carrying data type should be movable and has its default constructor
+ */
+#pragma once
+
+#include "hohnor/common/NonCopyable.h"
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace Hohnor
+{
+    template <typename T>
+    class MPSCQueue : NonCopyable
+    {
+    public:
+        MPSCQueue()
+            : head_(nullptr),
+              tail_(new Node()) //Stub node
+        {
+            head_.store(tail_, std::memory_order_relaxed);
+        }
+
+        //Not thread safe, producers must have stopped
+        ~MPSCQueue()
+        {
+            clear();
+            delete tail_;
+        }
+
+        //Thread safe, wait free: one exchange and one store
+        void push(const T &x)
+        {
+            pushNode(new Node(x));
+        }
+
+        void push(T &&x)
+        {
+            pushNode(new Node(std::move(x)));
+        }
+
+        //Consumer only, for an owner that never shares the queue with other threads: plain loads and stores
+        //instead of the exchange. Must not be mixed with push() from another thread
+        void pushLocal(T &&x)
+        {
+            Node *node = new Node(std::move(x));
+            Node *prev = head_.load(std::memory_order_relaxed);
+            head_.store(node, std::memory_order_relaxed);
+            prev->next_.store(node, std::memory_order_relaxed);
+        }
+
+        //Consumer only. Return false if the queue is empty, or the only elements are still being linked by a producer
+        bool pop(T &x)
+        {
+            Node *tail = tail_;
+            Node *next = tail->next_.load(std::memory_order_acquire);
+            if (next == nullptr)
+                return false;
+            x = std::move(next->value_);
+            next->value_ = T();
+            tail_ = next;
+            delete tail;
+            return true;
+        }
+
+        //Consumer only. Pop elements pushed before this call and pass them to f in FIFO order.
+        //Elements pushed during the call, including the ones pushed by f itself, are left for the next call,
+        //so a consumer that posts to itself can not starve. Return number of elements consumed.
+        template <typename F>
+        size_t popAll(F &&f)
+        {
+            return popWhile([&f](T &value) {
+                f(value);
+                return true;
+            });
+        }
+
+        //Consumer only. Same as popAll(), but stop after the element for which f returns false,
+        //the rest is left for the next call
+        template <typename F>
+        size_t popWhile(F &&f)
+        {
+            Node *last = head_.load(std::memory_order_acquire);
+            size_t n = 0;
+            while (tail_ != last)
+            {
+                Node *tail = tail_;
+                Node *next = tail->next_.load(std::memory_order_acquire);
+                if (next == nullptr)
+                    break; //A producer is in the middle of linking, it will be seen next time
+                T value(std::move(next->value_));
+                next->value_ = T();
+                tail_ = next;
+                delete tail;
+                ++n;
+                if (!f(value))
+                    break;
+            }
+            return n;
+        }
+
+        //Consumer only, may return false while a producer is linking
+        bool empty() const
+        {
+            return tail_->next_.load(std::memory_order_acquire) == nullptr;
+        }
+
+        //Consumer only, drop all linked elements
+        void clear()
+        {
+            T x;
+            while (pop(x))
+            {
+            }
+        }
+
+    private:
+        struct Node
+        {
+            Node() : next_(nullptr), value_() {}
+            explicit Node(const T &x) : next_(nullptr), value_(x) {}
+            explicit Node(T &&x) : next_(nullptr), value_(std::move(x)) {}
+            std::atomic<Node *> next_;
+            T value_;
+        };
+
+        void pushNode(Node *node)
+        {
+            Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+            //Between the exchange and the store the queue is temporarily broken, the consumer simply stops at prev
+            prev->next_.store(node, std::memory_order_release);
+        }
+
+        //Producers side, the last node pushed
+        std::atomic<Node *> head_;
+        //Consumer side, the node before the first element
+        Node *tail_;
+    };
+} // namespace Hohnor
@@ -0,0 +1,121 @@
+/**
+ * Time point of CLOCK_MONOTONIC in micro seconds, unaffected by changes of the wall clock.
+ */
+#pragma once
+
+#include "hohnor/common/Types.h"
+#include "hohnor/time/Timestamp.h"
+namespace Hohnor
+{
+
+	///
+	/// Time point of CLOCK_MONOTONIC, in microseconds resolution.
+	/// It counts from an unspecified point (usually boot) and never jumps, so it is used for timers
+	/// and time intervals. Use Timestamp for the time of day.
+	///
+	/// This class is immutable.
+	/// It's recommended to pass it by value, since it's passed in register on x64.
+	///
+	class MonotonicTime
+	{
+	public:
+		///
+		/// Constucts an invalid MonotonicTime.
+		///
+		MonotonicTime()
+			: microSeconds_(0)
+		{
+		}
+
+		explicit MonotonicTime(int64_t microSecondsArg)
+			: microSeconds_(microSecondsArg)
+		{
+		}
+
+		// default copy/assignment/dtor are Okay
+
+		string toString() const;
+
+		bool valid() const { return microSeconds_ > 0; }
+
+		int64_t microSeconds() const { return microSeconds_; }
+
+		///
+		/// Get time of now by clock_gettime(CLOCK_MONOTONIC), a vDSO call.
+		///
+		static MonotonicTime now();
+		///
+		/// Get time of now by CLOCK_MONOTONIC_COARSE, cheaper but only as precise as the kernel tick (1-4ms).
+		///
+		static MonotonicTime nowCoarse();
+		static MonotonicTime invalid()
+		{
+			return MonotonicTime();
+		}
+
+		///
+		/// Convert a time of day to the monotonic clock, by the offset of the clocks now.
+		/// Never earlier than when, a timer set to the result does not fire before the wall clock reaches when
+		/// unless the wall clock is stepped meanwhile. Equal Timestamps convert to equal results.
+		///
+		static MonotonicTime fromTimestamp(Timestamp when);
+		///
+		/// Convert to the time of day, by the offset of the clocks now.
+		///
+		Timestamp toTimestamp() const;
+
+		static const int kMicroSecondsPerSecond = 1000 * 1000;
+
+	private:
+		int64_t microSeconds_;
+	};
+
+	inline bool operator<(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() < rhs.microSeconds();
+	}
+
+	inline bool operator<=(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() <= rhs.microSeconds();
+	}
+
+	inline bool operator>(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() > rhs.microSeconds();
+	}
+
+	inline bool operator>=(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() >= rhs.microSeconds();
+	}
+
+	inline bool operator==(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() == rhs.microSeconds();
+	}
+
+	inline bool operator!=(MonotonicTime lhs, MonotonicTime rhs)
+	{
+		return lhs.microSeconds() != rhs.microSeconds();
+	}
+
+	///
+	/// Gets time difference of two time points, result in seconds.
+	///
+	inline double timeDifference(MonotonicTime high, MonotonicTime low)
+	{
+		int64_t diff = high.microSeconds() - low.microSeconds();
+		return static_cast<double>(diff) / MonotonicTime::kMicroSecondsPerSecond;
+	}
+
+	///
+	/// Add @c seconds to given time point.
+	///
+	inline MonotonicTime addTime(MonotonicTime time, double seconds)
+	{
+		int64_t delta = static_cast<int64_t>(seconds * MonotonicTime::kMicroSecondsPerSecond);
+		return MonotonicTime(time.microSeconds() + delta);
+	}
+
+} // namespace Hohnor
@@ -1,15 +1,18 @@
 #include "hohnor/core/EventLoop.h"
 #include "hohnor/core/Signal.h"
-#include "hohnor/io/Epoll.h"
 #include "hohnor/io/FdUtils.h"
-#include "hohnor/thread/Mutex.h"
+#include "hohnor/log/Logging.h"
 #include "hohnor/thread/Exception.h"
 #include "hohnor/thread/ThreadPool.h"
 #include "hohnor/core/IOHandler.h"
+#include "hohnor/core/IdleReaper.h"
 #include "hohnor/core/Timer.h"
 #include "hohnor/core/Timer.h"
 #include <sys/eventfd.h>
+#include <time.h>
 #include <cassert>
+#include <algorithm>
+#include <iterator>
 
 namespace Hohnor
 {
@@ -23,35 +26,63 @@ namespace Hohnor
 
 using namespace Hohnor;
 
+namespace
+{
+    int64_t monotonicNs()
+    {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    uint64_t packSlowestHandler(int64_t ns, int fd)
+    {
+        uint64_t saturated = ns > 0xffffffffLL ? 0xffffffffULL : static_cast<uint64_t>(ns);
+        return (saturated << 32) | static_cast<uint32_t>(fd);
+    }
+} // namespace
+
 EventLoop *EventLoop::loopOfCurrentThread()
 {
     return Loop::t_loopInThisThread;
 }
 
-EventLoop::EventLoop()
-    : poller_(new Epoll()), quit_(false),
+EventLoop::EventLoop(const Options &options)
+    : options_(options), poller_(Poller::create(options.backend)), quit_(false),
       threadId_(CurrentThread::tid()),
       iteration_(0), state_(Ready),
-      pollReturnTime_(Timestamp::now()),
+      now_(options.coarseClock ? MonotonicTime::nowCoarse() : MonotonicTime::now()),
       wakeUpHandler_(), //initilize later
-      timers_(),
-      pendingFunctorsLock_(new Mutex()), pendingFunctors_(), signalMap_(),
-      threadPool_()
+      timers_(), idleReaper_(),
+      pendingFunctors_(), pendingBudgetFunctors_(0), pendingBudgetNs_(0), pendingLeft_(false),
+      pendingBudgetExhausted_(0), slicedTasks_(), idleCallbacks_(), runningIdleCallbacks_(), idleBudgetUs_(1000),
+      wakeUpPending_(false), signalMap_(),
+      threadPool_(), ioHandlerCount_(0),
+      busyPollUsec_(0), blockingWaits_(0), busyPolls_(0), busyPollHits_(0), busyPollMisses_(0),
+      polledEvents_(0), eventsSize_(poller_->eventsSize()),
+      pendingIOUpdates_(), applyingIOUpdates_(),
+      ioSlots_(), staleEvents_(0), interestUpdatesRequested_(0), interestUpdatesApplied_(0),
+      loopStatsEnabled_(false), loopStatsIntervalNs_(0),
+      waitNs_(), ioNs_(), pendingNs_(), eventsPerWakeup_(), functorsPerDrain_(),
+      slowestHandler_(0), slowestIntervalStartNs_(0), lastTimedIteration_(0), lastSlowestHandler_(0)
 {
 }
 
-EventLoopPtr EventLoop::create() {
+EventLoopPtr EventLoop::create(const Options &options) {
     LOG_DEBUG << "Enter EventLoop creation factory";
-    auto ptr = EventLoopPtr(new EventLoop());
+    auto ptr = EventLoopPtr(new EventLoop(options));
     //Two step creation, because IOHandle needs shared_ptr of the EventLoop which is only available after the EventLoop is fully constructed
-    ptr->timers_ = new TimerQueue(ptr.get());
-    //create eventfd for wake up
-    int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    if (evtfd < 0)
-        LOG_SYSFATAL << "Fail to create eventfd for wake up";
-    ptr->wakeUpHandler_ = ptr->handleIO(evtfd);
-    ptr->wakeUpHandler_->setReadCallback(std::bind(&EventLoop::handleWakeUp, ptr.get()));
-    ptr->wakeUpHandler_->enable();
+    ptr->timers_ = new TimerQueue(ptr.get(), options.timers, options.timerTick, options.timerfd);
+    //create eventfd for wake up, a thread confined loop is only posted to by itself
+    if (!options.threadConfined)
+    {
+        int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (evtfd < 0)
+            LOG_SYSFATAL << "Fail to create eventfd for wake up";
+        ptr->wakeUpHandler_ = ptr->handleIO(evtfd);
+        ptr->wakeUpHandler_->setReadCallback(std::bind(&EventLoop::handleWakeUp, ptr.get()));
+        ptr->wakeUpHandler_->enable();
+    }
     LOG_DEBUG << "EventLoop created " << ptr.get() << " in thread " << ptr->threadId_;
     return ptr;
 }
@@ -61,10 +92,11 @@ EventLoop::~EventLoop()
     LOG_DEBUG << "Destroying EventLoop " << this << " in thread " << threadId_;
     if (state_ != End)
         endLoop();
-    Loop::t_loopInThisThread = nullptr;
+    //The loop may be destroyed in a thread that runs another loop
+    if (Loop::t_loopInThisThread == this)
+        Loop::t_loopInThisThread = nullptr;
     delete timers_;
     delete poller_;
-    delete pendingFunctorsLock_;
     LOG_DEBUG << "EventLoop " << this << " of thread " << threadId_;
 }
 
@@ -97,41 +129,62 @@ void EventLoop::loop()
     while (!quit_)
     {
         ++iteration_;
-        state_ = Polling;
+        applyIOHandlerUpdates();
+        bool timed = loopStatsEnabled_.load(std::memory_order_relaxed);
+        int64_t pollStart = timed ? monotonicNs() : 0;
+        setState(Polling);
         //epoll Wait for any IO events
-        auto res = poller_->wait();
-        pollReturnTime_ = Timestamp::now();
+        PollEvent *events = NULL;
+        int numEvents = poll(&events);
+        int64_t pollEnd = timed ? monotonicNs() : 0;
+        if (options_.coarseClock)
+            now_.store(MonotonicTime::nowCoarse(), std::memory_order_relaxed);
+        else //Same clock as the stats, read it once
+            now_.store(timed ? MonotonicTime(pollEnd / 1000) : MonotonicTime::now(), std::memory_order_relaxed);
 
-        state_ = IOHandling;
-        while (res.hasNext())
+        setState(IOHandling);
+        if (!options_.timerfd)
         {
-            auto event = res.next();
-            IOHandler *handler = (IOHandler *)event.data.ptr;
-            handler->retEvents(event.events);
-            handler->run();
+            //Coarse time of the loop may be behind the deadline the poll waited for
+            MonotonicTime now = options_.coarseClock ? MonotonicTime::now() : now_.load(std::memory_order_relaxed);
+            MonotonicTime next = timers_->nextExpiration();
+            if (next.valid() && next <= now)
+                timers_->runExpired(now);
         }
+        uint64_t slowestHandler = handleEvents(events, numEvents, timed);
+        int64_t ioEnd = timed ? monotonicNs() : 0;
 
-        state_ = PendingHandling;
-        std::vector<Functor> funcs;
-        {
-            MutexGuard guard(*pendingFunctorsLock_);
-            funcs.swap(pendingFunctors_);
-        }
-        for (Functor func : funcs)
+        setState(PendingHandling);
+        //Clear the flag before draining, a post that is not drained this time will see it cleared and wake us up
+        if (!options_.threadConfined)
+            wakeUpPending_.exchange(false);
+        size_t numFunctors = runPendingFunctors();
+        int64_t pendingEnd = timed ? monotonicNs() : 0;
+
+        if (hasIdleWork())
         {
-            HCHECK_NE(func, nullptr) << " pending functors should not be nullptr";
-            func();
+            setState(IdleHandling);
+            runIdleWork(numEvents == 0 && numFunctors == 0);
         }
+        if (timed)
+            recordLoopStats(pollStart, pollEnd, ioEnd, pendingEnd, numEvents, numFunctors, slowestHandler);
     }
     state_ = End;
 
     //Start resource clean up
     LOG_DEBUG << "EventLoop " << this << " in thread " << threadId_ << " is ended";
     LOG_DEBUG << "Reset all IOHandler and TimerHandler stored in loop object to disabled state";
-    timers_->timerFdIOHandle_->disable();
-    timers_->timerFdIOHandle_.reset();
-    wakeUpHandler_->disable();
-    wakeUpHandler_.reset();
+    idleReaper_.reset();
+    if (timers_->timerFdIOHandle_)
+    {
+        timers_->timerFdIOHandle_->disable();
+        timers_->timerFdIOHandle_.reset();
+    }
+    if (wakeUpHandler_)
+    {
+        wakeUpHandler_->disable();
+        wakeUpHandler_.reset();
+    }
     while (!signalMap_.empty())
     {
         signalMap_.begin()->second->disable();
@@ -145,12 +198,268 @@ void EventLoop::loop()
         //Instead we free out the loop ptr in the handler
         //To avoid infinite ownership looping
         interactiveIOHandler_->loop_.reset();
+        --ioHandlerCount_;
     }
+    for (auto &functors : pendingFunctors_)
+        functors.clear();
+    pendingLeft_ = false;
+    //Unfinished tasks are dropped
+    slicedTasks_.clear();
+    idleCallbacks_.clear();
+    pendingIOUpdates_.clear();
+    Loop::t_loopInThisThread = nullptr;
+}
+
+int EventLoop::poll(PollEvent **events)
+{
+    //Pending functors or idle work are waiting for their turn, only pick up IO that is ready now. A thread confined
+    //loop has no wake up for the functors it posted after draining
+    if (pendingLeft_ || hasIdleWork() || (options_.threadConfined && hasPendingFunctors()))
     {
-        MutexGuard guard(*pendingFunctorsLock_);
-        pendingFunctors_.clear();
+        int n = poller_->poll(0, events);
+        if (n > 0)
+            polledEvents_.store(polledEvents_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        eventsSize_.store(poller_->eventsSize(), std::memory_order_relaxed);
+        return n;
     }
-    Loop::t_loopInThisThread = nullptr;
+    //Without timerfd the wait ends by the next timer
+    MonotonicTime next = options_.timerfd ? MonotonicTime::invalid() : timers_->nextExpiration();
+    int64_t budget = busyPollUsec_.load(std::memory_order_relaxed);
+    if (budget > 0)
+    {
+        int64_t deadline = MonotonicTime::now().microSeconds() + budget;
+        if (next.valid())
+            deadline = std::min(deadline, next.microSeconds());
+        uint64_t spins = 0;
+        do
+        {
+            ++spins;
+            int n = poller_->poll(0, events);
+            if (n > 0)
+            {
+                busyPolls_.store(busyPolls_.load(std::memory_order_relaxed) + spins, std::memory_order_relaxed);
+                busyPollHits_.store(busyPollHits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                polledEvents_.store(polledEvents_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+                eventsSize_.store(poller_->eventsSize(), std::memory_order_relaxed);
+                return n;
+            }
+        } while (!quit_ && MonotonicTime::now().microSeconds() < deadline);
+        busyPolls_.store(busyPolls_.load(std::memory_order_relaxed) + spins, std::memory_order_relaxed);
+        busyPollMisses_.store(busyPollMisses_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    int n;
+    if (next.valid())
+        n = poller_->pollMicros(std::max<int64_t>(0, next.microSeconds() - MonotonicTime::now().microSeconds()), events);
+    else
+        n = poller_->poll(-1, events);
+    blockingWaits_.store(blockingWaits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    polledEvents_.store(polledEvents_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    eventsSize_.store(poller_->eventsSize(), std::memory_order_relaxed);
+    return n;
+}
+
+size_t EventLoop::runPendingFunctors()
+{
+    auto run = [](Functor &func) {
+        HCHECK_NE(func, nullptr) << " pending functors should not be nullptr";
+        func();
+    };
+    MPSCQueue<Functor> &normal = pendingFunctors_[static_cast<int>(Priority::Normal)];
+    MPSCQueue<Functor> &background = pendingFunctors_[static_cast<int>(Priority::Background)];
+    size_t n = pendingFunctors_[static_cast<int>(Priority::Urgent)].popAll(run);
+    size_t maxFunctors = pendingBudgetFunctors_.load(std::memory_order_relaxed);
+    int64_t maxNs = pendingBudgetNs_.load(std::memory_order_relaxed);
+    if (maxFunctors == 0 && maxNs == 0)
+    {
+        n += normal.popAll(run);
+        n += background.popAll(run);
+        pendingLeft_ = false;
+        return n;
+    }
+    int64_t deadline = maxNs ? monotonicNs() + maxNs : 0;
+    size_t budgeted = 0;
+    bool exhausted = false;
+    auto runBudgeted = [&](Functor &func) {
+        run(func);
+        ++budgeted;
+        exhausted = (maxFunctors && budgeted >= maxFunctors) || (maxNs && monotonicNs() >= deadline);
+        return !exhausted;
+    };
+    n += normal.popWhile(runBudgeted);
+    if (!exhausted)
+        n += background.popWhile(runBudgeted);
+    else
+        n += background.popWhile([&run](Functor &func) {
+            run(func);
+            return false;
+        });
+    pendingLeft_ = !normal.empty() || !background.empty();
+    if (exhausted && pendingLeft_)
+        pendingBudgetExhausted_.store(pendingBudgetExhausted_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return n;
+}
+
+void EventLoop::runIdleWork(bool idle)
+{
+    MonotonicTime now = MonotonicTime::now();
+    int64_t budget = idleBudgetUs_.load(std::memory_order_relaxed);
+    //Budget counts from poll return, unless nothing else was done
+    MonotonicTime deadline = idle ? MonotonicTime(now.microSeconds() + budget)
+                                  : MonotonicTime(now_.load(std::memory_order_relaxed).microSeconds() + budget);
+    if (!idleCallbacks_.empty() && now < deadline)
+    {
+        runningIdleCallbacks_.swap(idleCallbacks_);
+        size_t i = 0;
+        while (i < runningIdleCallbacks_.size() && now < deadline)
+        {
+            runningIdleCallbacks_[i++]();
+            now = MonotonicTime::now();
+        }
+        //Left over by the budget go before those added meanwhile
+        if (i < runningIdleCallbacks_.size())
+        {
+            idleCallbacks_.insert(idleCallbacks_.begin(), std::make_move_iterator(runningIdleCallbacks_.begin() + i),
+                                  std::make_move_iterator(runningIdleCallbacks_.end()));
+        }
+        runningIdleCallbacks_.clear();
+    }
+    while (!slicedTasks_.empty() && now < deadline && !quit_)
+    {
+        SlicedTask task(std::move(slicedTasks_.front()));
+        slicedTasks_.pop_front();
+        //At the back, so tasks take turns
+        if (task(deadline))
+            slicedTasks_.push_back(std::move(task));
+        now = MonotonicTime::now();
+    }
+}
+
+void EventLoop::runSliced(SlicedTask task)
+{
+    HCHECK(task) << "Sliced task should not be empty";
+    runInLoop(std::bind(&EventLoop::addSlicedTaskInLoop, this, std::move(task)));
+}
+
+void EventLoop::addSlicedTaskInLoop(SlicedTask &task)
+{
+    slicedTasks_.push_back(std::move(task));
+}
+
+void EventLoop::runWhenIdle(Functor callback)
+{
+    HCHECK(callback) << "Idle callback should not be empty";
+    runInLoop(std::bind(&EventLoop::addIdleCallbackInLoop, this, std::move(callback)));
+}
+
+void EventLoop::addIdleCallbackInLoop(Functor &callback)
+{
+    idleCallbacks_.push_back(std::move(callback));
+}
+
+void EventLoop::setIdleBudget(double seconds)
+{
+    HCHECK(seconds > 0) << "Idle budget must be positive";
+    idleBudgetUs_.store(static_cast<int64_t>(seconds * MonotonicTime::kMicroSecondsPerSecond), std::memory_order_relaxed);
+}
+
+void EventLoop::setPendingBudget(size_t maxFunctors, double maxSeconds)
+{
+    HCHECK(maxSeconds >= 0) << "Pending budget must not be negative";
+    pendingBudgetFunctors_.store(maxFunctors, std::memory_order_relaxed);
+    pendingBudgetNs_.store(static_cast<int64_t>(maxSeconds * 1e9), std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::handleEvents(PollEvent *events, int numEvents, bool timed)
+{
+    uint64_t slowest = 0;
+    int64_t start = timed ? monotonicNs() : 0;
+    uint64_t stale = 0;
+    for (int i = 0; i < numEvents; ++i)
+    {
+        int fd = static_cast<int>(events[i].data.u64 & 0xffffffffu);
+        uint32_t generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+        //An earlier handler of this batch may have destroyed or disabled the handler of fd
+        if (UNLIKELY(static_cast<size_t>(fd) >= ioSlots_.size() || ioSlots_[fd].generation != generation ||
+                     ioSlots_[fd].handler == NULL))
+        {
+            ++stale;
+            continue;
+        }
+        IOHandler *handler = ioSlots_[fd].handler;
+        handler->retEvents(events[i].events);
+        handler->run();
+        if (timed)
+        {
+            int64_t end = monotonicNs();
+            uint64_t packed = packSlowestHandler(end - start, fd);
+            if ((packed >> 32) > (slowest >> 32))
+                slowest = packed;
+            start = end;
+        }
+    }
+    if (stale)
+        staleEvents_.store(staleEvents_.load(std::memory_order_relaxed) + stale, std::memory_order_relaxed);
+    return slowest;
+}
+
+void EventLoop::recordLoopStats(int64_t pollStart, int64_t pollEnd, int64_t ioEnd, int64_t pendingEnd,
+                                int numEvents, size_t numFunctors, uint64_t slowestHandler)
+{
+    waitNs_.record(static_cast<uint64_t>(pollEnd - pollStart));
+    ioNs_.record(static_cast<uint64_t>(ioEnd - pollEnd));
+    pendingNs_.record(static_cast<uint64_t>(pendingEnd - ioEnd));
+    eventsPerWakeup_.record(numEvents > 0 ? static_cast<uint64_t>(numEvents) : 0);
+    functorsPerDrain_.record(numFunctors);
+    if (lastTimedIteration_ + 1 != iteration_)
+    {
+        //First iteration since stats are turned on
+        slowestHandler_ = 0;
+        slowestIntervalStartNs_ = pollStart;
+    }
+    lastTimedIteration_ = iteration_;
+    if ((slowestHandler >> 32) > (slowestHandler_ >> 32))
+        slowestHandler_ = slowestHandler;
+    if (pendingEnd - slowestIntervalStartNs_ >= loopStatsIntervalNs_.load(std::memory_order_relaxed))
+    {
+        lastSlowestHandler_.store(slowestHandler_, std::memory_order_relaxed);
+        slowestHandler_ = 0;
+        slowestIntervalStartNs_ = pendingEnd;
+    }
+}
+
+void EventLoop::setLoopStats(bool on, double interval)
+{
+    HCHECK(interval > 0) << "Interval of loop stats must be positive";
+    loopStatsIntervalNs_.store(static_cast<int64_t>(interval * 1e9), std::memory_order_relaxed);
+    loopStatsEnabled_.store(on, std::memory_order_relaxed);
+}
+
+EventLoop::LoopStats EventLoop::loopStats() const
+{
+    LoopStats stats;
+    stats.waitNs = waitNs_.snapshot();
+    stats.ioNs = ioNs_.snapshot();
+    stats.pendingNs = pendingNs_.snapshot();
+    stats.eventsPerWakeup = eventsPerWakeup_.snapshot();
+    stats.functorsPerDrain = functorsPerDrain_.snapshot();
+    uint64_t slowest = lastSlowestHandler_.load(std::memory_order_relaxed);
+    stats.slowestHandlerNs = slowest >> 32;
+    stats.slowestHandlerFd = slowest == 0 ? -1 : static_cast<int>(static_cast<uint32_t>(slowest));
+    return stats;
+}
+
+EventLoop::PollStats EventLoop::pollStats() const
+{
+    PollStats stats;
+    stats.blockingWaits = blockingWaits_.load(std::memory_order_relaxed);
+    stats.busyPolls = busyPolls_.load(std::memory_order_relaxed);
+    stats.busyPollHits = busyPollHits_.load(std::memory_order_relaxed);
+    stats.busyPollMisses = busyPollMisses_.load(std::memory_order_relaxed);
+    stats.events = polledEvents_.load(std::memory_order_relaxed);
+    stats.eventsSize = eventsSize_.load(std::memory_order_relaxed);
+    stats.syscalls = poller_->syscalls();
+    stats.staleEvents = staleEvents_.load(std::memory_order_relaxed);
+    return stats;
 }
 
 void EventLoop::runInLoop(Functor cb)
@@ -170,17 +479,28 @@ void EventLoop::runInLoop(Functor cb)
 }
 
 void EventLoop::queueInLoop(Functor cb)
+{
+    queueInLoop(std::move(cb), Priority::Normal);
+}
+
+void EventLoop::queueInLoop(Functor cb, Priority priority)
 {
     if(state_ == End)
     {
         LOG_ERROR << "EventLoop " << this << " is ended, can not queue in loop";
         return;
     }
+    if (options_.threadConfined)
     {
-        MutexGuard guard(*pendingFunctorsLock_);
-        pendingFunctors_.push_back(std::move(cb));
+        //Checks the thread in builds without NDEBUG, the next poll does not block while the queue is not empty
+        isLoopThread();
+        pendingFunctors_[static_cast<int>(priority)].pushLocal(std::move(cb));
+        return;
     }
-    if (!isLoopThread() || state_ == PendingHandling || state_ == Ready)
+    pendingFunctors_[static_cast<int>(priority)].push(std::move(cb));
+    //Only the first post after a drain writes the eventfd, the loop has not drained the queue yet for the others
+    if ((!isLoopThread() || state_ == PendingHandling || state_ == IdleHandling || state_ == Ready) &&
+        !wakeUpPending_.exchange(true))
     {
         wakeUp();
     }
@@ -209,7 +529,9 @@ void EventLoop::runInPool(Functor callback)
     }
     if (threadPool_)
     {
-        threadPool_->run(std::move(callback));
+        //Pool tasks are copyable std::functions, share the move-only functor with them
+        auto task = std::make_shared<Functor>(std::move(callback));
+        threadPool_->run([task]() { (*task)(); });
     }
     else
     {
@@ -225,6 +547,8 @@ void EventLoop::wakeUp()
         LOG_ERROR << "EventLoop " << this << " is ended, can not wake up";
         return;
     }
+    if (options_.threadConfined)
+        return;
     uint64_t one = 1;
     ssize_t n = ::write(wakeUpHandler_->fd(), &one, sizeof one);
     if (n != sizeof one)
@@ -276,40 +600,124 @@ IOHandlerPtr EventLoop::handleIO(int fd){
     return IOHandlerPtr(new IOHandler(shared_from_this(), fd));
 }
 
-void EventLoop::updateIOHandler(IOHandlerPtr handler, bool addNew) //Load handle's epoll context to epoll, and manage context lifecycle. 
-// addNew == true && enabled == true means creating epoll node, addNew == false && enabled == true means modifing events in epoll, enable == false means deleting epoll node and remove ownership
+void EventLoop::updateIOHandler(IOHandler *handler)
 {
     assertInLoopThread();
     HCHECK(handler) << "Handler has been free";
-    if (addNew)
+    interestUpdatesRequested_.store(interestUpdatesRequested_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (!handler->updatePending_)
     {
-        HCHECK(handler->isEnabled())<< "Handler should be enabled when adding to epoll";
-        poller_->add(handler->fd(), handler->getEvents(), (void *)handler.get());
+        handler->updatePending_ = true;
+        //Holding the handler also keeps its fd open until it is removed from epoll
+        pendingIOUpdates_.push_back(handler->shared_from_this());
     }
-    else if (handler->isEnabled()) // If is it enable and not addNew, it means we are modifying the events
+}
+
+void EventLoop::applyIOHandlerUpdates() //Load handle's epoll context to epoll according to its final status and events in this iteration
+{
+    //Releasing handlers may destroy callbacks that update other handlers, keep going until nothing is left
+    while (!pendingIOUpdates_.empty())
     {
-        poller_->modify(handler->fd(), handler->getEvents(), (void *)handler.get());
+        applyingIOUpdates_.swap(pendingIOUpdates_);
+        uint64_t applied = 0;
+        for (auto &handler : applyingIOUpdates_)
+        {
+            handler->updatePending_ = false;
+            if (handler->isEnabled())
+            {
+                if (!handler->registered_)
+                {
+                    if (poller_->add(handler->fd(), handler->events_, bindIOSlot(handler.get())) == 0)
+                        handler->registered_ = true;
+                    else
+                        unbindIOSlot(handler->fd(), handler->slotGeneration_);
+                    ++applied;
+                }
+                else if (handler->registeredEvents_ != handler->events_)
+                {
+                    poller_->modify(handler->fd(), handler->events_, ioSlotData(handler->fd(), handler->slotGeneration_));
+                    ++applied;
+                }
+                handler->registeredEvents_ = handler->events_;
+            }
+            else if (handler->registered_) // If it is not enabled, we are removing the handler from epoll
+            {
+                poller_->remove(handler->fd());
+                unbindIOSlot(handler->fd(), handler->slotGeneration_);
+                handler->registered_ = false;
+                ++applied;
+            }
+        }
+        interestUpdatesApplied_.store(interestUpdatesApplied_.load(std::memory_order_relaxed) + applied, std::memory_order_relaxed);
+        applyingIOUpdates_.clear();
     }
-    else // If it is not enabled, we are removing the handler from epoll
+}
+
+PollData EventLoop::bindIOSlot(IOHandler *handler)
+{
+    size_t fd = static_cast<size_t>(handler->fd());
+    if (fd >= ioSlots_.size())
+        ioSlots_.resize(std::max(fd + 1, ioSlots_.size() * 2));
+    IOSlot &slot = ioSlots_[fd];
+    slot.handler = handler;
+    handler->slotGeneration_ = ++slot.generation;
+    return ioSlotData(handler->fd(), slot.generation);
+}
+
+bool EventLoop::unbindIOSlot(int fd, uint32_t generation)
+{
+    if (static_cast<size_t>(fd) >= ioSlots_.size() || ioSlots_[fd].generation != generation)
+        return false;
+    ioSlots_[fd].handler = NULL;
+    ++ioSlots_[fd].generation;
+    return true;
+}
+
+void EventLoop::removeFd(int fd, uint32_t generation)
+{
+    assertInLoopThread();
+    //The fd may have been closed and reused by a newer handler before this runs
+    if (unbindIOSlot(fd, generation))
+        poller_->remove(fd);
+}
+
+IdleReaper *EventLoop::idleReaper()
+{
+    assertInLoopThread();
+    if (state_ == End)
     {
-        poller_->remove(handler->fd());
+        LOG_ERROR << "EventLoop " << this << " is ended, can not track idle timeouts";
+        return nullptr;
     }
+    if (!idleReaper_)
+        idleReaper_.reset(new IdleReaper(this, options_.idleTick));
+    return idleReaper_.get();
 }
 
-void EventLoop::removeFd(int fd)
+std::shared_ptr<TimerHandler> EventLoop::addTimer(TimerCallback cb, Timestamp when, double interval, double slack)
 {
-    assertInLoopThread();
-    poller_->remove(fd);
+    return addTimer(std::move(cb), MonotonicTime::fromTimestamp(when), interval, slack);
+}
+
+std::shared_ptr<TimerHandler> EventLoop::addTimer(TimerCallback cb, MonotonicTime when, double interval, double slack)
+{
+    if(state_ == End)
+    {
+        LOG_ERROR << "EventLoop " << this << " is ended, can not add timer";
+        return nullptr;
+    }
+    return timers_->addTimer(std::move(cb), when, interval, slack);
 }
 
-std::shared_ptr<TimerHandler> EventLoop::addTimer(TimerCallback cb, Timestamp when, double interval)
+std::shared_ptr<TimerHandler> EventLoop::addPrecisionTimer(TimerCallback cb, MonotonicTime when, double interval, double spin)
 {
     if(state_ == End)
     {
         LOG_ERROR << "EventLoop " << this << " is ended, can not add timer";
         return nullptr;
     }
-    return timers_->addTimer(std::move(cb), when, interval);
+    HCHECK(spin > 0) << "Spin of a precision timer must be positive";
+    return timers_->addTimer(std::move(cb), when, interval, 0.0, spin);
 }
 
 // void EventLoop::removeTimer(TimerHandle id)
@@ -386,4 +794,23 @@ void EventLoop::handleKeyboard(KeyboardCallback cb)
         }});
 }
 
-bool EventLoop::isLoopThread() { return CurrentThread::tid() == threadId_; }
\ No newline at end of file
+bool EventLoop::isLoopThread()
+{
+    if (options_.threadConfined)
+    {
+#ifndef NDEBUG
+        if (CurrentThread::tid() != threadId_)
+            LOG_FATAL << "EventLoop " << this << " is thread confined to thread " << threadId_
+                      << ", but used in thread " << CurrentThread::tid();
+#endif
+        return true;
+    }
+    return CurrentThread::tid() == threadId_;
+}
+
+MonotonicTime EventLoop::now()
+{
+    if (isLoopThread())
+        return now_.load(std::memory_order_relaxed);
+    return options_.coarseClock ? MonotonicTime::nowCoarse() : MonotonicTime::now();
+}
\ No newline at end of file
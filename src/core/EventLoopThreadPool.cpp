@@ -0,0 +1,148 @@
+#include "hohnor/core/EventLoopThreadPool.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/log/Logging.h"
+#include <cassert>
+
+using namespace Hohnor;
+
+EventLoopThread::EventLoopThread(ThreadInitCallback cb, const std::string &name, const EventLoop::Options &options)
+    : loop_(), started_(false), stopped_(false),
+      mutex_(), cond_(mutex_),
+      callback_(std::move(cb)),
+      options_(options),
+      thread_(std::bind(&EventLoopThread::threadFunc, this), name)
+{
+}
+
+EventLoopThread::~EventLoopThread()
+{
+    stopLoop();
+}
+
+EventLoopPtr EventLoopThread::startLoop()
+{
+    assert(!started_);
+    started_ = true;
+    thread_.start();
+    MutexGuard guard(mutex_);
+    while (!loop_)
+    {
+        cond_.wait();
+    }
+    return loop_;
+}
+
+void EventLoopThread::stopLoop()
+{
+    if (!started_ || stopped_)
+        return;
+    stopped_ = true;
+    EventLoopPtr loop = this->loop();
+    if (loop)
+    {
+        loop->endLoop();
+    }
+    thread_.join();
+}
+
+EventLoopPtr EventLoopThread::loop()
+{
+    MutexGuard guard(mutex_);
+    return loop_;
+}
+
+void EventLoopThread::threadFunc()
+{
+    auto loop = EventLoop::create(options_);
+    if (callback_)
+    {
+        callback_(loop);
+    }
+    //Publish the loop from inside the loop, so that the loop is never seen in Ready state by others,
+    //ending a Ready loop from another thread would run it in that thread.
+    loop->queueInLoop([this, loop]() {
+        MutexGuard guard(mutex_);
+        loop_ = loop;
+        cond_.notify();
+    });
+    loop->loop();
+    LOG_DEBUG << "EventLoopThread " << CurrentThread::name() << " finished looping";
+}
+
+EventLoopThreadPool::EventLoopThreadPool(EventLoopPtr baseLoop, const std::string &name)
+    : baseLoop_(baseLoop), name_(name), started_(false), next_(0),
+      threadInitCallback_(), threads_(), loops_()
+{
+    HCHECK(baseLoop_) << "Base loop of EventLoopThreadPool cannot be null";
+}
+
+EventLoopThreadPool::~EventLoopThreadPool()
+{
+    stop();
+}
+
+void EventLoopThreadPool::start(size_t numThreads)
+{
+    assert(!started_);
+    started_ = true;
+    threads_.reserve(numThreads);
+    loops_.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        threads_.emplace_back(new EventLoopThread(threadInitCallback_, name_ + std::to_string(i), baseLoop_->options()));
+        loops_.push_back(threads_.back()->startLoop());
+    }
+    if (numThreads == 0 && threadInitCallback_)
+    {
+        threadInitCallback_(baseLoop_);
+    }
+    LOG_DEBUG << "EventLoopThreadPool " << name_ << " started with " << numThreads << " loops";
+}
+
+void EventLoopThreadPool::stop()
+{
+    for (auto &thr : threads_)
+    {
+        thr->stopLoop();
+    }
+}
+
+EventLoopPtr EventLoopThreadPool::getNextLoop()
+{
+    if (loops_.empty())
+        return baseLoop_;
+    return loops_[next_++ % loops_.size()];
+}
+
+EventLoopPtr EventLoopThreadPool::getLeastLoadedLoop()
+{
+    if (loops_.empty())
+        return baseLoop_;
+    //Start scanning from a rotating position, so that ties are spread instead of piling on loops_[0]
+    size_t start = next_++ % loops_.size();
+    size_t best = start;
+    size_t bestLoad = loops_[start]->ioHandlerCount();
+    for (size_t i = 1; i < loops_.size(); ++i)
+    {
+        size_t index = (start + i) % loops_.size();
+        size_t load = loops_[index]->ioHandlerCount();
+        if (load < bestLoad)
+        {
+            best = index;
+            bestLoad = load;
+        }
+    }
+    return loops_[best];
+}
+
+EventLoopPtr EventLoopThreadPool::getLoop(Distribution distribution)
+{
+    return distribution == LeastConnections ? getLeastLoadedLoop() : getNextLoop();
+}
+
+std::vector<EventLoopPtr> EventLoopThreadPool::getAllLoops()
+{
+    if (loops_.empty())
+        return std::vector<EventLoopPtr>(1, baseLoop_);
+    return loops_;
+}
@@ -22,6 +22,8 @@ namespace Hohnor
             oss << "RDHUP ";
         if (ev & EPOLLERR)
             oss << "ERR ";
+        if (ev & EPOLLET)
+            oss << "ET ";
         return oss.str();
     }
 } // namespace Hohnor
@@ -29,12 +31,14 @@ namespace Hohnor
 using namespace Hohnor;
 
 IOHandler::IOHandler(EventLoopPtr loop, int fd) : loop_(loop), events_(0), revents_(0), status_(Status::Created),
+                                                                registered_(false), registeredEvents_(0), updatePending_(false), slotGeneration_(0),
                                                                 closeCallback_(nullptr), errorCallback_(nullptr), readCallback_(nullptr), writeCallback_(nullptr)
 {
     HCHECK(loop) << "EventLoop cannot be null";
     HCHECK(fd >= 0) << "File descriptor must be non-negative";
     LOG_DEBUG << "Creating IOHandler for fd " << fd;
     this->setFd(fd);
+    ++loop_->ioHandlerCount_;
 }
 
 IOHandler::~IOHandler()
@@ -43,25 +47,31 @@ IOHandler::~IOHandler()
     //We can assure only one thread can access this IOHandler, so we can safely disable it
     LOG_DEBUG << "Destroying IOHandler as well as guard for fd " << fd();
     if(LIKELY(loop_)){
-        if(LIKELY(status_ == Status::Enabled)){ //This IOHandler is still enabled
+        if(LIKELY(registered_)){ //This IOHandler is still in epoll
             if(UNLIKELY(loop_->state() == EventLoop::LoopState::End || loop_->quit_))
             {
                 //If the loop is ended,
                 //we cannot & do not need to remove the fd from epoll, 
                 //so we just set self status to Disabled
                 LOG_DEBUG << "EventLoop is ended, IOHandler for fd " << fd() << " will not be removed from epoll";
+                //Events of this iteration may still be dispatched, drop the ones of this handler
+                if (loop_->isLoopThread())
+                    loop_->unbindIOSlot(fd(), slotGeneration_);
             }
             else {
                 LOG_DEBUG << "Using loop's removeFd for fd " << fd();
                 int fd = this->fd();
+                uint32_t generation = slotGeneration_;
                 EventLoop *loop = loop_.get();
-                loop_->runInLoop([loop, fd]() {
-                    loop->removeFd(fd);
+                //Runs right away in the loop thread, so later events of the current batch are dropped
+                loop_->runInLoop([loop, fd, generation]() {
+                    loop->removeFd(fd, generation);
                 });
                 //If the loop is not ended, we can safely remove the fd from epoll
             }
         }
         status_ = Status::Disabled;
+        --loop_->ioHandlerCount_;
         loop_.reset();
     }
     else{
@@ -73,14 +83,11 @@ IOHandler::~IOHandler()
     }
 }
 
-void IOHandler::updateInLoop(IOHandlerPtr handler, Status nextStatus) //addNew is True only when IOHandle call enable(), which works to add new context to epoll
+void IOHandler::updateInLoop(Status nextStatus) //The loop decides whether it is an add, modify or remove when it applies the update
 {
     loop_->assertInLoopThread();
-    bool addNew = false;
-    if((status_ == Status::Created && nextStatus == Status::Enabled) || (status_ == Status::Disabled && nextStatus == Status::Enabled)) //When switching from Created/Disabled to Enabled, we need to add new context to epoll
-        addNew = true;
     status_ = nextStatus;
-    loop_->updateIOHandler(handler, addNew);
+    loop_->updateIOHandler(this);
     if(status_ == Status::Disabled){
         cleanCallbacks();
     }
@@ -94,6 +101,9 @@ void IOHandler::run()
         LOG_WARN << " The handler is disabled during running, probably from anther thread";
         return;
     }
+    //Callbacks may drop the last outside reference to this handler (e.g. user erases the connection
+    //in its close callback), keep it alive until all callbacks of this event are done
+    IOHandlerPtr guard = shared_from_this();
         
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
@@ -126,23 +136,34 @@ void IOHandler::run()
 }
 
 void IOHandler::update(Status nextStatus){
+    //Fast path in loop thread, no closure and no shared_ptr copy
+    if (loop_->isLoopThread())
+    {
+        updateStatusInLoop(nextStatus);
+        return;
+    }
     auto handler = shared_from_this();
     loop_->runInLoop([handler, nextStatus](){
-        if(handler->status() == Status::Disabled && nextStatus == Status::Disabled)
-        {
-            LOG_DEBUG << "Trying to disable a handler that has already been disabled";
-            return;
-        }
-        if (handler->status() == Status::Created && nextStatus == Status::Disabled)
-        {
-            LOG_WARN << "Trying to disable a handler that has not been enabled";
-            handler->status_ = Status::Disabled;
-            return;
-        }
-        handler->updateInLoop(handler, nextStatus);
+        handler->updateStatusInLoop(nextStatus);
     });
 }
 
+void IOHandler::updateStatusInLoop(Status nextStatus)
+{
+    if(status() == Status::Disabled && nextStatus == Status::Disabled)
+    {
+        LOG_DEBUG << "Trying to disable a handler that has already been disabled";
+        return;
+    }
+    if (status() == Status::Created && nextStatus == Status::Disabled)
+    {
+        LOG_WARN << "Trying to disable a handler that has not been enabled";
+        status_ = Status::Disabled;
+        return;
+    }
+    updateInLoop(nextStatus);
+}
+
 
 
 void IOHandler::disable()
@@ -175,103 +196,86 @@ void IOHandler::setReadCallback(ReadCallback cb)
 {
     HCHECK(loop_) << "EventLoop cannot be null";
     LOG_DEBUG << "Setting read callback for IOHandler on fd " << fd();
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, cb](){
-        handler->readCallback_ = std::move(cb);
-        handler->setReadEvent(cb != nullptr);
-    });
+    setCallback(&IOHandler::readCallback_, EPOLLIN, std::move(cb));
 }
 
 void IOHandler::setWriteCallback(WriteCallback cb)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, cb](){
-        handler->writeCallback_ = std::move(cb);
-        handler->setWriteEvent(cb != nullptr);
-    });
+    setCallback(&IOHandler::writeCallback_, EPOLLOUT, std::move(cb));
 }
 
 void IOHandler::setCloseCallback(CloseCallback cb)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, cb](){
-        handler->closeCallback_ = std::move(cb);
-        handler->setCloseEvent(cb != nullptr);
-    });
+    setCallback(&IOHandler::closeCallback_, EPOLLRDHUP, std::move(cb));
 }
+
 void IOHandler::setErrorCallback(ErrorCallback cb)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, cb](){
-        handler->errorCallback_ = std::move(cb);
-        handler->setErrorEvent(cb != nullptr);
-    });
+    setCallback(&IOHandler::errorCallback_, EPOLLERR, std::move(cb));
+}
+
+void IOHandler::setCallback(ReadCallback IOHandler::*slot, int event, ReadCallback cb)
+{
+    //Callbacks are move-only, bind carries cb into the loop
+    loop_->runInLoop(std::bind(&IOHandler::setCallbackInLoop, shared_from_this(), slot, event, std::move(cb)));
+}
+
+void IOHandler::setCallbackInLoop(ReadCallback IOHandler::*slot, int event, ReadCallback &cb)
+{
+    bool on = cb != nullptr;
+    this->*slot = std::move(cb);
+    updateEvents(event, on);
 }
 
 void IOHandler::setReadEvent(bool on)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, on](){
-        if (on)
-        {
-            handler->events_ |= EPOLLIN;
-        }
-        else
-        {
-            handler->events_ &= ~EPOLLIN;
-        }
-        if (handler->isEnabled())
-            handler->updateInLoop(handler, Status::Enabled);
-    });
+    updateEvents(EPOLLIN, on);
 }
 
 void IOHandler::setWriteEvent(bool on)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, on](){
-        if (on)
-        {
-            handler->events_ |= EPOLLOUT;
-        }
-        else
-        {
-            handler->events_ &= ~EPOLLOUT;
-        }
-        if (handler->isEnabled())
-            handler->updateInLoop(handler, Status::Enabled);
-    });
+    updateEvents(EPOLLOUT, on);
 }
 
 void IOHandler::setCloseEvent(bool on)
 {
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, on](){
-        if (on)
-        {
-            handler->events_ |= EPOLLRDHUP;
-        }
-        else
-        {
-            handler->events_ &= ~EPOLLRDHUP;
-        }
-        if (handler->isEnabled())
-            handler->updateInLoop(handler, Status::Enabled);
-    });
+    updateEvents(EPOLLRDHUP, on);
 }
 
 void IOHandler::setErrorEvent(bool on)
 {
+    updateEvents(EPOLLERR, on);
+}
+
+void IOHandler::setEdgeTriggered(bool on)
+{
+    updateEvents(EPOLLET, on);
+}
+
+void IOHandler::updateEvents(int mask, bool on)
+{
+    //Fast path in loop thread, no closure and no shared_ptr copy, the loop only records the handler as dirty
+    if (loop_->isLoopThread())
+    {
+        updateEventsInLoop(mask, on);
+        return;
+    }
     auto handler = shared_from_this();
-    loop_->runInLoop([handler, on](){
-        if (on)
-        {
-            handler->events_ |= EPOLLERR;
-        }
-        else
-        {
-            handler->events_ &= ~EPOLLERR;
-        }
-        if (handler->isEnabled())
-            handler->updateInLoop(handler, Status::Enabled);
+    loop_->runInLoop([handler, mask, on](){
+        handler->updateEventsInLoop(mask, on);
     });
-}
\ No newline at end of file
+}
+
+void IOHandler::updateEventsInLoop(int mask, bool on)
+{
+    if (on)
+    {
+        events_ |= mask;
+    }
+    else
+    {
+        events_ &= ~mask;
+    }
+    if (isEnabled())
+        loop_->updateIOHandler(this);
+}
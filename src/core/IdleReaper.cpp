@@ -0,0 +1,135 @@
+#include "hohnor/core/IdleReaper.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/log/Logging.h"
+#include <algorithm>
+
+using namespace Hohnor;
+
+IdleReaper::Entry::Entry(Functor onIdle)
+    : lastActive_(), timeoutUs_(0),
+      onIdle_(std::move(onIdle)), tick_(0), generation_(0)
+{
+}
+
+IdleReaper::IdleReaper(EventLoop *loop, double tick)
+    : loop_(loop),
+      tickUs_(std::max<int64_t>(1, static_cast<int64_t>(tick * MonotonicTime::kMicroSecondsPerSecond))),
+      start_(loop->now()), currentTick_(0), size_(0), reaped_(0), buckets_(kMinBuckets), processing_(), timer_()
+{
+}
+
+IdleReaper::~IdleReaper()
+{
+    if (timer_)
+        timer_->cancel();
+}
+
+int64_t IdleReaper::tickOf(MonotonicTime time) const
+{
+    //Round up, the tick of a bucket is never before the deadlines in it
+    int64_t elapsed = time.microSeconds() - start_.microSeconds();
+    return elapsed <= 0 ? 0 : (elapsed + tickUs_ - 1) / tickUs_;
+}
+
+void IdleReaper::add(const EntryPtr &entry, double timeout)
+{
+    loop_->assertInLoopThread();
+    HCHECK(timeout > 0) << "Idle timeout must be positive";
+    entry->timeoutUs_ = static_cast<int64_t>(timeout * MonotonicTime::kMicroSecondsPerSecond);
+    reserve(entry->timeoutUs_);
+    entry->touch(loop_->now());
+    insert(entry);
+}
+
+void IdleReaper::insert(const EntryPtr &entry)
+{
+    entry->tick_ = std::max(tickOf(entry->deadline()), currentTick_ + 1);
+    Ref ref = {entry, ++entry->generation_};
+    buckets_[entry->tick_ & (buckets_.size() - 1)].push_back(std::move(ref));
+    ++size_;
+    if (!timer_)
+    {
+        //Aligned to the ticks, so a bucket is processed as soon as its tick has passed
+        MonotonicTime next(start_.microSeconds() + (tickOf(loop_->now()) + 1) * tickUs_);
+        timer_ = loop_->addTimer(std::bind(&IdleReaper::handleTick, this), next, tick());
+    }
+}
+
+void IdleReaper::reserve(int64_t timeoutUs)
+{
+    //Deadlines fall up to one tick after the current one plus the timeout, rounded up
+    size_t span = static_cast<size_t>(timeoutUs / tickUs_ + 3);
+    if (span <= buckets_.size())
+        return;
+    size_t size = buckets_.size();
+    while (size < span)
+        size <<= 1;
+    std::vector<std::vector<Ref>> buckets(size);
+    for (auto &bucket : buckets_)
+    {
+        for (auto &ref : bucket)
+        {
+            EntryPtr entry = ref.entry.lock();
+            if (!entry || entry->generation_ != ref.generation)
+            {
+                --size_;
+                continue;
+            }
+            buckets[entry->tick_ & (size - 1)].push_back(std::move(ref));
+        }
+    }
+    buckets_.swap(buckets);
+}
+
+void IdleReaper::handleTick()
+{
+    MonotonicTime now = loop_->now();
+    int64_t nowTick = (now.microSeconds() - start_.microSeconds()) / tickUs_;
+    //After a stall each bucket is visited once, every due entry in it is found by its tick
+    int64_t first = std::max(currentTick_ + 1, nowTick - static_cast<int64_t>(buckets_.size()) + 1);
+    for (int64_t tick = first; tick <= nowTick; ++tick)
+    {
+        currentTick_ = tick;
+        processBucket(tick, now);
+    }
+    currentTick_ = std::max(currentTick_, nowTick);
+    if (size_ == 0 && timer_)
+    {
+        //Not from inside its own callback
+        std::shared_ptr<TimerHandler> timer = std::move(timer_);
+        loop_->queueInLoop([timer]() { timer->cancel(); });
+    }
+}
+
+void IdleReaper::processBucket(int64_t tick, MonotonicTime now)
+{
+    processing_.swap(buckets_[tick & (buckets_.size() - 1)]);
+    size_ -= processing_.size();
+    for (size_t i = 0; i < processing_.size(); ++i)
+    {
+        EntryPtr entry = processing_[i].entry.lock();
+        //Released, or moved to another bucket
+        if (!entry || entry->generation_ != processing_[i].generation)
+            continue;
+        if (entry->tick_ > tick)
+        {
+            //A later round of this bucket, looked up again as callbacks may grow the buckets
+            buckets_[entry->tick_ & (buckets_.size() - 1)].push_back(std::move(processing_[i]));
+            ++size_;
+        }
+        else if (entry->deadline() <= now)
+        {
+            ++entry->generation_;
+            ++reaped_;
+            if (entry->onIdle_)
+                entry->onIdle_();
+        }
+        else
+        {
+            //Active since it was put here
+            insert(entry);
+        }
+    }
+    processing_.clear();
+}
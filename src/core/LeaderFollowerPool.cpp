@@ -0,0 +1,210 @@
+#include "hohnor/core/LeaderFollowerPool.h"
+#include "hohnor/log/Logging.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cassert>
+
+using namespace Hohnor;
+
+namespace
+{
+    //Data of the stop eventfd, slots carry (generation << 32 | fd)
+    const uint64_t kStopData = UINT64_MAX;
+
+    uint64_t slotData(int fd, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+} // namespace
+
+LeaderFollowerPool::LeaderFollowerPool(const std::string &name)
+    : name_(name), epollFd_(::epoll_create1(EPOLL_CLOEXEC)), stopFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      quit_(false), mutex_(), slots_(), threads_(), dispatched_()
+{
+    if (epollFd_.fd() < 0 || stopFd_.fd() < 0)
+        LOG_SYSFATAL << "LeaderFollowerPool " << name_ << " fails to create epoll or eventfd";
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = kStopData;
+    if (::epoll_ctl(epollFd_.fd(), EPOLL_CTL_ADD, stopFd_.fd(), &event) < 0)
+        LOG_SYSFATAL << "LeaderFollowerPool " << name_ << " fails to add stop eventfd";
+}
+
+LeaderFollowerPool::~LeaderFollowerPool()
+{
+    stop();
+}
+
+void LeaderFollowerPool::start(size_t numThreads)
+{
+    assert(threads_.empty());
+    HCHECK(numThreads > 0) << "LeaderFollowerPool needs at least one thread";
+    dispatched_.reset(new std::atomic<uint64_t>[numThreads]);
+    for (size_t i = 0; i < numThreads; ++i)
+        dispatched_[i].store(0, std::memory_order_relaxed);
+    threads_.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        threads_.emplace_back(new Thread(std::bind(&LeaderFollowerPool::threadFunc, this, i), name_ + std::to_string(i)));
+        threads_.back()->start();
+    }
+    LOG_DEBUG << "LeaderFollowerPool " << name_ << " started with " << numThreads << " threads";
+}
+
+void LeaderFollowerPool::stop()
+{
+    if (quit_.exchange(true))
+        return;
+    uint64_t one = 1;
+    if (::write(stopFd_.fd(), &one, sizeof one) != sizeof one)
+        LOG_SYSERR << "LeaderFollowerPool " << name_ << " fails to wake up threads";
+    for (auto &thread : threads_)
+        thread->join();
+}
+
+void LeaderFollowerPool::threadFunc(size_t index)
+{
+    while (!quit_.load(std::memory_order_relaxed))
+    {
+        //One event at a time, the ones left in the epoll are for the followers
+        struct epoll_event event;
+        int n = ::epoll_wait(epollFd_.fd(), &event, 1, -1);
+        if (n < 0)
+        {
+            if (errno != EINTR)
+                LOG_SYSERR << "LeaderFollowerPool " << name_ << " epoll_wait";
+            continue;
+        }
+        if (n == 0 || event.data.u64 == kStopData)
+            continue;
+        int fd = static_cast<int>(event.data.u64 & 0xffffffffu);
+        uint32_t generation = static_cast<uint32_t>(event.data.u64 >> 32);
+        EntryPtr entry;
+        {
+            MutexGuard guard(mutex_);
+            //Removed after the event was taken
+            if (static_cast<size_t>(fd) < slots_.size() && slots_[fd].generation == generation)
+                entry = slots_[fd].entry;
+        }
+        if (!entry)
+            continue;
+        dispatched_[index].store(dispatched_[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        dispatch(entry, event.events);
+    }
+}
+
+void LeaderFollowerPool::dispatch(const EntryPtr &entry, uint32_t events)
+{
+    {
+        MutexGuard guard(entry->mutex);
+        if (entry->removed)
+            return;
+        //modify() re-armed it while the event was on its way, the running thread takes it over
+        if (entry->running)
+        {
+            entry->missed |= events;
+            return;
+        }
+        entry->running = true;
+    }
+    while (true)
+    {
+        entry->callback(events);
+        MutexGuard guard(entry->mutex);
+        if (entry->missed && !entry->removed)
+        {
+            events = entry->missed;
+            entry->missed = 0;
+            continue;
+        }
+        entry->running = false;
+        if (!entry->removed)
+            arm(EPOLL_CTL_MOD, *entry);
+        return;
+    }
+}
+
+int LeaderFollowerPool::arm(int op, const Entry &entry)
+{
+    struct epoll_event event;
+    event.events = entry.events | EPOLLONESHOT;
+    event.data.u64 = slotData(entry.guard.fd(), entry.generation);
+    int ret = ::epoll_ctl(epollFd_.fd(), op, entry.guard.fd(), &event);
+    if (ret < 0)
+        LOG_SYSERR << "LeaderFollowerPool " << name_ << " epoll_ctl on fd " << entry.guard.fd();
+    return ret;
+}
+
+int LeaderFollowerPool::add(int fd, uint32_t events, EventCallback callback)
+{
+    HCHECK(fd >= 0) << "File descriptor must be non-negative";
+    FdUtils::setNonBlocking(fd);
+    EntryPtr entry;
+    {
+        MutexGuard guard(mutex_);
+        if (static_cast<size_t>(fd) >= slots_.size())
+            slots_.resize(fd + 1);
+        HCHECK(!slots_[fd].entry) << "Fd " << fd << " is in LeaderFollowerPool " << name_ << " already";
+        entry = std::make_shared<Entry>(fd, slots_[fd].generation, events, std::move(callback));
+        slots_[fd].entry = entry;
+    }
+    int ret = arm(EPOLL_CTL_ADD, *entry);
+    if (ret < 0)
+    {
+        //The fd is closed with the entry
+        MutexGuard guard(mutex_);
+        slots_[fd].entry.reset();
+        ++slots_[fd].generation;
+    }
+    return ret;
+}
+
+int LeaderFollowerPool::modify(int fd, uint32_t events)
+{
+    EntryPtr entry;
+    {
+        MutexGuard guard(mutex_);
+        if (static_cast<size_t>(fd) < slots_.size())
+            entry = slots_[fd].entry;
+    }
+    if (!entry)
+        return -1;
+    MutexGuard guard(entry->mutex);
+    entry->events = events;
+    //A running callback re-arms with the new events when it returns
+    if (entry->running || entry->removed)
+        return 0;
+    return arm(EPOLL_CTL_MOD, *entry);
+}
+
+int LeaderFollowerPool::remove(int fd)
+{
+    EntryPtr entry;
+    {
+        MutexGuard guard(mutex_);
+        if (static_cast<size_t>(fd) < slots_.size())
+        {
+            entry.swap(slots_[fd].entry);
+            //Events already taken by a thread are dropped
+            ++slots_[fd].generation;
+        }
+    }
+    if (!entry)
+        return -1;
+    MutexGuard guard(entry->mutex);
+    entry->removed = true;
+    int ret = ::epoll_ctl(epollFd_.fd(), EPOLL_CTL_DEL, fd, NULL);
+    if (ret < 0)
+        LOG_SYSERR << "LeaderFollowerPool " << name_ << " epoll_ctl on fd " << fd;
+    //The fd is closed with the last reference, after the callback if it is running
+    return ret;
+}
+
+std::vector<uint64_t> LeaderFollowerPool::dispatched() const
+{
+    std::vector<uint64_t> counts(threads_.size());
+    for (size_t i = 0; i < counts.size(); ++i)
+        counts[i] = dispatched_[i].load(std::memory_order_relaxed);
+    return counts;
+}
@@ -58,7 +58,7 @@ void signalFDRead(int fd, int signal){
     HCHECK_EQ(fdsi.ssi_signo, signal) << "Received unexpected signal: " << fdsi.ssi_signo;
 }
 
-void SignalHandler::createIOHandler(int fd, Functor cb)
+void SignalHandler::createIOHandler(int fd, SignalCallback cb)
 {
     if(cb == nullptr){
         LOG_WARN << "Creating signal io without callback";
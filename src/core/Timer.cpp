@@ -4,6 +4,9 @@
 #include "hohnor/core/IOHandler.h"
 #include "hohnor/log/Logging.h"
 #include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <algorithm>
 
 using namespace Hohnor;
 
@@ -18,37 +21,49 @@ int createTimerfd()
     return timerfd;
 }
 
-struct timespec howMuchTimeFromNow(Timestamp when)
+namespace
 {
-    int64_t microseconds = when.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
-    if (microseconds < 100)
+    //Arming sooner than this lets an overdue timer fire again at once, only precision timers need it
+    const int64_t kMinArmUs = 100;
+
+    int64_t monotonicNs()
     {
-        microseconds = 100;
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+} // namespace
+
+struct timespec howMuchTimeFromNow(MonotonicTime when, int64_t minMicroseconds)
+{
+    int64_t microseconds = when.microSeconds() - MonotonicTime::now().microSeconds();
+    if (microseconds < minMicroseconds)
+    {
+        microseconds = minMicroseconds;
     }
     struct timespec ts;
     ts.tv_sec = static_cast<time_t>(
-        microseconds / Timestamp::kMicroSecondsPerSecond);
+        microseconds / MonotonicTime::kMicroSecondsPerSecond);
     ts.tv_nsec = static_cast<long>(
-        (microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+        (microseconds % MonotonicTime::kMicroSecondsPerSecond) * 1000);
     return ts;
 }
 
-bool timerCmpLessThan(std::shared_ptr<TimerHandler> &lhs, std::shared_ptr<TimerHandler> &rhs)
-{
-    if (lhs->expiration().microSecondsSinceEpoch() < rhs->expiration().microSecondsSinceEpoch())
-        return true;
-    else if (lhs->expiration().microSecondsSinceEpoch() > rhs->expiration().microSecondsSinceEpoch())
-        return false;
-    else
-        return lhs->sequence() < rhs->sequence();
-}
-
-void resetTimerfd(int timerfd, Timestamp expiration)
+void resetTimerfd(int timerfd, MonotonicTime expiration, int64_t minMicroseconds)
 {
     // wake up loop by timerfd_settime()
     struct itimerspec newValue;
     memZero(&newValue, sizeof newValue);
-    newValue.it_value = howMuchTimeFromNow(expiration);
+    newValue.it_value = howMuchTimeFromNow(expiration, minMicroseconds);
     int ret = ::timerfd_settime(timerfd, 0, &newValue, NULL);
     if (ret)
     {
@@ -58,11 +73,15 @@ void resetTimerfd(int timerfd, Timestamp expiration)
 
 std::atomic<uint64_t> TimerHandler::s_numCreated_;
 
-TimerHandler::TimerHandler(EventLoop *loop, TimerCallback callback, Timestamp when, double interval) : loop_(loop), callback_(callback),
+TimerHandler::TimerHandler(EventLoop *loop, TimerCallback callback, MonotonicTime when, double interval, double slack, double spin) : loop_(loop), callback_(std::move(callback)),
                                                                         expiration_(when),
                                                                         interval_(interval),
+                                                                        slackUs_(slack > 0 ? static_cast<int64_t>(slack * MonotonicTime::kMicroSecondsPerSecond) : 0),
+                                                                        spinUs_(spin > 0 ? std::max<int64_t>(1, static_cast<int64_t>(spin * MonotonicTime::kMicroSecondsPerSecond)) : 0),
                                                                         disabled_(false),
-                                                                        sequence_(s_numCreated_++)
+                                                                        rescheduled_(false),
+                                                                        sequence_(s_numCreated_++),
+                                                                        queue_(NULL), heapIndex_(TimerQueue::TimerHeap::npos), wheel_(NULL), wheelRef_(), wheelTick_(0), wheelSlot_(0)
 {
 }
 
@@ -73,12 +92,12 @@ void TimerHandler::run()
         LOG_DEBUG << "Running timer callback for sequence " << sequence_ << " at " << expiration_.toString();
         callback_();
     }
-    if(!isRepeat()){
+    if(!isRepeat() && !rescheduled_){
         callback_ = nullptr; // Clear callback to avoid running it again and release resources enclosed
     }
 }
 
-void TimerHandler::disable()
+void TimerHandler::cancel()
 {
     if(disabled_)
     {
@@ -91,12 +110,26 @@ void TimerHandler::disable()
         callback_ = nullptr;
         return;
     }
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler](){
-        handler->interval_ = 0.0;
-        handler->disabled_ = true;
-        handler->callback_ = nullptr;
-    });
+    loop_->runInLoop(std::bind(&TimerHandler::cancelInLoop, shared_from_this()));
+}
+
+void TimerHandler::cancelInLoop()
+{
+    interval_ = 0.0;
+    disabled_ = true;
+    callback_ = nullptr;
+    if (queue_)
+        queue_->removeInLoop(this);
+}
+
+void TimerHandler::reschedule(MonotonicTime when)
+{
+    if(disabled_)
+    {
+        LOG_DEBUG << "Timer is already disabled"; 
+        return;
+    }
+    loop_->runInLoop(std::bind(&TimerQueue::rescheduleInLoop, queue_, shared_from_this(), when));
 }
 
 void TimerHandler::updateCallback(TimerCallback callback)
@@ -106,14 +139,17 @@ void TimerHandler::updateCallback(TimerCallback callback)
         LOG_DEBUG << "Timer is already disabled"; 
         return;
     }
-    auto handler = shared_from_this();
-    loop_->runInLoop([handler, callback](){
-        handler->callback_ = std::move(callback);
-        if(Timestamp::now() >= handler->expiration() && handler->getRepeatInterval() <= 0.0)
-        {
-            LOG_WARN << "Updated timer callback after time expired and no more repeat";
-        }
-    });
+    //Callbacks are move-only, bind carries it into the loop
+    loop_->runInLoop(std::bind(&TimerHandler::updateCallbackInLoop, shared_from_this(), std::move(callback)));
+}
+
+void TimerHandler::updateCallbackInLoop(TimerCallback &callback)
+{
+    callback_ = std::move(callback);
+    if(loop_->now() >= expiration() && getRepeatInterval() <= 0.0)
+    {
+        LOG_WARN << "Updated timer callback after time expired and no more repeat";
+    }
 }
 
 void TimerHandler::reloadInLoop()
@@ -124,13 +160,203 @@ void TimerHandler::reloadInLoop()
     }
     else
     {
-        expiration_ = Timestamp::invalid();
+        expiration_ = MonotonicTime::invalid();
     }
 }
 
-TimerQueue::TimerQueue(EventLoop *loop) : loop_(loop), timerFdIOHandle_(nullptr),
-                                          heap_(timerCmpLessThan)
+TimerWheel::TimerWheel(MonotonicTime start, double tick)
+    : start_(start),
+      tickUs_(std::max<int64_t>(1, static_cast<int64_t>(tick * MonotonicTime::kMicroSecondsPerSecond))),
+      currentTick_(0), size_(0)
 {
+    memZero(occupied_, sizeof occupied_);
+}
+
+TimerWheel::~TimerWheel()
+{
+    for (int slot = 0; slot < kLevels * kSlots; ++slot)
+    {
+        while (slots_[slot].linked())
+        {
+            std::shared_ptr<TimerHandler> timer = static_cast<TimerHandler *>(slots_[slot].next)->wheelRef_;
+            remove(timer.get());
+            timer->disable();
+        }
+    }
+    while (due_.linked())
+    {
+        std::shared_ptr<TimerHandler> timer = static_cast<TimerHandler *>(due_.next)->wheelRef_;
+        remove(timer.get());
+        timer->disable();
+    }
+}
+
+void TimerWheel::insert(const std::shared_ptr<TimerHandler> &timer)
+{
+    HCHECK(timer->wheel_ == NULL) << "Timer " << timer->sequence() << " is in a wheel already";
+    int64_t us = timer->expiration().microSeconds() - start_.microSeconds();
+    //Round up, so that a timer never fires before its expiration
+    timer->wheelTick_ = us <= 0 ? 0 : static_cast<uint64_t>((us + tickUs_ - 1) / tickUs_);
+    timer->wheel_ = this;
+    timer->wheelRef_ = timer;
+    ++size_;
+    //Due already, e.g. a late repeating timer reloaded by its interval. The next advance fires it whatever the
+    //tick, so it catches up one run per wakeup like in a heap instead of staying late by one run per tick
+    if (timer->wheelTick_ <= currentTick_)
+    {
+        timer->wheelSlot_ = kDueSlot;
+        timer->linkBefore(&due_);
+        return;
+    }
+    link(timer.get());
+}
+
+void TimerWheel::link(TimerHandler *timer)
+{
+    //Next tick to process, due timers fire in it
+    uint64_t base = currentTick_ + 1;
+    uint64_t tick = std::max(timer->wheelTick_, base);
+    uint64_t delta = tick - base;
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (1ULL << (kLevelBits * (level + 1))))
+        ++level;
+    //Beyond the top level, park it in the farthest slot, it is linked again by its real tick when cascaded
+    if (delta >= (1ULL << (kLevelBits * kLevels)))
+        tick = base + (1ULL << (kLevelBits * kLevels)) - 1;
+    int slot = level * kSlots + static_cast<int>((tick >> (kLevelBits * level)) & (kSlots - 1));
+    timer->wheelSlot_ = slot;
+    timer->linkBefore(&slots_[slot]);
+    occupied_[slot >> 6] |= 1ULL << (slot & 63);
+}
+
+void TimerWheel::remove(TimerHandler *timer)
+{
+    if (timer->wheel_ != this)
+        return;
+    //Dropping the wheel's reference may destroy the timer, do it last
+    std::shared_ptr<TimerHandler> ref(std::move(timer->wheelRef_));
+    int slot = timer->wheelSlot_;
+    timer->unlink();
+    if (slot != kDueSlot && !slots_[slot].linked())
+        occupied_[slot >> 6] &= ~(1ULL << (slot & 63));
+    timer->wheel_ = NULL;
+    --size_;
+}
+
+void TimerWheel::processTick(uint64_t tick, std::vector<std::shared_ptr<TimerHandler>> &expired)
+{
+    //Timers are linked relative to the tick in process
+    currentTick_ = tick - 1;
+    //Cascade from coarse to fine, a cascaded timer always lands in a finer level
+    for (int level = kLevels - 1; level >= 0; --level)
+    {
+        if (level > 0 && (tick & ((1ULL << (kLevelBits * level)) - 1)) != 0)
+            continue;
+        int slot = level * kSlots + static_cast<int>((tick >> (kLevelBits * level)) & (kSlots - 1));
+        if (!occupied(slot))
+            continue;
+        occupied_[slot >> 6] &= ~(1ULL << (slot & 63));
+        TimerWheelLink pending;
+        pending.linkBefore(&slots_[slot]);
+        slots_[slot].unlink();
+        while (pending.linked())
+        {
+            TimerHandler *timer = static_cast<TimerHandler *>(pending.next);
+            timer->unlink();
+            if (level > 0)
+            {
+                link(timer);
+                continue;
+            }
+            timer->wheel_ = NULL;
+            --size_;
+            expired.push_back(std::move(timer->wheelRef_));
+        }
+    }
+    currentTick_ = tick;
+}
+
+uint64_t TimerWheel::nextTickOfLevel(int level) const
+{
+    const int kWords = kSlots / 64;
+    const uint64_t *words = occupied_ + level * kWords;
+    uint64_t unit = 1ULL << (kLevelBits * level);
+    //First tick to come that processes a slot of this level, and that slot
+    uint64_t first = (currentTick_ + unit) & ~(unit - 1);
+    int start = static_cast<int>((first >> (kLevelBits * level)) & (kSlots - 1));
+    for (int k = 0; k <= kWords; ++k)
+    {
+        int index = (start / 64 + k) % kWords;
+        uint64_t word = words[index];
+        if (k == 0)
+            word &= ~0ULL << (start % 64);
+        else if (k == kWords) //Back to the word of start, only slots before start are left
+            word &= (1ULL << (start % 64)) - 1;
+        if (word)
+        {
+            int slot = index * 64 + __builtin_ctzll(word);
+            return first + static_cast<uint64_t>((slot - start + kSlots) % kSlots) * unit;
+        }
+    }
+    return UINT64_MAX;
+}
+
+void TimerWheel::advance(MonotonicTime now, std::vector<std::shared_ptr<TimerHandler>> &expired)
+{
+    while (due_.linked())
+    {
+        TimerHandler *timer = static_cast<TimerHandler *>(due_.next);
+        timer->unlink();
+        timer->wheel_ = NULL;
+        --size_;
+        expired.push_back(std::move(timer->wheelRef_));
+    }
+    int64_t us = now.microSeconds() - start_.microSeconds();
+    if (us < 0)
+        return;
+    uint64_t nowTick = static_cast<uint64_t>(us / tickUs_);
+    while (currentTick_ < nowTick)
+    {
+        uint64_t next = UINT64_MAX;
+        for (int level = 0; size_ && level < kLevels; ++level)
+            next = std::min(next, nextTickOfLevel(level));
+        //Nothing to do in the ticks in between
+        if (next > nowTick)
+        {
+            currentTick_ = nowTick;
+            break;
+        }
+        processTick(next, expired);
+    }
+}
+
+MonotonicTime TimerWheel::nextAdvance() const
+{
+    if (size_ == 0)
+        return MonotonicTime::invalid();
+    if (due_.linked())
+        return MonotonicTime(start_.microSeconds() + static_cast<int64_t>(currentTick_) * tickUs_);
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < kLevels; ++level)
+        next = std::min(next, nextTickOfLevel(level));
+    return MonotonicTime(start_.microSeconds() + static_cast<int64_t>(next) * tickUs_);
+}
+
+TimerQueue::TimerQueue(EventLoop *loop, TimerBackend backend, double tick, bool timerfd) : loop_(loop), timerFdIOHandle_(nullptr),
+                                          heap_(), wheel_(), armed_(),
+                                          timerfdUpdates_(0), timerfdUpdatesAvoided_(0), expired_(),
+                                          lateness_(), preciseLateness_(), timerSlackLowered_(false)
+{
+    if (backend == TimerBackend::Wheel)
+    {
+        HCHECK(tick > 0) << "Tick of timer wheel must be positive";
+        wheel_.reset(new TimerWheel(MonotonicTime::now(), tick));
+    }
+    if (!timerfd)
+    {
+        LOG_DEBUG << "Created TimerQueue without timerfd";
+        return;
+    }
     int fd = createTimerfd();
     LOG_DEBUG << "Created timerfd " << fd;
     timerFdIOHandle_ = loop->handleIO(fd);
@@ -143,8 +369,9 @@ TimerQueue::~TimerQueue()
 {
     while (heap_.size())
     {
-        heap_.popTop()->disable();
+        heap_.pop()->disable();
     }
+    wheel_.reset();
     // Eventloop will take care of these
     // timerFdIOHandle_->disable();
     // LOG_DEBUG << "disable TimerQueue fd ";
@@ -155,7 +382,8 @@ TimerQueue::~TimerQueue()
 void TimerQueue::handleRead()
 {
     loop_->assertInLoopThread();
-    Timestamp now(Timestamp::now());
+    //Coarse time of the loop may be behind the timerfd, that would set it again and again to a time already passed
+    MonotonicTime now(loop_->options().coarseClock ? MonotonicTime::now() : loop_->now());
     uint64_t howmany;
     ssize_t n = ::read(timerFdIOHandle_->fd(), &howmany, sizeof howmany);
     LOG_TRACE << "TimerQueue::handleRead() " << howmany << " at " << now.toString();
@@ -163,43 +391,188 @@ void TimerQueue::handleRead()
     {
         LOG_ERROR << "TimerQueue::handleRead() reads " << n << " bytes instead of 8";
     }
+    runExpired(now);
+}
 
-    while (heap_.size() && heap_.top()->expiration().microSecondsSinceEpoch() <= now.microSecondsSinceEpoch())
+void TimerQueue::runExpired(MonotonicTime now)
+{
+    //timerfd is not set any more after it went off
+    armed_ = MonotonicTime::invalid();
+    if (wheel_)
+        wheel_->advance(now, expired_);
+    //Take the expired ones out first, so that a repeating timer runs once per call however late it is.
+    //The heap is ordered by deadline, so this also takes the timers whose deadline is later but are due
+    //already, till the first one that is not. Others that are due are left for a later wakeup before their deadline.
+    //Precision timers are taken from the time they spin
+    size_t fromWheel = expired_.size();
+    while (heap_.size() && heap_.top()->expiration().microSeconds() - heap_.top()->spinUs_ <= now.microSeconds())
     {
-        auto timerHandler = heap_.popTop();
+        expired_.push_back(heap_.pop());
+        //Each one due at a time of its own would have set the timerfd once more without slack
+        if (expired_.size() > fromWheel + 1 && expired_[expired_.size() - 2]->expiration() != expired_.back()->expiration())
+            timerfdUpdatesAvoided_.store(timerfdUpdatesAvoided_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < expired_.size(); ++i)
+    {
+        std::shared_ptr<TimerHandler> &timerHandler = expired_[i];
+        if (timerHandler->isPrecise())
+        {
+            int64_t expirationNs = timerHandler->expiration().microSeconds() * 1000;
+            int64_t nowNs = monotonicNs();
+            while (nowNs < expirationNs)
+            {
+                cpuRelax();
+                nowNs = monotonicNs();
+            }
+            preciseLateness_.record(static_cast<uint64_t>(std::max<int64_t>(0, nowNs - expirationNs)));
+        }
+        else
+        {
+            int64_t late = now.microSeconds() - timerHandler->expiration().microSeconds();
+            lateness_.record(static_cast<uint64_t>(std::max<int64_t>(0, late)) * 1000);
+        }
+        timerHandler->rescheduled_ = false;
         timerHandler->run();
-        if (timerHandler->isRepeat())
+        if (timerHandler->rescheduled_ && !timerHandler->disabled_)
+        {
+            requeueInLoop(timerHandler);
+        }
+        else if (timerHandler->isRepeat())
         {
             timerHandler->reloadInLoop();
-            loop_->queueInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timerHandler));
+            requeueInLoop(timerHandler);
         }
         else //For non-repeating timers, mark it as disabled.
         {
             timerHandler->disabled_ = true;
         }
     }
-    if (heap_.size())
-    {
-        resetTimerfd(timerFdIOHandle_->fd(), heap_.top()->expiration());
-    }
+    expired_.clear();
+    armNext();
 }
 
 std::shared_ptr<TimerHandler> TimerQueue::addTimer(TimerCallback cb,
-                             Timestamp when,
-                             double interval)
+                             MonotonicTime when,
+                             double interval,
+                             double slack,
+                             double spin)
 {
-    std::shared_ptr<TimerHandler> timerHandler(new TimerHandler(loop_, std::move(cb), when, interval));
+    std::shared_ptr<TimerHandler> timerHandler(new TimerHandler(loop_, std::move(cb), when, interval, slack, spin));
+    timerHandler->queue_ = this;
     loop_->queueInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timerHandler));
     return timerHandler;
 }
 
+MonotonicTime TimerQueue::nextExpiration() const
+{
+    MonotonicTime next = wheel_ ? wheel_->nextAdvance() : MonotonicTime::invalid();
+    if (heap_.size() && (!next.valid() || heap_.top()->wakeTimeUs() < next.microSeconds()))
+        next = MonotonicTime(heap_.top()->wakeTimeUs());
+    return next;
+}
+
+void TimerQueue::armNext()
+{
+    MonotonicTime next = nextExpiration();
+    if (!next.valid())
+        return;
+    armTimerfd(next, heap_.size() && heap_.top()->isPrecise() && heap_.top()->wakeTimeUs() == next.microSeconds());
+}
+
+void TimerQueue::armTimerfd(MonotonicTime when, bool precise)
+{
+    //The loop polls till nextExpiration() instead
+    if (!timerFdIOHandle_)
+        return;
+    if (armed_.valid() && armed_.microSeconds() <= when.microSeconds())
+    {
+        timerfdUpdatesAvoided_.store(timerfdUpdatesAvoided_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    armed_ = when;
+    resetTimerfd(timerFdIOHandle_->fd(), when, precise ? 1 : kMinArmUs);
+    timerfdUpdates_.store(timerfdUpdates_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
 void TimerQueue::addTimerInLoop(std::shared_ptr<TimerHandler> timerHandler)
 {
     loop_->assertInLoopThread();
     HCHECK_NE(timerHandler, nullptr) << "Adding a nullptr to timerqueue";
-    heap_.insert(timerHandler);
+    //Cancelled before it got here
+    if (timerHandler->disabled_)
+        return;
+    insertInLoop(timerHandler);
+}
+
+void TimerQueue::insertInLoop(const std::shared_ptr<TimerHandler> &timerHandler)
+{
+    if (wheel_ && !timerHandler->isPrecise())
+    {
+        wheel_->insert(timerHandler);
+        //The wheel turns at the armed time and takes every tick up to then, so the timer is in time if that is
+        //before its deadline
+        if (armed_.valid() && armed_.microSeconds() <= timerHandler->deadline().microSeconds())
+            timerfdUpdatesAvoided_.store(timerfdUpdatesAvoided_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            armTimerfd(wheel_->nextAdvance());
+        return;
+    }
+    if (timerHandler->isPrecise() && !timerSlackLowered_)
+    {
+        //Sleeps of the loop thread, e.g. poll timeouts, may otherwise be extended by 50us
+        timerSlackLowered_ = true;
+        if (::prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL) != 0)
+            LOG_SYSERR << "prctl(PR_SET_TIMERSLACK)";
+    }
+    heap_.push(timerHandler);
     if(heap_.top() == timerHandler)
     {
-        resetTimerfd(timerFdIOHandle_->fd(), timerHandler->expiration());
+        armTimerfd(MonotonicTime(timerHandler->wakeTimeUs()), timerHandler->isPrecise());
     }
-}
\ No newline at end of file
+}
+
+void TimerQueue::requeueInLoop(const std::shared_ptr<TimerHandler> &timerHandler)
+{
+    //A wheel takes expirations in the past, they fire at the next advance
+    if (wheel_ && !timerHandler->isPrecise())
+        wheel_->insert(timerHandler);
+    else
+        heap_.push(timerHandler);
+}
+
+void TimerQueue::removeInLoop(TimerHandler *timerHandler)
+{
+    //Nothing to do if it is not queued yet or is running now
+    if (timerHandler->wheel_)
+        wheel_->remove(timerHandler);
+    else if (timerHandler->heapIndex_ != TimerHeap::npos)
+        heap_.remove(timerHandler->heapIndex_);
+}
+
+void TimerQueue::rescheduleInLoop(const std::shared_ptr<TimerHandler> &timerHandler, MonotonicTime when)
+{
+    //Cancelled, or a one-shot timer that has run, since reschedule() was called
+    if (timerHandler->disabled_)
+        return;
+    if (timerHandler->heapIndex_ != TimerHeap::npos)
+    {
+        //Move in place
+        timerHandler->expiration_ = when;
+        heap_.update(timerHandler->heapIndex_);
+        //Moved later it only causes a wakeup with nothing to run, that is cheaper than another syscall
+        if (timerHandler->heapIndex_ == 0)
+            armTimerfd(MonotonicTime(timerHandler->wakeTimeUs()), timerHandler->isPrecise());
+    }
+    else if (timerHandler->wheel_)
+    {
+        wheel_->remove(timerHandler.get());
+        timerHandler->expiration_ = when;
+        insertInLoop(timerHandler);
+    }
+    else
+    {
+        //Not queued yet or running now, it is queued by the new expiration
+        timerHandler->expiration_ = when;
+        timerHandler->rescheduled_ = true;
+    }
+}
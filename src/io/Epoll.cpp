@@ -1,11 +1,29 @@
 #include "hohnor/io/Epoll.h"
 #include "hohnor/io/FdUtils.h"
 #include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 
 using namespace Hohnor;
 
+namespace
+{
+#ifdef SYS_epoll_pwait2
+    //Cleared by the first ENOSYS, the kernel is older than 5.11
+    std::atomic<bool> s_hasPwait2(true);
+#else
+    std::atomic<bool> s_hasPwait2(false);
+#endif
+} // namespace
+
+const size_t Epoll::kMaxEventsSize;
+const size_t Epoll::kShrinkAfterIdleWaits;
+
 Epoll::Epoll(size_t maxEventsSize, bool closeOnExec)
-    : events_(std::move(std::unique_ptr<epoll_event[]>(new epoll_event[maxEventsSize]))), maxEventsSize_(maxEventsSize), readyEvents_(0)
+    : events_(std::move(std::unique_ptr<epoll_event[]>(new epoll_event[maxEventsSize]))), maxEventsSize_(maxEventsSize),
+      minEventsSize_(maxEventsSize), readyEvents_(0), lastReadyEvents_(0), idleWaits_(0)
 {
     int ret = epoll_create1(closeOnExec ? EPOLL_CLOEXEC : 0);
     if (ret == -1)
@@ -16,6 +34,7 @@ Epoll::Epoll(size_t maxEventsSize, bool closeOnExec)
 
 int Epoll::ctl(int cmd, int fd, epoll_event *event)
 {
+    incSyscalls();
     int ret = epoll_ctl(this->fd(), cmd, fd, event);
     if (ret < 0)
     {
@@ -26,24 +45,38 @@ int Epoll::ctl(int cmd, int fd, epoll_event *event)
 
 int Epoll::add(int fd, int trackEvents, void *ptr)
 {
-    epoll_event e;
-    e.events = trackEvents;
+    PollData data;
+    if (ptr != NULL)
+        data.ptr = ptr;
+    else
+        data.fd = fd;
+    return add(fd, trackEvents, data);
+}
+
+int Epoll::modify(int fd, int trackEvents, void *ptr)
+{
+    PollData data;
     if (ptr != NULL)
-        e.data.ptr = ptr;
+        data.ptr = ptr;
     else
-        e.data.fd = fd;
+        data.fd = fd;
+    return modify(fd, trackEvents, data);
+}
+
+int Epoll::add(int fd, int trackEvents, PollData data)
+{
+    epoll_event e;
+    e.events = trackEvents;
+    e.data = data;
     FdUtils::setNonBlocking(fd);
     return this->ctl(EPOLL_CTL_ADD, fd, &e);
 }
 
-int Epoll::modify(int fd, int trackEvents, void *ptr)
+int Epoll::modify(int fd, int trackEvents, PollData data)
 {
     epoll_event e;
     e.events = trackEvents;
-    if (ptr != NULL)
-        e.data.ptr = ptr;
-    else
-        e.data.fd = fd;
+    e.data = data;
     return this->ctl(EPOLL_CTL_MOD, fd, &e);
 }
 
@@ -52,15 +85,99 @@ int Epoll::remove(int fd)
     return this->ctl(EPOLL_CTL_DEL, fd, NULL);
 }
 
-Epoll::Iter Epoll::wait(int timeout, const sigset_t *sigmask)
+void Epoll::adaptEventsSize()
+{
+    size_t size = maxEventsSize_;
+    if (lastReadyEvents_ == maxEventsSize_ && maxEventsSize_ < kMaxEventsSize)
+    {
+        //Filled up, there are probably more ready fds left in kernel
+        size = std::min(maxEventsSize_ * 2, kMaxEventsSize);
+        idleWaits_ = 0;
+    }
+    else if (lastReadyEvents_ == 0)
+    {
+        //Timed out or interrupted, e.g. a busy poll spin, tells nothing about the load
+    }
+    else if (lastReadyEvents_ < maxEventsSize_ / 4 && maxEventsSize_ > minEventsSize_)
+    {
+        if (++idleWaits_ >= kShrinkAfterIdleWaits)
+        {
+            size = std::max(maxEventsSize_ / 2, minEventsSize_);
+            idleWaits_ = 0;
+        }
+    }
+    else
+    {
+        idleWaits_ = 0;
+    }
+    if (size != maxEventsSize_)
+    {
+        LOG_DEBUG << "Hohnor::Epoll resizes events from " << maxEventsSize_ << " to " << size;
+        events_.reset(new epoll_event[size]);
+        maxEventsSize_ = size;
+    }
+}
+
+int Epoll::waitEvents(int timeout, const sigset_t *sigmask)
 {
+    //Iter of last wait has been destroyed, safe to reallocate events
+    adaptEventsSize();
     int ret;
+    incSyscalls();
     if (sigmask == NULL)
         ret = epoll_wait(fd(), events_.get(), maxEventsSize_, timeout);
     else
         ret = epoll_pwait(fd(), events_.get(), maxEventsSize_, timeout, sigmask);
     if (ret == -1 && errno != EINTR)
         LOG_SYSERR << "Hohnor::Epoll::wait() ";
-    readyEvents_ = ret;
+    lastReadyEvents_ = ret > 0 ? static_cast<size_t>(ret) : 0;
+    return ret;
+}
+
+int Epoll::waitEventsMicros(int64_t timeout)
+{
+    //Whole milliseconds need no finer wait
+    if (timeout <= 0 || timeout % 1000 == 0 || !s_hasPwait2.load(std::memory_order_relaxed))
+        return waitEvents(timeout < 0 ? -1 : static_cast<int>((timeout + 999) / 1000), NULL);
+#ifdef SYS_epoll_pwait2
+    adaptEventsSize();
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout / 1000000);
+    ts.tv_nsec = static_cast<long>(timeout % 1000000) * 1000;
+    incSyscalls();
+    //Called directly, older glibc has no wrapper
+    int ret = static_cast<int>(::syscall(SYS_epoll_pwait2, fd(), events_.get(), static_cast<int>(maxEventsSize_), &ts, NULL, 0));
+    if (ret == -1 && errno == ENOSYS)
+    {
+        LOG_DEBUG << "Hohnor::Epoll falls back to epoll_wait, epoll_pwait2 is not supported";
+        s_hasPwait2.store(false, std::memory_order_relaxed);
+        return waitEvents(static_cast<int>((timeout + 999) / 1000), NULL);
+    }
+    if (ret == -1 && errno != EINTR)
+        LOG_SYSERR << "Hohnor::Epoll::wait() ";
+    lastReadyEvents_ = ret > 0 ? static_cast<size_t>(ret) : 0;
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+Epoll::Iter Epoll::wait(int timeout, const sigset_t *sigmask)
+{
+    readyEvents_ = waitEvents(timeout, sigmask);
     return Iter(this);
-}
\ No newline at end of file
+}
+
+int Epoll::poll(int timeout, PollEvent **events)
+{
+    int ret = waitEvents(timeout, NULL);
+    *events = events_.get();
+    return ret > 0 ? ret : 0;
+}
+
+int Epoll::pollMicros(int64_t timeout, PollEvent **events)
+{
+    int ret = waitEventsMicros(timeout);
+    *events = events_.get();
+    return ret > 0 ? ret : 0;
+}
@@ -0,0 +1,345 @@
+#include "hohnor/io/IOUring.h"
+#include "hohnor/log/Logging.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace Hohnor;
+
+namespace
+{
+    //Completions of POLL_REMOVE requests carry this, real polls never have generation 0
+    const uint64_t kIgnoredUserData = 0;
+
+    int ioUringSetup(unsigned entries, struct io_uring_params *p)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+} // namespace
+
+IOUring::IOUring(unsigned entries, size_t maxEventsSize)
+    : FdGuard(-1),
+      sqRing_(MAP_FAILED), sqRingSize_(0), cqRing_(MAP_FAILED), cqRingSize_(0),
+      sqes_(NULL), sqesSize_(0),
+      sqHead_(NULL), sqTail_(NULL), sqRingMask_(NULL), sqArray_(NULL), sqEntries_(0),
+      cqHead_(NULL), cqTail_(NULL), cqRingMask_(NULL), cqes_(NULL),
+      sqTailLocal_(0), toSubmit_(0),
+      entries_(), fired_(), events_()
+{
+    events_.reserve(maxEventsSize);
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    //Every tracked fd may have a completion waiting, leave room for them
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+    int ringFd = ioUringSetup(entries, &p);
+    if (ringFd < 0)
+    {
+        LOG_WARN << "Hohnor::IOUring io_uring_setup() failed: " << strerror_tl(errno);
+        return;
+    }
+    setFd(ringFd);
+    //Waiting with timeout needs IORING_ENTER_EXT_ARG, and completions must never be dropped
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+    {
+        LOG_WARN << "Hohnor::IOUring kernel lacks IORING_FEAT_EXT_ARG or IORING_FEAT_NODROP";
+        return;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = ::mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_SYSERR << "Hohnor::IOUring mmap submission queue error";
+        return;
+    }
+    cqRing_ = singleMmap ? sqRing_ : ::mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+    {
+        LOG_SYSERR << "Hohnor::IOUring mmap completion queue error";
+        return;
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ::mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_SYSERR << "Hohnor::IOUring mmap submission entries error";
+        return;
+    }
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sqRingMask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    sqEntries_ = p.sq_entries;
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cqRingMask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+    sqTailLocal_ = *sqTail_;
+    //Set last, valid() depends on it
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+}
+
+IOUring::~IOUring()
+{
+    if (sqes_ != NULL)
+        ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+        ::munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != MAP_FAILED)
+        ::munmap(sqRing_, sqRingSize_);
+}
+
+struct io_uring_sqe *IOUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqTailLocal_ - head >= sqEntries_)
+    {
+        //Queue is full, hand what we have to the kernel first
+        enter(false, 0);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqTailLocal_ - head >= sqEntries_)
+        {
+            LOG_ERROR << "Hohnor::IOUring submission queue is full";
+            return NULL;
+        }
+    }
+    unsigned index = sqTailLocal_ & *sqRingMask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    ++sqTailLocal_;
+    ++toSubmit_;
+    return sqe;
+}
+
+void IOUring::armPoll(int fd, Entry &entry)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    //One shot, re-armed after the loop handled the event, same as a level-triggered epoll.
+    //EPOLLET is dropped, handlers that drain until EAGAIN work with level-triggered reports as well
+    sqe->poll32_events = entry.events & ~static_cast<uint32_t>(EPOLLET);
+    sqe->user_data = userData(fd, entry.generation);
+    entry.armed = true;
+}
+
+void IOUring::cancelPoll(int fd, Entry &entry)
+{
+    if (!entry.armed)
+        return;
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == NULL)
+        return;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = userData(fd, entry.generation);
+    sqe->user_data = kIgnoredUserData;
+    entry.armed = false;
+}
+
+int IOUring::add(int fd, int trackEvents, void *ptr)
+{
+    PollData data;
+    data.ptr = ptr;
+    return add(fd, trackEvents, data);
+}
+
+int IOUring::modify(int fd, int trackEvents, void *ptr)
+{
+    PollData data;
+    data.ptr = ptr;
+    return modify(fd, trackEvents, data);
+}
+
+int IOUring::add(int fd, int trackEvents, PollData data)
+{
+    if (fd < 0)
+    {
+        errno = EBADF;
+        LOG_SYSERR << "Hohnor::IOUring::add() error";
+        return -1;
+    }
+    if (static_cast<size_t>(fd) >= entries_.size())
+        entries_.resize(std::max(static_cast<size_t>(fd) + 1, entries_.size() * 2));
+    Entry &entry = entries_[fd];
+    if (entry.tracked)
+    {
+        errno = EEXIST;
+        LOG_SYSERR << "Hohnor::IOUring::add() error";
+        return -1;
+    }
+    FdUtils::setNonBlocking(fd);
+    entry.data = data;
+    entry.events = static_cast<uint32_t>(trackEvents);
+    if (++entry.generation == 0)
+        entry.generation = 1;
+    entry.tracked = true;
+    armPoll(fd, entry);
+    return 0;
+}
+
+int IOUring::modify(int fd, int trackEvents, PollData data)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= entries_.size() || !entries_[fd].tracked)
+    {
+        errno = ENOENT;
+        LOG_SYSERR << "Hohnor::IOUring::modify() error";
+        return -1;
+    }
+    Entry &entry = entries_[fd];
+    entry.data = data;
+    if (entry.events == static_cast<uint32_t>(trackEvents))
+        return 0;
+    entry.events = static_cast<uint32_t>(trackEvents);
+    //A poll that has fired picks up the new events when it is re-armed, otherwise replace it
+    if (entry.armed)
+    {
+        cancelPoll(fd, entry);
+        if (++entry.generation == 0)
+            entry.generation = 1;
+        armPoll(fd, entry);
+    }
+    return 0;
+}
+
+int IOUring::remove(int fd)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= entries_.size() || !entries_[fd].tracked)
+    {
+        errno = ENOENT;
+        LOG_SYSERR << "Hohnor::IOUring::remove() error";
+        return -1;
+    }
+    Entry &entry = entries_[fd];
+    cancelPoll(fd, entry);
+    if (++entry.generation == 0)
+        entry.generation = 1;
+    entry.tracked = false;
+    entry.data.u64 = 0;
+    return 0;
+}
+
+int IOUring::enter(bool wait, int64_t timeout)
+{
+    __atomic_store_n(sqTail_, sqTailLocal_, __ATOMIC_RELEASE);
+    unsigned flags = 0;
+    unsigned minComplete = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    arg.sigmask_sz = _NSIG / 8;
+    if (wait)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        minComplete = 1;
+        if (timeout >= 0)
+        {
+            ts.tv_sec = timeout / 1000000;
+            ts.tv_nsec = (timeout % 1000000) * 1000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+    else
+    {
+        //Still let kernel run pending completion work so that readiness shows up in the completion queue
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    incSyscalls();
+    int ret = ioUringEnter(fd(), toSubmit_, minComplete, flags, wait ? &arg : NULL, wait ? sizeof arg : 0);
+    if (ret >= 0)
+    {
+        toSubmit_ -= std::min(toSubmit_, static_cast<unsigned>(ret));
+    }
+    else if (errno != EINTR && errno != ETIME && errno != EBUSY)
+    {
+        LOG_SYSERR << "Hohnor::IOUring::enter() error";
+    }
+    return ret;
+}
+
+void IOUring::reapCompletions()
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    unsigned mask = *cqRingMask_;
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe &cqe = cqes_[head & mask];
+        if (cqe.user_data == kIgnoredUserData)
+            continue;
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+        if (fd < 0 || static_cast<size_t>(fd) >= entries_.size())
+            continue;
+        Entry &entry = entries_[fd];
+        //Completion of a poll that has been cancelled or replaced
+        if (!entry.tracked || entry.generation != generation)
+            continue;
+        entry.armed = false;
+        fired_.push_back(fd);
+        if (cqe.res == -ECANCELED)
+            continue;
+        PollEvent event;
+        event.events = cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+        event.data = entry.data;
+        events_.push_back(event);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+int IOUring::poll(int timeout, PollEvent **events)
+{
+    return pollMicros(timeout < 0 ? -1 : timeout * 1000LL, events);
+}
+
+int IOUring::pollMicros(int64_t timeout, PollEvent **events)
+{
+    events_.clear();
+    //Re-arm polls whose events have been handled since last poll()
+    for (int fd : fired_)
+    {
+        Entry &entry = entries_[fd];
+        if (entry.tracked && !entry.armed)
+            armPoll(fd, entry);
+    }
+    fired_.clear();
+
+    reapCompletions();
+    //Block only if nothing is ready yet, submission of queued SQEs rides on the same syscall
+    if (events_.empty() && timeout != 0)
+    {
+        enter(true, timeout);
+        reapCompletions();
+    }
+    else if (toSubmit_ > 0 || timeout == 0)
+    {
+        enter(false, 0);
+        reapCompletions();
+    }
+    *events = events_.empty() ? NULL : &events_[0];
+    return static_cast<int>(events_.size());
+}
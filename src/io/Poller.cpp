@@ -0,0 +1,31 @@
+#include "hohnor/io/Poller.h"
+#include "hohnor/io/Epoll.h"
+#include "hohnor/io/IOUring.h"
+#include "hohnor/log/Logging.h"
+
+using namespace Hohnor;
+
+Poller *Poller::create(PollerBackend backend)
+{
+    if (backend == PollerBackend::IOUring)
+    {
+        IOUring *ring = new IOUring();
+        if (ring->valid())
+            return ring;
+        delete ring;
+        LOG_WARN << "io_uring is not supported, fall back to epoll";
+    }
+    return new Epoll();
+}
+
+const char *Hohnor::pollerBackendName(PollerBackend backend)
+{
+    switch (backend)
+    {
+    case PollerBackend::Epoll:
+        return "epoll";
+    case PollerBackend::IOUring:
+        return "io_uring";
+    }
+    return "unknown";
+}
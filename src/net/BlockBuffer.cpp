@@ -0,0 +1,144 @@
+#include "hohnor/common/BlockBuffer.h"
+#include "hohnor/net/SocketWrap.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace Hohnor;
+
+const size_t BlockBuffer::kBlockSize;
+const size_t BlockBuffer::kMaxPooledBlocks;
+
+namespace
+{
+    //Buffers may outlive the free list of their thread, e.g. when a static one is destroyed at exit
+    thread_local bool t_poolDestroyed = false;
+
+    struct BlockPool
+    {
+        ~BlockPool()
+        {
+            for (char *block : blocks)
+                delete[] block;
+            t_poolDestroyed = true;
+        }
+        std::vector<char *> blocks;
+    };
+    thread_local BlockPool t_pool;
+
+    char *acquireBlock()
+    {
+        if (t_poolDestroyed || t_pool.blocks.empty())
+            return new char[BlockBuffer::kBlockSize];
+        char *block = t_pool.blocks.back();
+        t_pool.blocks.pop_back();
+        return block;
+    }
+
+    void releaseBlock(char *block)
+    {
+        if (t_poolDestroyed || t_pool.blocks.size() >= BlockBuffer::kMaxPooledBlocks)
+            delete[] block;
+        else
+            t_pool.blocks.push_back(block);
+    }
+} // namespace
+
+size_t BlockBuffer::pooledBlocks()
+{
+    return t_poolDestroyed ? 0 : t_pool.blocks.size();
+}
+
+void BlockBuffer::append(const char* data, size_t len)
+{
+    readable_ += len;
+    while (len > 0)
+    {
+        if (blocks_.empty() || writeIndex_ == kBlockSize)
+        {
+            blocks_.push_back(acquireBlock());
+            writeIndex_ = 0;
+        }
+        size_t n = std::min(len, kBlockSize - writeIndex_);
+        memcpy(blocks_.back() + writeIndex_, data, n);
+        writeIndex_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void BlockBuffer::retrieve(size_t len)
+{
+    assert(len <= readable_);
+    if (len == readable_)
+    {
+        retrieveAll();
+        return;
+    }
+    readable_ -= len;
+    //Bytes are left, so the back block is never released here
+    while (len > 0)
+    {
+        size_t n = frontBytes();
+        if (len < n)
+        {
+            readIndex_ += len;
+            return;
+        }
+        len -= n;
+        releaseBlock(blocks_.front());
+        blocks_.pop_front();
+        readIndex_ = 0;
+    }
+}
+
+void BlockBuffer::retrieveAll()
+{
+    for (char *block : blocks_)
+        releaseBlock(block);
+    blocks_.clear();
+    readIndex_ = 0;
+    writeIndex_ = 0;
+    readable_ = 0;
+}
+
+std::string BlockBuffer::retrieveAllAsString()
+{
+    std::string result;
+    result.reserve(readable_);
+    for (size_t i = 0; i < blocks_.size(); ++i)
+    {
+        size_t begin = i == 0 ? readIndex_ : 0;
+        size_t end = i + 1 == blocks_.size() ? writeIndex_ : kBlockSize;
+        result.append(blocks_[i] + begin, end - begin);
+    }
+    retrieveAll();
+    return result;
+}
+
+ssize_t BlockBuffer::writeFd(int fd, int* savedErrno, size_t maxBytes)
+{
+    if (readable_ == 0 || maxBytes == 0)
+        return 0;
+    struct iovec vec[IOV_MAX];
+    int iovcnt = 0;
+    size_t bytes = 0;
+    while (static_cast<size_t>(iovcnt) < blocks_.size() && iovcnt < IOV_MAX && bytes < maxBytes)
+    {
+        size_t begin = iovcnt == 0 ? readIndex_ : 0;
+        size_t end = static_cast<size_t>(iovcnt) + 1 == blocks_.size() ? writeIndex_ : kBlockSize;
+        size_t len = std::min(end - begin, maxBytes - bytes);
+        vec[iovcnt].iov_base = blocks_[iovcnt] + begin;
+        vec[iovcnt].iov_len = len;
+        bytes += len;
+        ++iovcnt;
+    }
+    const ssize_t n = SocketFuncs::writev(fd, vec, iovcnt);
+    if (n < 0)
+        *savedErrno = errno;
+    else
+        retrieve(static_cast<size_t>(n));
+    return n;
+}
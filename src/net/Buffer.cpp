@@ -6,9 +6,84 @@
 
 using namespace Hohnor;
 
+const size_t Buffer::kSizeClasses;
+const size_t Buffer::kMaxPooledBytes;
+
+namespace
+{
+    //Buffers may outlive the free list of their thread, e.g. when a static one is destroyed at exit
+    thread_local bool t_poolDestroyed = false;
+
+    struct StoragePool
+    {
+        ~StoragePool() { t_poolDestroyed = true; }
+        std::vector<std::vector<char>> classes[Buffer::kSizeClasses];
+        size_t bytes = 0;
+    };
+    thread_local StoragePool t_pool;
+
+    size_t classSize(size_t sizeClass)
+    {
+        return (kCheapPrepend + kInitialSize) << (2 * sizeClass);
+    }
+} // namespace
+
+size_t Buffer::pooledBytes()
+{
+    return t_poolDestroyed ? 0 : t_pool.bytes;
+}
+
+std::vector<char> Buffer::acquireStorage(size_t size)
+{
+    for (size_t i = 0; i < kSizeClasses; ++i)
+    {
+        if (size <= classSize(i))
+        {
+            std::vector<char> storage;
+            if (!t_poolDestroyed && !t_pool.classes[i].empty())
+            {
+                storage.swap(t_pool.classes[i].back());
+                t_pool.classes[i].pop_back();
+                t_pool.bytes -= storage.size();
+            }
+            else
+            {
+                storage.resize(classSize(i));
+            }
+            return storage;
+        }
+    }
+    return std::vector<char>(size);
+}
+
+void Buffer::releaseStorage(std::vector<char>& storage)
+{
+    for (size_t i = 0; i < kSizeClasses && !t_poolDestroyed; ++i)
+    {
+        if (storage.size() == classSize(i))
+        {
+            std::vector<std::vector<char>> &free = t_pool.classes[i];
+            if ((free.size() + 1) * storage.size() <= kMaxPooledBytes)
+            {
+                t_pool.bytes += storage.size();
+                free.emplace_back();
+                free.back().swap(storage);
+                return;
+            }
+            break;
+        }
+    }
+    std::vector<char>().swap(storage);
+}
+
 //Refered to https://github.com/chenshuo/muduo/blob/master/muduo/net/Buffer.cc
 ssize_t Buffer::readFd(int fd, int* savedErrno)
 {
+    // A released buffer reads into pooled storage rather than copying all from extrabuf
+    if (buffer_.empty())
+    {
+        ensureWritable(kInitialSize);
+    }
     // saved an ioctl()/FIONREAD call to tell how much to read
     char extrabuf[65536];
     struct iovec vec[2];
@@ -34,6 +109,12 @@ ssize_t Buffer::readFd(int fd, int* savedErrno)
         writerIndex_ = buffer_.size();
         append(extrabuf, n - writable);
     }
+    //Readers such as TCPConnection::readUntil() search only the bytes of the latest read and the
+    //delimiter.size() - 1 bytes before them
+    if (n >= 0)
+    {
+        lastWriteBytes_ = static_cast<size_t>(n);
+    }
     // if (n == writable + sizeof extrabuf)
     // {
     //   goto line_30;
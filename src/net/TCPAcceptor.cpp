@@ -21,12 +21,50 @@ void TCPAcceptor::setAcceptCallback(AcceptCallback cb)
         auto self = weakSelf.lock();
         if (self)
         {
+            if (self->loopSelector_)
+            {
+                self->acceptToSelectedLoop(cb);
+                return;
+            }
             auto handler = self->accept();
             cb(TCPConnection::create(handler));
         }
     });
 }
 
+void TCPAcceptor::setLoopSelector(LoopSelector selector)
+{
+    auto self = shared_from_this();
+    this->loop()->runInLoop([self, selector]() {
+        self->loopSelector_ = std::move(selector);
+    });
+}
+
+void TCPAcceptor::acceptToSelectedLoop(const AcceptCallback &cb)
+{
+    int acceptedFd = SocketFuncs::accept(this->fd(), NULL);
+    if (acceptedFd < 0)
+    {
+        return;
+    }
+    EventLoopPtr ioLoop = loopSelector_();
+    if (!ioLoop)
+    {
+        ioLoop = this->loop();
+    }
+    //The handler takes the fd's ownership here, so the fd is closed even if the functor never runs
+    IOHandlerPtr handler = ioLoop->handleIO(acceptedFd);
+    if (!handler)
+    {
+        LOG_ERROR << "Selected loop refused accepted fd " << acceptedFd;
+        SocketFuncs::close(acceptedFd);
+        return;
+    }
+    ioLoop->runInLoop([handler, cb]() {
+        cb(TCPConnection::create(handler));
+    });
+}
+
 IOHandlerPtr TCPAcceptor::accept()
 {
     IOHandlerPtr handler = nullptr;
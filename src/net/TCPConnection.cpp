@@ -7,6 +7,9 @@
 #include "hohnor/common/Buffer.h"
 #include "hohnor/time/Timestamp.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netinet/tcp.h>
 
@@ -15,9 +18,19 @@ using namespace Hohnor;
 TCPConnection::TCPConnection(IOHandlerPtr handler)
     : Socket(handler, handler->loop()),
       writing_(false),
-      readBuffer_(),
-      writeBuffer_(),
+      edgeTriggered_(false),
+      eventBudget_(kDefaultEventBudget),
+      readBuffer_(0),
+      writeBuffer_(0),
+      outputBuffer_(),
+      fileSegments_(),
+      bytesAfterSegments_(0),
+      outbound_(),
+      outboundScheduled_(false),
+      flushing_(),
+      flushingParts_(),
       highWaterMark_(64*1024*1024), // 64MB default high water mark
+      idleEntry_(),
       highWaterMarkCallback_(),
       readCompleteCallback_(),
       writeCompleteCallback_(),
@@ -43,7 +56,8 @@ TCPConnection::~TCPConnection()
     LOG_DEBUG << "TCPConnection::dtor at " << this
               << " fd=" << getSocketHandler()->fd();
 
-    if (getSocketHandler() && (!getSocketHandler()->isEnabled())) {
+    // Pending interest updates may keep the handler past the connection, its callbacks must not reach this
+    if (getSocketHandler() && getSocketHandler()->isEnabled()) {
         getSocketHandler()->disable();
     }
 }
@@ -74,20 +88,15 @@ void TCPConnection::setWriteCompleteCallback(const WriteCompleteCallback& cb)
     });
 }
 
-void TCPConnection::setCloseCallback(const CloseCallback& cb)
+void TCPConnection::setCloseCallback(CloseCallback cb)
 {
-    auto sharedThis = shared_from_this();
-    loop()->runInLoop([sharedThis, cb]() {
-        sharedThis->closeCallback_ = cb;
-    });
+    // Callbacks are move-only, bind carries cb into the loop
+    loop()->runInLoop(std::bind(&TCPConnection::setCloseCallbackInLoop, shared_from_this(), std::move(cb)));
 }
 
-void TCPConnection::setErrorCallback(const ErrorCallback& cb)
+void TCPConnection::setErrorCallback(ErrorCallback cb)
 {
-    auto sharedThis = shared_from_this();
-    loop()->runInLoop([sharedThis, cb]() {
-        sharedThis->errorCallback_ = cb;
-    });
+    loop()->runInLoop(std::bind(&TCPConnection::setErrorCallbackInLoop, shared_from_this(), std::move(cb)));
 }
 
 // --- Read Operations ---
@@ -106,8 +115,11 @@ void TCPConnection::readRaw()
 void TCPConnection::readUntil(const std::string& delimiter)
 {
     ReadStopCondition condition = [delimiter](Buffer& buffer) -> bool {
-        const char* found = std::search<const char *, const char *>( (buffer.beginWrite() - buffer.lastWriteBytes()), 
-                                                                    buffer.beginWrite(), delimiter.c_str(), 
+        // The delimiter may have begun in the bytes of an earlier read
+        size_t searched = std::min(buffer.readableBytes(),
+                                   static_cast<size_t>(buffer.lastWriteBytes()) + delimiter.size() - 1);
+        const char* found = std::search<const char *, const char *>( (buffer.beginWrite() - searched),
+                                                                    buffer.beginWrite(), delimiter.c_str(),
                                                                     (delimiter.c_str() + delimiter.size()));
         return found != buffer.beginWrite();
     };
@@ -143,17 +155,14 @@ void TCPConnection::write(const void* data, int len)
 
 void TCPConnection::write(const StringPiece message)
 {
-    auto sharedThis = shared_from_this();
-    loop()->runInLoop([sharedThis, message]() {
-        if (sharedThis->isClosed()) {
-            LOG_ERROR << "TCPConnection::write called on a closed connection";
-            return;
-        }
-        sharedThis->writeInLoop(message);
-    });
-    if(UNLIKELY(!Socket::isEnabled())) {
-        // If the socket is not enabled, we need to enable it
-        enable();
+    if (isInLoopThread()) {
+        writeFromLoop(&message, 1);
+    }
+    else {
+        // The caller may reuse the bytes once this returns
+        OutboundMessage outbound;
+        outbound.owned.assign(message.data(), message.size());
+        queueOutbound(std::move(outbound));
     }
 }
 
@@ -170,6 +179,62 @@ void TCPConnection::write(Buffer* buffer)
     }
 }
 
+void TCPConnection::write(std::string&& message)
+{
+    if (isInLoopThread()) {
+        StringPiece bytes(message);
+        writeFromLoop(&bytes, 1);
+    }
+    else {
+        OutboundMessage outbound;
+        outbound.owned.swap(message);
+        queueOutbound(std::move(outbound));
+    }
+}
+
+void TCPConnection::write(Buffer&& buffer)
+{
+    if (isInLoopThread()) {
+        StringPiece bytes(buffer.readableSlice());
+        writeFromLoop(&bytes, 1);
+        buffer.retrieveAll();
+    }
+    else if (buffer.readableBytes() > 0) {
+        // The caller is left with a released buffer
+        OutboundMessage outbound;
+        outbound.buffer.reset(new Buffer(std::move(buffer)));
+        queueOutbound(std::move(outbound));
+    }
+}
+
+void TCPConnection::write(const std::shared_ptr<const std::string>& message)
+{
+    if (isInLoopThread()) {
+        StringPiece bytes(*message);
+        writeFromLoop(&bytes, 1);
+    }
+    else {
+        OutboundMessage outbound;
+        outbound.shared = message;
+        queueOutbound(std::move(outbound));
+    }
+}
+
+void TCPConnection::writev(const StringPiece* parts, size_t n)
+{
+    if (isInLoopThread()) {
+        writeFromLoop(parts, n);
+    }
+    else {
+        // The parts may be gone by the time the loop runs
+        OutboundMessage outbound;
+        for (size_t i = 0; i < n; ++i) {
+            outbound.owned.append(parts[i].data(), parts[i].size());
+        }
+        queueOutbound(std::move(outbound));
+    }
+}
+
 void TCPConnection::write()
 {
     auto sharedThis = shared_from_this();
@@ -178,7 +243,14 @@ void TCPConnection::write()
             LOG_ERROR << "TCPConnection::write called on a closed connection";
             return;
         }
-        sharedThis->getSocketHandler()->setWriteEvent(true);
+        // Writes queued from other threads before this call go first
+        sharedThis->writeOutbound(true);
+        Buffer &staged = sharedThis->writeBuffer_;
+        if (staged.readableBytes() > 0) {
+            sharedThis->writeInLoop(staged.readableSlice());
+            staged.retrieveAll();
+        }
+        staged.release();
     });
     if(UNLIKELY(!Socket::isEnabled())) {
         // If the socket is not enabled, we need to enable it
@@ -186,11 +258,41 @@ void TCPConnection::write()
     }
 }
 
+void TCPConnection::sendFile(int fd, off_t offset, size_t length)
+{
+    std::shared_ptr<FdGuard> file(new FdGuard(::fcntl(fd, F_DUPFD_CLOEXEC, 0)));
+    if (file->fd() < 0) {
+        LOG_SYSERR << "TCPConnection::sendFile failed to dup fd [" << fd << "]";
+        return;
+    }
+    if (isInLoopThread()) {
+        if (isClosed()) {
+            LOG_ERROR << "TCPConnection::sendFile called on a closed connection";
+            return;
+        }
+        sendFileInLoop(file, offset, length);
+        if(UNLIKELY(!Socket::isEnabled())) {
+            // If the socket is not enabled, we need to enable it
+            enable();
+        }
+    }
+    else {
+        // Queued with the writes of other threads, so it keeps its place among them
+        OutboundMessage outbound;
+        outbound.file = file;
+        outbound.offset = offset;
+        outbound.length = length;
+        queueOutbound(std::move(outbound));
+    }
+}
+
 // --- Connection Management ---
 void TCPConnection::shutdown()
 {
     auto sharedThis = shared_from_this();
     loop()->runInLoop([sharedThis]() {
+        // Writes queued from other threads before this call go first, a flush batch may not have taken them yet
+        sharedThis->writeOutbound(true);
         SocketFuncs::shutdownWrite(sharedThis->fd());
     });
 }
@@ -203,6 +305,7 @@ void TCPConnection::forceClose()
             LOG_ERROR << "TCPConnection::forceClose called on a closed connection";
             return;
         }
+        sharedThis->writeOutbound(true);
         sharedThis->disable();
         // sharedThis->Socket::resetSocketHandler();
     });
@@ -213,7 +316,50 @@ void TCPConnection::forceCloseWithDelay(double seconds)
     auto sharedThis = shared_from_this();
     loop()->addTimer([sharedThis]() {
         sharedThis->forceClose();
-    }, addTime(Timestamp::now(), seconds));
+    }, addTime(loop()->now(), seconds));
+}
+
+void TCPConnection::setIdleTimeout(double seconds)
+{
+    auto sharedThis = shared_from_this();
+    loop()->runInLoop([sharedThis, seconds]() {
+        sharedThis->setIdleTimeoutInLoop(seconds);
+    });
+}
+
+void TCPConnection::setIdleTimeoutInLoop(double seconds)
+{
+    if (seconds <= 0) {
+        // The reaper drops its reference when it meets it
+        idleEntry_.reset();
+        return;
+    }
+    if (isClosed()) {
+        LOG_ERROR << "TCPConnection::setIdleTimeout called on a closed connection";
+        return;
+    }
+    IdleReaper *reaper = loop()->idleReaper();
+    if (!reaper) {
+        return;
+    }
+    if (!idleEntry_) {
+        auto weakThis = std::weak_ptr<TCPConnection>(shared_from_this());
+        idleEntry_ = std::make_shared<IdleReaper::Entry>([weakThis]() {
+            auto sharedThis = weakThis.lock();
+            if (sharedThis && !sharedThis->isClosed()) {
+                LOG_DEBUG << "TCPConnection fd [" << sharedThis->fd() << "] idle timeout";
+                sharedThis->handleClose();
+            }
+        });
+    }
+    reaper->add(idleEntry_, seconds);
+}
+
+void TCPConnection::touch()
+{
+    if (idleEntry_) {
+        idleEntry_->touch(loop()->now());
+    }
 }
 
 // --- Flow Control ---
@@ -231,6 +377,47 @@ void TCPConnection::setTCPNoDelay(bool on)
 
 }
 
+void TCPConnection::setBusyPoll(int usec)
+{
+    auto sharedThis = shared_from_this();
+    loop()->runInLoop([sharedThis, usec]() {
+        if (sharedThis->isClosed()) {
+            LOG_ERROR << "TCPConnection::setBusyPoll called on a closed connection";
+            return;
+        }
+#ifdef SO_BUSY_POLL
+        int optval = usec;
+        if (::setsockopt(sharedThis->fd(), SOL_SOCKET, SO_BUSY_POLL, &optval, static_cast<socklen_t>(sizeof optval)) != 0) {
+            LOG_SYSERR << "TCPConnection::setBusyPoll error";
+        }
+#else
+        LOG_ERROR << "SO_BUSY_POLL is not supported.";
+#endif
+    });
+}
+
+void TCPConnection::setEdgeTriggered(bool on)
+{
+    auto sharedThis = shared_from_this();
+    loop()->runInLoop([sharedThis, on]() {
+        if (sharedThis->isClosed()) {
+            LOG_ERROR << "TCPConnection::setEdgeTriggered called on a closed connection";
+            return;
+        }
+        sharedThis->edgeTriggered_ = on;
+        sharedThis->getSocketHandler()->setEdgeTriggered(on);
+    });
+}
+
+void TCPConnection::setEventBudget(size_t bytes)
+{
+    HCHECK(bytes > 0) << "Event budget must be positive";
+    auto sharedThis = shared_from_this();
+    loop()->runInLoop([sharedThis, bytes]() {
+        sharedThis->eventBudget_ = bytes;
+    });
+}
+
 // --- TCP Info ---
 struct tcp_info TCPConnection::getTCPInfo() const
 {
@@ -254,29 +441,18 @@ std::string TCPConnection::getTCPInfoStr() const
 void TCPConnection::handleRead()
 {
     loop()->assertInLoopThread();
+    touch();
+
+    if (edgeTriggered_) {
+        drainRead();
+        return;
+    }
     
     int savedErrno = 0;
     ssize_t n = readBuffer_.readFd(this->fd(), &savedErrno);
     
     if (n > 0) {
-        LOG_TRACE << "TCPConnection::handleRead fd [" << fd() << "] read " << n << " bytes to " << getTCPInfoStr();
-
-        // Check if we should stop reading based on the current read mode
-        if(isReadingUntilCondition() && readStopCondition_(readBuffer_)) //Reading until condition && condition meets
-        {
-            if (readCompleteCallback_) {
-                readCompleteCallback_(shared_from_this());
-            }
-        } else if (!isReadingUntilCondition()) {//Reading raw, directly get into callback
-            if (readCompleteCallback_) {
-                readCompleteCallback_(shared_from_this());
-            }
-        }
-        
-        // Shrink buffer if it's getting too large and empty
-        if (readBuffer_.readableBytes() == 0 && readBuffer_.capacity() > 1024*1024) {
-            readBuffer_.shrink(0);
-        }
+        handleReadBytes(n);
     }
     else if (n == 0) {
         LOG_DEBUG << "TCPConnection::handleRead fd [" << fd() << "] connection closed by peer to " << getTCPInfoStr();
@@ -297,32 +473,96 @@ void TCPConnection::handleWrite()
         LOG_WARN << "TCPConnection::handleWrite fd [" << fd() << "] not writing to " << getTCPInfoStr();
         return;
     }
+    touch();
+    flushWrite();
+}
 
-    ssize_t n = ::write(fd(), writeBuffer_.peek(), writeBuffer_.readableBytes());
-    if (n > 0) {
-        writeBuffer_.retrieve(n);
-        LOG_TRACE << "TCPConnection::handleWrite fd [" << fd() << "] wrote " << n << " bytes to " << getTCPInfoStr();
-
-        if (writeBuffer_.readableBytes() == 0) {
-            // All data written
-            setWriteEvent(false);
-            writing_ = false;
-            
-            if (writeCompleteCallback_) {
-                //Must put into queue, otherwise it may be called immediately and cause re-entrancy issues and oveerflow
-                loop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+void TCPConnection::flushWrite()
+{
+    // A continuation may find everything flushed by an edge in between
+    if (!writing_) {
+        return;
+    }
+
+    // Level-triggered writes once per event, edge-triggered flushes until EAGAIN or the budget is used up
+    size_t written = 0;
+    while (hasOutput()) {
+        if (edgeTriggered_ && written >= eventBudget_) {
+            continueInLoop(&TCPConnection::flushWrite);
+            return;
+        }
+        int savedErrno = 0;
+        ssize_t n;
+        if (!fileSegments_.empty() && fileSegments_.front().bytesBefore == 0) {
+            n = sendFileSegment(&savedErrno);
+            if (n == 0) {
+                // The file ended early, the segment was dropped
+                continue;
             }
-            
-            // Shrink write buffer if it's getting too large and empty
-            if (writeBuffer_.capacity() > 1024*1024) {
-                writeBuffer_.shrink(0);
+        }
+        else {
+            // Buffered bytes up to the next file segment
+            size_t limit = fileSegments_.empty() ? SIZE_MAX : fileSegments_.front().bytesBefore;
+            n = outputBuffer_.writeFd(fd(), &savedErrno, limit);
+            if (n > 0 && !fileSegments_.empty()) {
+                fileSegments_.front().bytesBefore -= n;
             }
         }
+        if (n > 0) {
+            written += n;
+            LOG_TRACE << "TCPConnection::handleWrite fd [" << fd() << "] wrote " << n << " bytes to " << getTCPInfoStr();
+            if (!edgeTriggered_) {
+                break;
+            }
+        }
+        else if (edgeTriggered_ && n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)) {
+            // Next EPOLLOUT edge continues
+            return;
+        }
+        else {
+            LOG_ERROR << "TCPConnection::handleWrite fd [" << fd() << "] error: " << strerror_tl(savedErrno) << getTCPInfoStr();
+            errno = savedErrno;
+            handleError();
+            return;
+        }
+    }
+
+    if (!hasOutput()) {
+        // All data and files written, the blocks went back as they were written
+        setWriteEvent(false);
+        writing_ = false;
+        
+        if (writeCompleteCallback_) {
+            //Must put into queue, otherwise it may be called immediately and cause re-entrancy issues and oveerflow
+            loop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+    }
+}
+
+ssize_t TCPConnection::sendFileSegment(int* savedErrno)
+{
+    FileSegment &segment = fileSegments_.front();
+    assert(segment.bytesBefore == 0);
+    ssize_t n = SocketFuncs::sendfile(fd(), segment.file->fd(), &segment.offset, segment.remaining);
+    if (n < 0) {
+        *savedErrno = errno;
+        return n;
+    }
+    if (n == 0) {
+        LOG_ERROR << "TCPConnection::sendFile fd [" << fd() << "] file ended " << segment.remaining
+                  << " bytes early, the rest is skipped";
+        segment.remaining = 0;
     }
     else {
-        LOG_ERROR << "TCPConnection::handleWrite fd [" << fd() << "] error: " << strerror_tl(errno) << getTCPInfoStr();
-        handleError();
+        segment.remaining -= n;
+    }
+    if (segment.remaining == 0) {
+        fileSegments_.pop_front();
+        if (fileSegments_.empty()) {
+            bytesAfterSegments_ = 0;
+        }
     }
+    return n;
 }
 
 void TCPConnection::handleClose()
@@ -330,6 +570,7 @@ void TCPConnection::handleClose()
     loop()->assertInLoopThread();
 
     LOG_DEBUG << "TCPConnection::handleClose fd [" << fd() << "] to "<< getTCPInfoStr();
+    idleEntry_.reset();
 
     // Disable the handler to stop receiving events, but close usually comes with error,
     // So we let the disable() happen in queued function to avoid potential race conditions
@@ -344,8 +585,9 @@ void TCPConnection::handleClose()
         });
     }
     
-    // Call the close callback if set
+    // Call the close callback if set, the user may drop the connection in it, so hold it until we return
     if (closeCallback_) {
+        TCPConnectionPtr guardThis = shared_from_this();
         closeCallback_();
     }
 }
@@ -364,19 +606,102 @@ void TCPConnection::handleError()
 }
 
 // --- Internal Helper Methods ---
+void TCPConnection::handleReadBytes(ssize_t n)
+{
+    LOG_TRACE << "TCPConnection::handleRead fd [" << fd() << "] read " << n << " bytes to " << getTCPInfoStr();
+
+    // Check if we should stop reading based on the current read mode
+    if(isReadingUntilCondition() && readStopCondition_(readBuffer_)) //Reading until condition && condition meets
+    {
+        if (readCompleteCallback_) {
+            readCompleteCallback_(shared_from_this());
+        }
+    } else if (!isReadingUntilCondition()) {//Reading raw, directly get into callback
+        if (readCompleteCallback_) {
+            readCompleteCallback_(shared_from_this());
+        }
+    }
+    
+    // Drained, the storage goes back to the pool of the loop until the next read
+    readBuffer_.release();
+}
+
+void TCPConnection::drainRead()
+{
+    // User callbacks may close or drop the connection while we are draining
+    TCPConnectionPtr guardThis = shared_from_this();
+    size_t total = 0;
+    while (!isClosed() && getSocketHandler()->isEnabled()) {
+        if (total >= eventBudget_) {
+            continueInLoop(&TCPConnection::drainRead);
+            return;
+        }
+        int savedErrno = 0;
+        ssize_t n = readBuffer_.readFd(this->fd(), &savedErrno);
+        if (n > 0) {
+            total += n;
+            handleReadBytes(n);
+        }
+        else if (n == 0) {
+            LOG_DEBUG << "TCPConnection::drainRead fd [" << fd() << "] connection closed by peer to " << getTCPInfoStr();
+            handleClose();
+            return;
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+            // Drained, next EPOLLIN edge continues
+            return;
+        }
+        else if (savedErrno != EINTR) {
+            LOG_ERROR << "TCPConnection::drainRead fd [" << fd() << "] error: " << strerror_tl(savedErrno) << getTCPInfoStr();
+            errno = savedErrno;
+            handleError();
+            return;
+        }
+    }
+}
+
+void TCPConnection::continueInLoop(void (TCPConnection::*handler)())
+{
+    std::weak_ptr<TCPConnection> weakThis(shared_from_this());
+    loop()->queueInLoop([weakThis, handler]() {
+        auto sharedThis = weakThis.lock();
+        if (sharedThis && !sharedThis->isClosed() && sharedThis->getSocketHandler()->isEnabled()) {
+            ((*sharedThis).*handler)();
+        }
+    });
+}
+
 void TCPConnection::writeInLoop(const StringPiece& message)
+{
+    writevInLoop(&message, 1);
+}
+
+void TCPConnection::writevInLoop(const StringPiece* parts, size_t n)
 {
     loop()->assertInLoopThread();
     
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        total += parts[i].size();
+    }
     ssize_t nwrote = 0;
-    size_t remaining = message.size();
+    size_t remaining = total;
     bool faultError = false;
     
     // If no data in output queue, try writing directly
-    if (!writing_ && writeBuffer_.readableBytes() == 0) {
-        nwrote = ::write(fd(), message.data(), message.size());
+    if (!writing_ && !hasOutput()) {
+        struct iovec vec[IOV_MAX];
+        int iovcnt = 0;
+        for (size_t i = 0; i < n && iovcnt < IOV_MAX; ++i) {
+            if (parts[i].size() > 0) {
+                vec[iovcnt].iov_base = const_cast<char*>(parts[i].data());
+                vec[iovcnt].iov_len = parts[i].size();
+                ++iovcnt;
+            }
+        }
+        nwrote = SocketFuncs::writev(fd(), vec, iovcnt);
         if (nwrote >= 0) {
-            remaining = message.size() - nwrote;
+            remaining = total - nwrote;
             if (remaining == 0 && writeCompleteCallback_) {
                 loop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
             }
@@ -396,14 +721,24 @@ void TCPConnection::writeInLoop(const StringPiece& message)
 
     // If we couldn't write all data, append the rest to output buffer
     if (!faultError && remaining > 0) {
-        size_t oldLen = writeBuffer_.readableBytes();
+        size_t oldLen = outputBuffer_.readableBytes();
         
         // Check high water mark
         if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_) {
             highWaterMarkCallback_(shared_from_this());
         }
         
-        writeBuffer_.append(message.data() + nwrote, remaining);
+        // Skip what was written, then copy the tail part by part
+        size_t skip = static_cast<size_t>(nwrote);
+        for (size_t i = 0; i < n; ++i) {
+            size_t size = parts[i].size();
+            if (skip >= size) {
+                skip -= size;
+                continue;
+            }
+            appendOutput(parts[i].data() + skip, size - skip);
+            skip = 0;
+        }
         if (!writing_) {
             setWriteEvent(true);
             writing_ = true;
@@ -416,6 +751,160 @@ void TCPConnection::writeInLoop(const void* data, size_t len)
     writeInLoop(StringPiece(static_cast<const char*>(data), len));
 }
 
+bool TCPConnection::isInLoopThread()
+{
+    return EventLoop::loopOfCurrentThread() == loop().get();
+}
+
+void TCPConnection::writeFromLoop(const StringPiece* parts, size_t n)
+{
+    if (isClosed()) {
+        LOG_ERROR << "TCPConnection::write called on a closed connection";
+        return;
+    }
+    writevInLoop(parts, n);
+    if(UNLIKELY(!Socket::isEnabled())) {
+        // If the socket is not enabled, we need to enable it
+        enable();
+    }
+}
+
+StringPiece TCPConnection::OutboundMessage::bytes() const
+{
+    if (shared) {
+        return StringPiece(*shared);
+    }
+    if (buffer) {
+        return buffer->readableSlice();
+    }
+    return StringPiece(owned);
+}
+
+void TCPConnection::queueOutbound(OutboundMessage&& message)
+{
+    outbound_.push(std::move(message));
+    // Only the first message since the last flush posts a functor
+    if (!outboundScheduled_.exchange(true, std::memory_order_acq_rel)) {
+        auto sharedThis = shared_from_this();
+        loop()->queueInLoop([sharedThis]() { sharedThis->flushOutbound(); });
+    }
+    if(UNLIKELY(!Socket::isEnabled())) {
+        // If the socket is not enabled, we need to enable it
+        enable();
+    }
+}
+
+void TCPConnection::flushOutbound()
+{
+    loop()->assertInLoopThread();
+    // A bounded batch keeps the messages hot in cache and lets other work of the loop run in between
+    writeOutbound(false);
+
+    // Stay scheduled while messages are left, a push this misses after clearing the flag schedules itself
+    if (outbound_.empty()) {
+        outboundScheduled_.exchange(false, std::memory_order_acq_rel);
+        if (outbound_.empty() || outboundScheduled_.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+    auto sharedThis = shared_from_this();
+    loop()->queueInLoop([sharedThis]() { sharedThis->flushOutbound(); });
+}
+
+void TCPConnection::writeOutbound(bool all)
+{
+    outbound_.popWhile([this, all](OutboundMessage &message) {
+        flushing_.push_back(std::move(message));
+        if (flushing_.size() < kOutboundBatch) {
+            return true;
+        }
+        if (all) {
+            writeFlushing();
+        }
+        return all;
+    });
+    writeFlushing();
+}
+
+void TCPConnection::writeFlushing()
+{
+    if (flushing_.empty()) {
+        return;
+    }
+    if (isClosed()) {
+        LOG_ERROR << "TCPConnection::flushOutbound dropped " << flushing_.size() << " writes to a closed connection";
+    }
+    else {
+        // Runs of bytes between file segments go out with one writev
+        for (OutboundMessage &message : flushing_) {
+            if (message.file) {
+                if (!flushingParts_.empty()) {
+                    writevInLoop(flushingParts_.data(), flushingParts_.size());
+                    flushingParts_.clear();
+                }
+                sendFileInLoop(message.file, message.offset, message.length);
+            }
+            else if (message.bytes().size() > 0) {
+                flushingParts_.push_back(message.bytes());
+            }
+        }
+        if (!flushingParts_.empty()) {
+            writevInLoop(flushingParts_.data(), flushingParts_.size());
+            flushingParts_.clear();
+        }
+    }
+    flushing_.clear();
+}
+
+void TCPConnection::appendOutput(const char* data, size_t len)
+{
+    outputBuffer_.append(data, len);
+    if (!fileSegments_.empty()) {
+        bytesAfterSegments_ += len;
+    }
+}
+
+void TCPConnection::sendFileInLoop(const std::shared_ptr<FdGuard>& file, off_t offset, size_t length)
+{
+    loop()->assertInLoopThread();
+
+    // Nothing ahead of it, try sending directly
+    if (!writing_ && !hasOutput() && length > 0) {
+        ssize_t n = SocketFuncs::sendfile(fd(), file->fd(), &offset, length);
+        if (n > 0) {
+            length -= n;
+        }
+        else if (n == 0) {
+            LOG_ERROR << "TCPConnection::sendFileInLoop fd [" << fd() << "] file ended " << length
+                      << " bytes early, the rest is skipped";
+            length = 0;
+        }
+        else if (errno != EWOULDBLOCK) {
+            LOG_ERROR << "TCPConnection::sendFileInLoop fd [" << fd() << "] sendfile error: " << strerror_tl(errno);
+            return;
+        }
+        if (length == 0 && writeCompleteCallback_) {
+            loop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+    }
+    if (length == 0) {
+        return;
+    }
+
+    // Queued behind the bytes appended since the previous segment, or everything buffered if it is the first
+    FileSegment segment;
+    segment.file = file;
+    segment.offset = offset;
+    segment.remaining = length;
+    segment.bytesBefore = fileSegments_.empty() ? outputBuffer_.readableBytes() : bytesAfterSegments_;
+    fileSegments_.push_back(std::move(segment));
+    bytesAfterSegments_ = 0;
+    if (!writing_) {
+        setWriteEvent(true);
+        writing_ = true;
+    }
+}
+
 void TCPConnection::setWriteEvent(bool on)
 {
     if (!isClosed()) {
@@ -261,7 +261,7 @@ void TCPConnector::retry()
             if (sharedThis->state_ == Disconnected) { // Only retry if still disconnected
                 sharedThis->connect(sharedThis->serverAddr_);
             }
-        }, addTime(Timestamp::now(), retryDelayMs_ / 1000.0));
+        }, addTime(loop()->now(), retryDelayMs_ / 1000.0));
 
         if (retryCallback_) {
             retryCallback_();
@@ -0,0 +1,79 @@
+#include "hohnor/net/TCPServer.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/log/Logging.h"
+
+using namespace Hohnor;
+
+TCPServer::TCPServer(EventLoopPtr loop, const InetAddress &listenAddr, const std::string &name)
+    : loop_(loop),
+      listenAddr_(listenAddr),
+      name_(name),
+      acceptor_(TCPAcceptor::create(loop, SOCK_STREAM, listenAddr.isIPv6())),
+      threadPool_(),
+      numLoops_(0),
+      distribution_(EventLoopThreadPool::RoundRobin),
+      threadInitCallback_(),
+      connectionCallback_(),
+      started_(false)
+{
+    HCHECK(loop_) << "EventLoop of TCPServer cannot be null";
+    acceptor_->setReuseAddr(true);
+    LOG_DEBUG << "TCPServer " << name_ << " created for " << listenAddr_.toIpPort();
+}
+
+TCPServer::~TCPServer()
+{
+    LOG_DEBUG << "TCPServer " << name_ << " destroying";
+    stop();
+}
+
+void TCPServer::start()
+{
+    if (started_.exchange(true))
+    {
+        LOG_WARN << "TCPServer " << name_ << " is already started";
+        return;
+    }
+    threadPool_.reset(new EventLoopThreadPool(loop_, name_ + "-Loop"));
+    threadPool_->setThreadInitCallback(threadInitCallback_);
+    threadPool_->start(numLoops_);
+
+    EventLoopThreadPool *pool = threadPool_.get();
+    EventLoopThreadPool::Distribution distribution = distribution_;
+    if (numLoops_ > 0)
+    {
+        //The pool lives as long as the server, and the acceptor is disabled before the pool is stopped
+        acceptor_->setLoopSelector([pool, distribution]() {
+            return pool->getLoop(distribution);
+        });
+    }
+    ConnectionCallback cb = connectionCallback_;
+    acceptor_->setAcceptCallback([cb](TCPConnectionPtr conn) {
+        if (cb)
+        {
+            cb(conn);
+        }
+    });
+    acceptor_->bindAddress(listenAddr_);
+    acceptor_->listen();
+    LOG_DEBUG << "TCPServer " << name_ << " listening on " << listenAddr_.toIpPort()
+              << " with " << numLoops_ << " IO loops";
+}
+
+void TCPServer::stop()
+{
+    if (!started_)
+        return;
+    if (acceptor_ && acceptor_->isListening())
+    {
+        acceptor_->disable();
+    }
+    if (acceptor_ && numLoops_ > 0)
+    {
+        acceptor_->setLoopSelector(nullptr);
+    }
+    if (threadPool_)
+    {
+        threadPool_->stop();
+    }
+}
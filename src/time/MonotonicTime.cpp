@@ -0,0 +1,98 @@
+#include "hohnor/time/MonotonicTime.h"
+#include <time.h>
+#include <stdio.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <atomic>
+
+using namespace Hohnor;
+
+static_assert(sizeof(MonotonicTime) == sizeof(int64_t),
+			  "MonotonicTime should be same size as int64_t");
+
+namespace
+{
+	MonotonicTime readClock(clockid_t clock)
+	{
+		struct timespec ts;
+		clock_gettime(clock, &ts);
+		return MonotonicTime(static_cast<int64_t>(ts.tv_sec) * MonotonicTime::kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+	}
+
+	//Offset between the clocks changes only when the wall clock is stepped, reads further apart than this are
+	//too noisy to tell a step
+	const int64_t kWallClockStepUs = 100;
+	const int64_t kUnsetOffset = INT64_MIN;
+	std::atomic<int64_t> s_wallMinusMonotonic(kUnsetOffset);
+
+	//Wall clock minus monotonic clock, never more than the actual offset so conversions from wall clock are
+	//never early. It is cached and changes only when the wall clock is stepped, so equal times convert to
+	//equal results and keep their order
+	int64_t wallMinusMonotonic()
+	{
+		//Wall clock between two monotonic reads, the try least likely to be preempted in the middle is taken.
+		//The actual offset is in [wall - after, wall - before]
+		int64_t offset = 0;
+		int64_t gap = INT64_MAX;
+		for (int i = 0; i < 4 && gap > 2; ++i)
+		{
+			int64_t before = MonotonicTime::now().microSeconds();
+			int64_t wall = Timestamp::now().microSecondsSinceEpoch();
+			int64_t after = MonotonicTime::now().microSeconds();
+			if (after - before < gap)
+			{
+				gap = after - before;
+				offset = wall - after;
+			}
+		}
+		int64_t cached = s_wallMinusMonotonic.load(std::memory_order_relaxed);
+		if (cached == kUnsetOffset)
+		{
+			s_wallMinusMonotonic.store(offset, std::memory_order_relaxed);
+			return offset;
+		}
+		if (gap > kWallClockStepUs)
+			return cached;
+		//Stepped forward, or backward beyond the error of this read, microseconds are truncated
+		if (offset - cached > kWallClockStepUs || cached > offset + gap + 1)
+		{
+			s_wallMinusMonotonic.store(offset, std::memory_order_relaxed);
+			return offset;
+		}
+		return cached;
+	}
+} // namespace
+
+string MonotonicTime::toString() const
+{
+	char buf[32] = {0};
+	int64_t seconds = microSeconds_ / kMicroSecondsPerSecond;
+	int64_t microseconds = microSeconds_ % kMicroSecondsPerSecond;
+	snprintf(buf, sizeof(buf), "%" PRId64 ".%06" PRId64 "", seconds, microseconds);
+	return buf;
+}
+
+MonotonicTime MonotonicTime::now()
+{
+	return readClock(CLOCK_MONOTONIC);
+}
+
+MonotonicTime MonotonicTime::nowCoarse()
+{
+	return readClock(CLOCK_MONOTONIC_COARSE);
+}
+
+MonotonicTime MonotonicTime::fromTimestamp(Timestamp when)
+{
+	return MonotonicTime(when.microSecondsSinceEpoch() - wallMinusMonotonic());
+}
+
+Timestamp MonotonicTime::toTimestamp() const
+{
+	return Timestamp(microSeconds_ + wallMinusMonotonic());
+}
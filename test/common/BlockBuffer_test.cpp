@@ -0,0 +1,124 @@
+#include "hohnor/common/BlockBuffer.h"
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+using namespace Hohnor;
+
+namespace
+{
+    std::string pattern(size_t len)
+    {
+        std::string s(len, '\0');
+        for (size_t i = 0; i < len; ++i)
+            s[i] = static_cast<char>('a' + i % 26);
+        return s;
+    }
+} // namespace
+
+TEST(BlockBufferTest, AppendAndRetrieveAcrossBlocks) {
+    const size_t kBlock = BlockBuffer::kBlockSize;
+    BlockBuffer buffer;
+    EXPECT_EQ(buffer.readableBytes(), 0u);
+    EXPECT_EQ(buffer.front().size(), 0);
+
+    std::string data = pattern(kBlock * 2 + 100);
+    buffer.append(data.data(), 10);
+    buffer.append(data.substr(10));
+    EXPECT_EQ(buffer.readableBytes(), data.size());
+    EXPECT_EQ(buffer.numBlocks(), 3u);
+    EXPECT_EQ(buffer.front().size(), static_cast<int>(kBlock));
+
+    // Within the front block, then across the boundary
+    buffer.retrieve(100);
+    EXPECT_EQ(buffer.front().size(), static_cast<int>(kBlock - 100));
+    EXPECT_EQ(buffer.front()[0], data[100]);
+    buffer.retrieve(kBlock);
+    EXPECT_EQ(buffer.numBlocks(), 2u);
+    EXPECT_EQ(buffer.front()[0], data[kBlock + 100]);
+    EXPECT_EQ(buffer.retrieveAllAsString(), data.substr(kBlock + 100));
+    EXPECT_EQ(buffer.readableBytes(), 0u);
+    EXPECT_EQ(buffer.numBlocks(), 0u);
+}
+
+TEST(BlockBufferTest, BlocksAreReused) {
+    {
+        BlockBuffer buffer;
+        buffer.append(pattern(BlockBuffer::kBlockSize * 3));
+    }
+    size_t pooled = BlockBuffer::pooledBlocks();
+    EXPECT_GE(pooled, 3u);
+    BlockBuffer buffer;
+    buffer.append(pattern(BlockBuffer::kBlockSize * 2));
+    EXPECT_EQ(BlockBuffer::pooledBlocks(), pooled - 2);
+    buffer.retrieve(BlockBuffer::kBlockSize);
+    EXPECT_EQ(BlockBuffer::pooledBlocks(), pooled - 1);
+}
+
+TEST(BlockBufferTest, WriteFd) {
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    ::fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+    std::string data = pattern(BlockBuffer::kBlockSize * 5 + 123);
+
+    BlockBuffer out;
+    out.append(data.data(), 7);
+    out.retrieve(7);
+    out.append(data);
+    int savedErrno = 0;
+    // One writev of every block
+    ASSERT_EQ(out.writeFd(fds[1], &savedErrno), static_cast<ssize_t>(data.size()));
+    EXPECT_EQ(out.readableBytes(), 0u);
+    EXPECT_EQ(out.writeFd(fds[1], &savedErrno), 0);
+
+    std::string received(data.size(), '\0');
+    ASSERT_EQ(::read(fds[0], &received[0], received.size()), static_cast<ssize_t>(data.size()));
+    EXPECT_EQ(received, data);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST(BlockBufferTest, PartialWrite) {
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    int capacity = ::fcntl(fds[1], F_GETPIPE_SZ);
+    ASSERT_GT(capacity, 0);
+    std::string data = pattern(static_cast<size_t>(capacity) * 2);
+
+    BlockBuffer out;
+    out.append(data);
+    int savedErrno = 0;
+    ssize_t n = out.writeFd(fds[1], &savedErrno);
+    ASSERT_GT(n, 0);
+    EXPECT_LT(static_cast<size_t>(n), data.size());
+    EXPECT_EQ(out.readableBytes(), data.size() - n);
+    EXPECT_EQ(out.writeFd(fds[1], &savedErrno), -1);
+    EXPECT_EQ(savedErrno, EAGAIN);
+    EXPECT_EQ(out.readableBytes(), data.size() - n);
+    EXPECT_EQ(out.retrieveAllAsString(), data.substr(n));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST(BlockBufferTest, WriteAtMostMaxBytes) {
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    std::string data = pattern(BlockBuffer::kBlockSize * 2 + 10);
+
+    BlockBuffer out;
+    out.append(data);
+    int savedErrno = 0;
+    EXPECT_EQ(out.writeFd(fds[1], &savedErrno, 0), 0);
+    // Ends inside the second block
+    const size_t limit = BlockBuffer::kBlockSize + 5;
+    ASSERT_EQ(out.writeFd(fds[1], &savedErrno, limit), static_cast<ssize_t>(limit));
+    EXPECT_EQ(out.readableBytes(), data.size() - limit);
+    EXPECT_EQ(out.front()[0], data[limit]);
+
+    std::string received(limit, '\0');
+    ASSERT_EQ(::read(fds[0], &received[0], limit), static_cast<ssize_t>(limit));
+    EXPECT_EQ(received, data.substr(0, limit));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
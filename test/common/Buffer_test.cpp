@@ -0,0 +1,116 @@
+#include "hohnor/common/Buffer.h"
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+using namespace Hohnor;
+
+namespace
+{
+    std::string pattern(size_t len)
+    {
+        std::string s(len, '\0');
+        for (size_t i = 0; i < len; ++i)
+            s[i] = static_cast<char>('a' + i % 26);
+        return s;
+    }
+} // namespace
+
+TEST(BufferTest, ReleasedBufferTakesStorageOnWrite) {
+    Buffer buffer(0);
+    EXPECT_EQ(buffer.capacity(), 0u);
+    EXPECT_EQ(buffer.readableBytes(), 0u);
+    EXPECT_EQ(buffer.writableBytes(), 0u);
+    buffer.retrieveAll();
+    EXPECT_EQ(buffer.writableBytes(), 0u);
+
+    buffer.append("hello", 5);
+    EXPECT_EQ(buffer.retrieveAllAsString(), "hello");
+    EXPECT_EQ(buffer.prependableBytes(), kCheapPrepend);
+    EXPECT_GE(buffer.writableBytes(), kInitialSize);
+    buffer.release();
+    EXPECT_EQ(buffer.capacity(), 0u);
+
+    // Not released while bytes are readable
+    buffer.append("x", 1);
+    buffer.release();
+    EXPECT_EQ(buffer.retrieveAllAsString(), "x");
+}
+
+// A header prepended to a buffer without storage, such as the staging buffer of a connection, goes in the cheap
+// prepend of storage taken for it
+TEST(BufferTest, PrependToReleasedBuffer) {
+    Buffer buffer;
+    buffer.release();
+    EXPECT_EQ(buffer.prependableBytes(), 0u);
+    buffer.prepend("1234", 4);
+    EXPECT_EQ(buffer.prependableBytes(), kCheapPrepend - 4);
+    buffer.append("body", 4);
+    EXPECT_EQ(buffer.retrieveAllAsString(), "1234body");
+
+    Buffer empty(0);
+    empty.ensureWritable(0);
+    EXPECT_GE(empty.writableBytes(), kInitialSize);
+    EXPECT_EQ(empty.prependableBytes(), kCheapPrepend);
+    empty.prepend("12345678", kCheapPrepend);
+    EXPECT_EQ(empty.retrieveAllAsString(), "12345678");
+}
+
+TEST(BufferTest, StorageIsReused) {
+    {
+        Buffer buffer;
+    }
+    size_t pooled = Buffer::pooledBytes();
+    EXPECT_GE(pooled, kCheapPrepend + kInitialSize);
+    Buffer buffer;
+    EXPECT_EQ(Buffer::pooledBytes(), pooled - buffer.capacity());
+    buffer.release();
+    EXPECT_EQ(Buffer::pooledBytes(), pooled);
+}
+
+TEST(BufferTest, GrowAcrossClasses) {
+    Buffer buffer;
+    std::string data = pattern(2 * 1024 * 1024);
+    for (size_t i = 0; i < data.size(); i += 1000)
+        buffer.append(data.data() + i, std::min<size_t>(1000, data.size() - i));
+    EXPECT_EQ(buffer.readableBytes(), data.size());
+    buffer.prepend("12345678", kCheapPrepend);
+    EXPECT_EQ(buffer.retrieveAsString(kCheapPrepend), "12345678");
+
+    buffer.retrieve(data.size() - 10);
+    buffer.shrink(0);
+    EXPECT_EQ(buffer.capacity(), kCheapPrepend + kInitialSize);
+    EXPECT_EQ(buffer.retrieveAllAsString(), data.substr(data.size() - 10));
+    buffer.shrink(0);
+    EXPECT_EQ(buffer.capacity(), 0u);
+}
+
+TEST(BufferTest, MoveLeavesReleasedBuffer) {
+    Buffer buffer;
+    buffer.append("abc", 3);
+    Buffer moved(std::move(buffer));
+    EXPECT_EQ(buffer.capacity(), 0u);
+    EXPECT_EQ(buffer.readableBytes(), 0u);
+    EXPECT_EQ(moved.retrieveAllAsString(), "abc");
+
+    buffer.append("def", 3);
+    moved = std::move(buffer);
+    EXPECT_EQ(buffer.capacity(), 0u);
+    EXPECT_EQ(moved.retrieveAllAsString(), "def");
+}
+
+TEST(BufferTest, ReadFdIntoReleasedBuffer) {
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    std::string data = pattern(100);
+    ASSERT_EQ(::write(fds[1], data.data(), data.size()), static_cast<ssize_t>(data.size()));
+
+    Buffer buffer(0);
+    int savedErrno = 0;
+    EXPECT_EQ(buffer.readFd(fds[0], &savedErrno), static_cast<ssize_t>(data.size()));
+    EXPECT_EQ(buffer.capacity(), kCheapPrepend + kInitialSize);
+    EXPECT_EQ(buffer.retrieveAllAsString(), data);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
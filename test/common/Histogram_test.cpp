@@ -0,0 +1,90 @@
+#include "hohnor/common/Histogram.h"
+#include "hohnor/thread/Thread.h"
+#include <gtest/gtest.h>
+#include <atomic>
+
+using namespace Hohnor;
+
+TEST(HistogramTest, Buckets) {
+    EXPECT_EQ(Histogram::bucketOf(0), 0);
+    EXPECT_EQ(Histogram::bucketOf(1), 1);
+    EXPECT_EQ(Histogram::bucketOf(2), 2);
+    EXPECT_EQ(Histogram::bucketOf(3), 2);
+    EXPECT_EQ(Histogram::bucketOf(4), 3);
+    EXPECT_EQ(Histogram::bucketOf(1023), 10);
+    EXPECT_EQ(Histogram::bucketOf(1024), 11);
+    EXPECT_EQ(Histogram::bucketOf(UINT64_MAX), 64);
+    EXPECT_EQ(Histogram::bucketUpperBound(0), 0);
+    EXPECT_EQ(Histogram::bucketUpperBound(10), 1023);
+    EXPECT_EQ(Histogram::bucketUpperBound(64), UINT64_MAX);
+}
+
+TEST(HistogramTest, EmptySnapshot) {
+    Histogram h;
+    auto s = h.snapshot();
+    EXPECT_EQ(s.count, 0);
+    EXPECT_EQ(s.sum, 0);
+    EXPECT_EQ(s.max, 0);
+    EXPECT_EQ(s.mean(), 0.0);
+    EXPECT_EQ(s.percentile(99), 0);
+}
+
+TEST(HistogramTest, RecordAndPercentile) {
+    Histogram h;
+    // 90 small values and 10 large ones
+    for (int i = 0; i < 90; ++i)
+        h.record(10);
+    for (int i = 0; i < 10; ++i)
+        h.record(5000);
+    auto s = h.snapshot();
+    EXPECT_EQ(s.count, 100);
+    EXPECT_EQ(s.sum, 90 * 10 + 10 * 5000);
+    EXPECT_EQ(s.max, 5000);
+    EXPECT_DOUBLE_EQ(s.mean(), (90 * 10 + 10 * 5000) / 100.0);
+    // Upper bound of the bucket of 10 is 15
+    EXPECT_EQ(s.percentile(50), 15);
+    EXPECT_EQ(s.percentile(90), 15);
+    // Capped by max instead of the bucket bound 8191
+    EXPECT_EQ(s.percentile(99), 5000);
+    EXPECT_EQ(s.percentile(100), 5000);
+}
+
+TEST(HistogramTest, Since) {
+    Histogram h;
+    h.record(1);
+    h.record(100);
+    auto before = h.snapshot();
+    h.record(100);
+    h.record(7);
+    auto delta = h.snapshot().since(before);
+    EXPECT_EQ(delta.count, 2);
+    EXPECT_EQ(delta.sum, 107);
+    EXPECT_EQ(delta.buckets[Histogram::bucketOf(1)], 0);
+    EXPECT_EQ(delta.buckets[Histogram::bucketOf(100)], 1);
+    EXPECT_EQ(delta.buckets[Histogram::bucketOf(7)], 1);
+}
+
+// Readers on other threads never see more than what has been recorded
+TEST(HistogramTest, ConcurrentSnapshot) {
+    Histogram h;
+    const uint64_t kRecords = 200000;
+    std::atomic<bool> done(false);
+    std::atomic<bool> monotonic(true);
+    Thread reader([&]() {
+        uint64_t last = 0;
+        while (!done) {
+            auto s = h.snapshot();
+            if (s.count < last || s.count > kRecords)
+                monotonic = false;
+            last = s.count;
+        }
+    });
+    reader.start();
+    for (uint64_t i = 0; i < kRecords; ++i)
+        h.record(i);
+    done = true;
+    reader.join();
+    EXPECT_TRUE(monotonic.load());
+    EXPECT_EQ(h.snapshot().count, kRecords);
+    EXPECT_EQ(h.snapshot().max, kRecords - 1);
+}
@@ -0,0 +1,125 @@
+#include "hohnor/common/IndexedHeap.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Hohnor;
+
+namespace
+{
+    struct Item
+    {
+        explicit Item(int k) : key(k), index(static_cast<size_t>(-1)) {}
+        int key;
+        size_t index;
+    };
+    typedef std::shared_ptr<Item> ItemPtr;
+
+    struct ItemLessThan
+    {
+        bool operator()(const ItemPtr &lhs, const ItemPtr &rhs) const { return lhs->key < rhs->key; }
+    };
+    struct ItemSetIndex
+    {
+        void operator()(const ItemPtr &item, size_t index) const { item->index = index; }
+    };
+    typedef IndexedHeap<ItemPtr, ItemLessThan, ItemSetIndex> Heap;
+
+    void expectIndexes(const std::vector<ItemPtr> &items)
+    {
+        for (auto &item : items)
+            EXPECT_NE(item->index, Heap::npos);
+    }
+} // namespace
+
+TEST(IndexedHeapTest, PushPopInOrder)
+{
+    Heap heap;
+    EXPECT_TRUE(heap.empty());
+    const int keys[] = {5, 3, 8, 1, 9, 2, 7, 3};
+    for (int key : keys)
+        heap.push(std::make_shared<Item>(key));
+    EXPECT_EQ(heap.size(), 8);
+    std::vector<int> popped;
+    while (!heap.empty())
+    {
+        ItemPtr item = heap.pop();
+        EXPECT_EQ(item->index, Heap::npos);
+        popped.push_back(item->key);
+    }
+    EXPECT_EQ(popped, std::vector<int>({1, 2, 3, 3, 5, 7, 8, 9}));
+}
+
+TEST(IndexedHeapTest, RemoveAndUpdateByIndex)
+{
+    Heap heap;
+    std::vector<ItemPtr> items;
+    for (int i = 0; i < 20; ++i)
+    {
+        items.push_back(std::make_shared<Item>(i * 10));
+        heap.push(items.back());
+    }
+    expectIndexes(items);
+
+    // Remove the middle one, the last one and the top
+    EXPECT_EQ(heap.remove(items[10]->index), items[10]);
+    EXPECT_EQ(heap.remove(items[19]->index), items[19]);
+    EXPECT_EQ(heap.remove(items[0]->index), items[0]);
+    EXPECT_EQ(items[10]->index, Heap::npos);
+    EXPECT_EQ(heap.size(), 17);
+    EXPECT_EQ(heap.top(), items[1]);
+
+    // Move one to the top and one to the bottom
+    items[15]->key = -1;
+    heap.update(items[15]->index);
+    EXPECT_EQ(heap.top(), items[15]);
+    items[15]->key = 1000;
+    heap.update(items[15]->index);
+    EXPECT_EQ(heap.top(), items[1]);
+
+    std::vector<int> popped;
+    while (!heap.empty())
+        popped.push_back(heap.pop()->key);
+    EXPECT_TRUE(std::is_sorted(popped.begin(), popped.end()));
+    EXPECT_EQ(popped.back(), 1000);
+}
+
+// Random operations against a sorted reference
+TEST(IndexedHeapTest, RandomOperations)
+{
+    Heap heap;
+    std::vector<ItemPtr> live;
+    std::mt19937 rng(7);
+    for (int round = 0; round < 5000; ++round)
+    {
+        int op = static_cast<int>(rng() % 4);
+        if (op == 0 || live.empty())
+        {
+            live.push_back(std::make_shared<Item>(static_cast<int>(rng() % 1000)));
+            heap.push(live.back());
+        }
+        else if (op == 1)
+        {
+            size_t victim = rng() % live.size();
+            heap.remove(live[victim]->index);
+            live.erase(live.begin() + victim);
+        }
+        else if (op == 2)
+        {
+            ItemPtr item = live[rng() % live.size()];
+            item->key = static_cast<int>(rng() % 1000);
+            heap.update(item->index);
+        }
+        else
+        {
+            ItemPtr top = heap.pop();
+            for (auto &item : live)
+                EXPECT_LE(top->key, item->key);
+            live.erase(std::find(live.begin(), live.end(), top));
+        }
+        ASSERT_EQ(heap.size(), live.size());
+    }
+    expectIndexes(live);
+}
@@ -0,0 +1,126 @@
+#include "hohnor/common/InlineFunction.h"
+#include <gtest/gtest.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+using namespace Hohnor;
+
+namespace
+{
+    int g_calls = 0;
+    void freeFunction() { ++g_calls; }
+
+    // Counts live copies to check callables are destroyed exactly once
+    struct Tracked
+    {
+        explicit Tracked(int *alive) : alive_(alive) { ++*alive_; }
+        Tracked(const Tracked &other) : alive_(other.alive_) { ++*alive_; }
+        Tracked(Tracked &&other) noexcept : alive_(other.alive_) { ++*alive_; }
+        ~Tracked() { --*alive_; }
+        void operator()() {}
+        int *alive_;
+    };
+}
+
+TEST(InlineFunctionTest, Empty) {
+    InlineFunction<void()> f;
+    EXPECT_FALSE(f);
+    EXPECT_TRUE(f == nullptr);
+    EXPECT_FALSE(nullptr != f);
+    EXPECT_THROW(f(), std::bad_function_call);
+
+    InlineFunction<void()> g(nullptr);
+    EXPECT_FALSE(g);
+
+    // Null function pointers and empty std::functions give empty ones, as std::function does
+    void (*nullFunction)() = nullptr;
+    InlineFunction<void()> h(nullFunction);
+    EXPECT_FALSE(h);
+    InlineFunction<void()> i(std::function<void()>{});
+    EXPECT_FALSE(i);
+}
+
+TEST(InlineFunctionTest, CallAndReturn) {
+    int base = 40;
+    InlineFunction<int(int)> add([base](int x) { return base + x; });
+    ASSERT_TRUE(add);
+    EXPECT_TRUE(add != nullptr);
+    EXPECT_EQ(add(2), 42);
+
+    g_calls = 0;
+    InlineFunction<void()> f(freeFunction);
+    f();
+    f = &freeFunction;
+    f();
+    EXPECT_EQ(g_calls, 2);
+
+    InlineFunction<void(char)> keys;
+    std::string seen;
+    keys = [&seen](char c) { seen.push_back(c); };
+    keys('o');
+    keys('k');
+    EXPECT_EQ(seen, "ok");
+}
+
+TEST(InlineFunctionTest, MoveOnlyCapture) {
+    std::unique_ptr<int> value(new int(7));
+    int result = 0;
+    InlineFunction<void()> f(std::bind([&result](std::unique_ptr<int> &p) { result = *p; }, std::move(value)));
+    InlineFunction<void()> g(std::move(f));
+    EXPECT_FALSE(f);
+    g();
+    EXPECT_EQ(result, 7);
+}
+
+TEST(InlineFunctionTest, InlineOrHeap) {
+    auto sp = std::make_shared<int>(1);
+    auto small = [sp]() {};
+    auto sp2 = sp;
+    auto twoPointers = [sp, sp2]() {};
+    char big[128] = {};
+    auto large = [big]() { (void)big; };
+    EXPECT_EQ(sizeof(InlineFunction<void()>), 64u);
+    EXPECT_TRUE(InlineFunction<void()>::storedInline<decltype(small)>());
+    EXPECT_TRUE(InlineFunction<void()>::storedInline<decltype(twoPointers)>());
+    EXPECT_FALSE(InlineFunction<void()>::storedInline<decltype(large)>());
+
+    // Both kinds keep working through moves
+    int calls = 0;
+    InlineFunction<void()> a([&calls, big]() { (void)big; ++calls; });
+    InlineFunction<void()> b([&calls, sp]() { ++calls; });
+    InlineFunction<void()> c(std::move(a));
+    InlineFunction<void()> d;
+    d = std::move(b);
+    c();
+    d();
+    c.swap(d);
+    c();
+    d();
+    EXPECT_EQ(calls, 4);
+}
+
+TEST(InlineFunctionTest, Lifetime) {
+    int alive = 0;
+    {
+        InlineFunction<void()> f{Tracked(&alive)};
+        EXPECT_EQ(alive, 1);
+        InlineFunction<void()> g(std::move(f));
+        EXPECT_EQ(alive, 1);
+        g = nullptr;
+        EXPECT_EQ(alive, 0);
+        g = Tracked(&alive);
+        EXPECT_EQ(alive, 1);
+    }
+    EXPECT_EQ(alive, 0);
+
+    // Captured resources are released with the function
+    auto sp = std::make_shared<int>(1);
+    {
+        InlineFunction<void()> f([sp]() {});
+        EXPECT_EQ(sp.use_count(), 2);
+        f = [sp]() {};
+        EXPECT_EQ(sp.use_count(), 2);
+    }
+    EXPECT_EQ(sp.use_count(), 1);
+}
@@ -0,0 +1,128 @@
+#include "hohnor/core/EventLoopThreadPool.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/thread/CurrentThread.h"
+#include "hohnor/thread/CountDownLatch.h"
+#include "hohnor/log/Logging.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <set>
+#include <sys/eventfd.h>
+
+using namespace Hohnor;
+
+class EventLoopThreadPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Logger::setGlobalLogLevel(Logger::LogLevel::DEBUG);
+    }
+};
+
+TEST_F(EventLoopThreadPoolTest, EventLoopThreadRunsInOwnThread) {
+    EventLoopThread thread;
+    auto loop = thread.startLoop();
+    ASSERT_NE(loop, nullptr);
+    EXPECT_EQ(thread.loop(), loop);
+
+    std::atomic<pid_t> loopTid{0};
+    CountDownLatch latch(1);
+    loop->runInLoop([&loopTid, &latch, loop]() {
+        loopTid = CurrentThread::tid();
+        EXPECT_EQ(EventLoop::loopOfCurrentThread(), loop.get());
+        latch.countDown();
+    });
+    latch.wait();
+    EXPECT_NE(loopTid.load(), CurrentThread::tid());
+
+    thread.stopLoop();
+    EXPECT_EQ(loop->state(), EventLoop::End);
+    // Stopping twice is harmless
+    thread.stopLoop();
+}
+
+TEST_F(EventLoopThreadPoolTest, ThreadInitCallback) {
+    std::atomic<int> inits{0};
+    EventLoopThread thread([&inits](EventLoopPtr loop) {
+        EXPECT_NE(loop, nullptr);
+        inits++;
+    });
+    thread.startLoop();
+    EXPECT_EQ(inits.load(), 1);
+}
+
+TEST_F(EventLoopThreadPoolTest, EmptyPoolFallsBackToBaseLoop) {
+    auto base = EventLoop::create();
+    EventLoopThreadPool pool(base);
+    pool.start(0);
+    EXPECT_EQ(pool.size(), 0);
+    EXPECT_EQ(pool.getNextLoop(), base);
+    EXPECT_EQ(pool.getLeastLoadedLoop(), base);
+    ASSERT_EQ(pool.getAllLoops().size(), 1);
+    EXPECT_EQ(pool.getAllLoops()[0], base);
+}
+
+TEST_F(EventLoopThreadPoolTest, RoundRobin) {
+    auto base = EventLoop::create();
+    EventLoopThreadPool pool(base, "RR");
+    pool.start(3);
+    ASSERT_EQ(pool.size(), 3);
+
+    auto loops = pool.getAllLoops();
+    std::set<EventLoop *> distinct;
+    for (auto &loop : loops) {
+        EXPECT_NE(loop, base);
+        distinct.insert(loop.get());
+    }
+    EXPECT_EQ(distinct.size(), 3);
+
+    for (int round = 0; round < 2; ++round) {
+        for (size_t i = 0; i < loops.size(); ++i) {
+            EXPECT_EQ(pool.getLoop(EventLoopThreadPool::RoundRobin), loops[i]);
+        }
+    }
+    pool.stop();
+    for (auto &loop : loops) {
+        EXPECT_EQ(loop->state(), EventLoop::End);
+    }
+}
+
+TEST_F(EventLoopThreadPoolTest, LeastConnections) {
+    auto base = EventLoop::create();
+    EventLoopThreadPool pool(base, "LC");
+    pool.start(2);
+    auto loops = pool.getAllLoops();
+    ASSERT_EQ(loops.size(), 2);
+
+    // Load the first loop with extra handlers, the second one must be chosen
+    std::vector<IOHandlerPtr> handlers;
+    for (int i = 0; i < 3; ++i) {
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ASSERT_GT(fd, 0);
+        handlers.push_back(loops[0]->handleIO(fd));
+    }
+    EXPECT_EQ(loops[0]->ioHandlerCount(), loops[1]->ioHandlerCount() + 3);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(pool.getLoop(EventLoopThreadPool::LeastConnections), loops[1]);
+    }
+
+    handlers.clear();
+    EXPECT_EQ(loops[0]->ioHandlerCount(), loops[1]->ioHandlerCount());
+}
+
+TEST_F(EventLoopThreadPoolTest, DestroyLoopFromAnotherLoopThread) {
+    auto base = EventLoop::create();
+    std::atomic<bool> checked{false};
+    std::unique_ptr<EventLoopThread> thread(new EventLoopThread());
+    std::weak_ptr<EventLoop> pooled = thread->startLoop();
+    base->queueInLoop([&thread, &checked, &pooled, base]() {
+        // Destroying a pooled loop in this thread must not clear this thread's loop
+        thread.reset();
+        EXPECT_TRUE(pooled.expired());
+        EXPECT_EQ(EventLoop::loopOfCurrentThread(), base.get());
+        checked = true;
+        base->endLoop();
+    });
+    base->loop();
+    EXPECT_TRUE(checked.load());
+}
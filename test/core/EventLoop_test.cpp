@@ -6,8 +6,11 @@
 #include <gtest/gtest.h>
 #include <atomic>
 #include <memory>
+#include <vector>
 #include <sys/eventfd.h>
 #include <unistd.h>
+#include <thread>
+#include <sys/socket.h>
 
 using namespace Hohnor;
 
@@ -223,6 +226,52 @@ TEST_F(EventLoopTest, PollReturnTime) {
     EXPECT_GE(after_loop_time.microSecondsSinceEpoch(), initial_time.microSecondsSinceEpoch());
 }
 
+// now() is read once per iteration in the loop thread, other threads read the clock
+TEST_F(EventLoopTest, CachedNow) {
+    auto loop = EventLoop::create();
+    MonotonicTime first, second, outside;
+    loop->runInLoop([&]() {
+        first = loop->now();
+        usleep(2000);
+        second = loop->now();
+        outside = MonotonicTime::now();
+        loop->endLoop();
+    });
+    loop->loop();
+    EXPECT_TRUE(first.valid());
+    EXPECT_EQ(first, second);
+    EXPECT_GE(timeDifference(outside, first), 0.002);
+    // Not the loop thread
+    MonotonicTime other;
+    std::thread reader([&]() { other = loop->now(); });
+    reader.join();
+    EXPECT_GE(other, outside);
+}
+
+TEST_F(EventLoopTest, CoarseNow) {
+    EventLoop::Options options;
+    options.coarseClock = true;
+    auto loop = EventLoop::create(options);
+    MonotonicTime cached;
+    int fired = 0;
+    loop->runInLoop([&]() {
+        cached = loop->now();
+        // Timers fire on time with a coarse loop clock
+        for (int i = 1; i <= 5; ++i) {
+            MonotonicTime when = addTime(MonotonicTime::now(), i * 0.002);
+            loop->addTimer([&, when]() {
+                EXPECT_GE(MonotonicTime::now(), when);
+                if (++fired == 5)
+                    loop->endLoop();
+            }, when);
+        }
+    });
+    loop->loop();
+    EXPECT_EQ(fired, 5);
+    EXPECT_TRUE(cached.valid());
+    EXPECT_NEAR(timeDifference(MonotonicTime::now(), cached), 0.0, 0.1);
+}
+
 TEST_F(EventLoopTest, MultipleCallbacksInQueue) {
     auto loop = EventLoop::create();
     std::vector<int> execution_order;
@@ -248,6 +297,379 @@ TEST_F(EventLoopTest, MultipleCallbacksInQueue) {
     }
 }
 
+TEST_F(EventLoopTest, QueueInLoopFromManyThreads) {
+    auto loop = EventLoop::create();
+    const int kThreads = 4;
+    const int kPostsPerThread = 20000;
+    std::atomic<int> executed{0};
+    std::atomic<int> finished{0};
+
+    std::vector<std::unique_ptr<Thread>> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back(new Thread([loop, &executed, &finished, kPostsPerThread]() {
+            for (int i = 0; i < kPostsPerThread; ++i) {
+                loop->queueInLoop([&executed]() {
+                    executed++;
+                });
+            }
+            finished++;
+            // The last producer ends the loop after all posts are queued
+            if (finished.load() == kThreads) {
+                loop->queueInLoop([loop]() {
+                    loop->endLoop();
+                });
+            }
+        }));
+        threads.back()->start();
+    }
+
+    loop->loop();
+    for (auto &t : threads) {
+        t->join();
+    }
+    EXPECT_EQ(executed.load(), kThreads * kPostsPerThread);
+}
+
+TEST_F(EventLoopTest, QueueInLoopFromPendingRunsNextIteration) {
+    auto loop = EventLoop::create();
+    int64_t firstIteration = -1;
+    int64_t secondIteration = -1;
+    loop->queueInLoop([loop, &firstIteration, &secondIteration]() {
+        firstIteration = loop->iteration();
+        // Queued while draining pending functors, must wake the loop up and run in a later iteration
+        loop->queueInLoop([loop, &secondIteration]() {
+            secondIteration = loop->iteration();
+            loop->endLoop();
+        });
+    });
+    loop->loop();
+    EXPECT_GT(secondIteration, firstIteration);
+}
+
+TEST_F(EventLoopTest, ThreadConfinedLoop) {
+    EventLoop::Options options;
+    options.threadConfined = true;
+    auto loop = EventLoop::create(options);
+    // No wake up eventfd
+    EXPECT_EQ(loop->ioHandlerCount() + 1, EventLoop::create()->ioHandlerCount());
+
+    // Functors posted by the loop to itself run without a wake up, from pending, IO and idle phases alike
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int chain = 0;
+    std::function<void()> next = [&]() {
+        if (++chain < 100) {
+            loop->queueInLoop(next);
+            return;
+        }
+        // The IO phase next, once the chain is done however long the loop thread was held up
+        uint64_t one = 1;
+        ::write(fd, &one, sizeof one);
+    };
+    loop->queueInLoop(next);
+
+    auto handler = loop->handleIO(fd);
+    bool fromIO = false, fromIdle = false;
+    handler->setReadCallback([&]() {
+        uint64_t value;
+        ::read(fd, &value, sizeof value);
+        loop->queueInLoop([&]() {
+            fromIO = true;
+            loop->runWhenIdle([&]() {
+                loop->queueInLoop([&]() {
+                    fromIdle = true;
+                    loop->endLoop();
+                });
+            });
+        });
+    });
+    handler->enable();
+    // Fails the test instead of hanging if a post is missed
+    loop->addTimer([&]() { loop->endLoop(); }, addTime(loop->now(), 5.0));
+
+    MonotonicTime start = MonotonicTime::now();
+    loop->loop();
+    EXPECT_EQ(chain, 100);
+    EXPECT_TRUE(fromIO);
+    EXPECT_TRUE(fromIdle);
+    EXPECT_LT(timeDifference(MonotonicTime::now(), start), 1.0);
+    EXPECT_EQ(loop->state(), EventLoop::End);
+}
+
+#ifndef NDEBUG
+TEST_F(EventLoopTest, ThreadConfinedLoopUsedFromAnotherThread) {
+    EXPECT_DEATH({
+        EventLoop::Options options;
+        options.threadConfined = true;
+        auto loop = EventLoop::create(options);
+        std::thread other([loop]() { loop->queueInLoop([]() {}); });
+        other.join();
+    }, ".*");
+}
+#endif
+
+TEST_F(EventLoopTest, BusyPoll) {
+    auto loop = EventLoop::create();
+    EXPECT_EQ(loop->busyPoll(), 0);
+    loop->setBusyPoll(200 * 1000); // 200ms, long enough for the post below to arrive while spinning
+    std::atomic<bool> executed{false};
+
+    // First iteration handles the wakeup of this post, then spins
+    loop->queueInLoop([]() {});
+    Thread t([loop, &executed]() {
+        CurrentThread::sleepUsec(20 * 1000); // 20ms
+        loop->runInLoop([loop, &executed]() {
+            executed = true;
+            loop->endLoop();
+        });
+    });
+    t.start();
+    loop->loop();
+    t.join();
+
+    EXPECT_TRUE(executed.load());
+    auto stats = loop->pollStats();
+    EXPECT_GE(stats.busyPollHits, 1);
+    EXPECT_GT(stats.busyPolls, stats.busyPollHits);
+    EXPECT_GE(stats.events, 2);
+    EXPECT_GT(stats.eventsSize, 0);
+}
+
+// Same loop on io_uring: wakeups from other threads, timers and IO all go through the ring
+TEST_F(EventLoopTest, IOUringBackend) {
+    EventLoop::Options options;
+    options.backend = PollerBackend::IOUring;
+    auto loop = EventLoop::create(options);
+    EXPECT_EQ(loop->options().backend, PollerBackend::IOUring);
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    std::atomic<int> bytesRead{0};
+    std::atomic<bool> posted{false};
+    std::atomic<bool> timerFired{false};
+    auto handler = loop->handleIO(fds[0]);
+    handler->setReadCallback([&]() {
+        char buf[16];
+        ssize_t n = ::read(fds[0], buf, sizeof buf);
+        if (n > 0)
+            bytesRead += static_cast<int>(n);
+    });
+    handler->enable();
+    loop->addTimer([&]() { timerFired = true; }, addTime(Timestamp::now(), 0.01));
+
+    Thread t([&]() {
+        for (int i = 0; i < 3; ++i) {
+            CurrentThread::sleepUsec(10 * 1000);
+            loop->queueInLoop([&posted]() { posted = true; });
+            ASSERT_EQ(::write(fds[1], "x", 1), 1);
+        }
+        CurrentThread::sleepUsec(20 * 1000);
+        loop->runInLoop([&loop]() { loop->endLoop(); });
+    });
+    t.start();
+    loop->loop();
+    t.join();
+
+    EXPECT_EQ(bytesRead.load(), 3);
+    EXPECT_TRUE(posted.load());
+    EXPECT_TRUE(timerFired.load());
+    EXPECT_GT(loop->pollStats().syscalls, 0);
+    handler.reset();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_F(EventLoopTest, LoopStats) {
+    auto loop = EventLoop::create();
+    EXPECT_FALSE(loop->loopStatsEnabled());
+    loop->setLoopStats(true, 0.01);
+    EXPECT_TRUE(loop->loopStatsEnabled());
+
+    int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT_GE(evtfd, 0);
+    auto handler = loop->handleIO(evtfd);
+    int ticks = 0;
+    handler->setReadCallback([evtfd]() {
+        uint64_t value;
+        ASSERT_EQ(::read(evtfd, &value, sizeof value), sizeof value);
+        // The slow handler of this loop
+        CurrentThread::sleepUsec(3000);
+    });
+    handler->enable();
+    auto timer = loop->addTimer([&]() {
+        uint64_t value = 1;
+        ASSERT_EQ(::write(evtfd, &value, sizeof value), sizeof value);
+        for (int i = 0; i < 3; ++i)
+            loop->queueInLoop([]() {});
+        if (++ticks == 10)
+            loop->endLoop();
+    }, addTime(Timestamp::now(), 0.005), 0.005);
+    loop->loop();
+
+    auto stats = loop->loopStats();
+    EXPECT_GE(stats.waitNs.count, 10);
+    EXPECT_EQ(stats.waitNs.count, stats.ioNs.count);
+    EXPECT_EQ(stats.waitNs.count, stats.pendingNs.count);
+    EXPECT_EQ(stats.waitNs.count, stats.eventsPerWakeup.count);
+    EXPECT_EQ(stats.waitNs.count, stats.functorsPerDrain.count);
+    EXPECT_GE(stats.ioNs.max, 3000 * 1000);
+    EXPECT_GE(stats.functorsPerDrain.sum, 27);
+    EXPECT_GE(stats.eventsPerWakeup.sum, 20);
+    EXPECT_EQ(stats.slowestHandlerFd, evtfd);
+    EXPECT_GE(stats.slowestHandlerNs, 3000 * 1000);
+    EXPECT_LT(stats.slowestHandlerNs, 1000 * 1000 * 1000);
+
+    // Nothing is recorded when off
+    auto off = EventLoop::create();
+    off->queueInLoop([off]() { off->endLoop(); });
+    off->loop();
+    EXPECT_EQ(off->loopStats().waitNs.count, 0);
+    EXPECT_EQ(off->loopStats().slowestHandlerFd, -1);
+}
+
+// Handlers ready in the same poll destroy each other, the event of the destroyed one is dropped
+TEST_F(EventLoopTest, StaleEventsDropped) {
+    auto loop = EventLoop::create();
+    int fds[2][2];
+    IOHandlerPtr handlers[2];
+    int calls = 0;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]), 0);
+        handlers[i] = loop->handleIO(fds[i][0]);
+        handlers[i]->setReadCallback([&, i]() {
+            ++calls;
+            handlers[1 - i].reset();
+            loop->endLoop();
+        });
+        handlers[i]->enable();
+    }
+    // Both are readable before the loop polls
+    ASSERT_EQ(::write(fds[0][1], "x", 1), 1);
+    ASSERT_EQ(::write(fds[1][1], "x", 1), 1);
+    loop->loop();
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(loop->pollStats().staleEvents, 1);
+    EXPECT_EQ(loop->ioHandlerCount(), 1);
+    handlers[0].reset();
+    handlers[1].reset();
+    ::close(fds[0][1]);
+    ::close(fds[1][1]);
+}
+
+// Urgent work goes first, normal work is cut by the budget and background still gets a turn
+TEST_F(EventLoopTest, PendingBudgetAndPriority) {
+    auto loop = EventLoop::create();
+    loop->setPendingBudget(10);
+    std::string order;
+    int evtfd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT_GE(evtfd, 0);
+    auto handler = loop->handleIO(evtfd);
+    handler->setReadCallback([&]() {
+        uint64_t value;
+        ASSERT_EQ(::read(evtfd, &value, sizeof value), sizeof value);
+        order += 'i';
+    });
+    handler->enable();
+
+    for (int i = 0; i < 30; ++i)
+        loop->queueInLoop([&order]() { order += 'n'; });
+    loop->queueInLoop([loop]() { loop->endLoop(); });
+    loop->queueInLoop([&order]() { order += 'b'; }, EventLoop::Priority::Background);
+    loop->queueInLoop([&order]() { order += 'u'; }, EventLoop::Priority::Urgent);
+    loop->loop();
+
+    EXPECT_EQ(order, "iu" + std::string(10, 'n') + "b" + std::string(20, 'n'));
+    EXPECT_EQ(loop->pendingBudgetExhausted(), 3);
+    EXPECT_GE(loop->iteration(), 4);
+    handler.reset();
+}
+
+// Sliced tasks take turns and yield to IO between slices, each slice ends by its deadline
+TEST_F(EventLoopTest, SlicedTasks) {
+    auto loop = EventLoop::create();
+    loop->setIdleBudget(0.002);
+    std::string order;
+    int reads = 0;
+    bool tooLong = false;
+    int done = 0;
+    int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT_GE(evtfd, 0);
+    auto handler = loop->handleIO(evtfd);
+    handler->setReadCallback([&]() {
+        uint64_t value;
+        ASSERT_EQ(::read(evtfd, &value, sizeof value), sizeof value);
+        ++reads;
+    });
+    handler->enable();
+
+    auto makeTask = [&](char name, int slices) {
+        auto left = std::make_shared<int>(slices);
+        return [&, name, left](MonotonicTime deadline) {
+            order += name;
+            tooLong = tooLong || timeDifference(deadline, MonotonicTime::now()) > 0.002;
+            // Busy till the deadline, and make IO ready for the loop to serve meanwhile
+            while (MonotonicTime::now() < deadline) {
+            }
+            uint64_t one = 1;
+            EXPECT_EQ(::write(evtfd, &one, sizeof one), sizeof one);
+            if (--*left > 0)
+                return true;
+            if (++done == 2)
+                loop->endLoop();
+            return false;
+        };
+    };
+    loop->runSliced(makeTask('a', 3));
+    loop->runSliced(makeTask('b', 2));
+    loop->runWhenIdle([&]() { order += 'i'; });
+    loop->loop();
+
+    EXPECT_EQ(order, "iababa");
+    // Each slice but the last one left IO behind that was read before the next slice
+    EXPECT_GE(reads, 4);
+    EXPECT_FALSE(tooLong);
+    handler.reset();
+}
+
+// Idle work does not delay functors queued from other threads by more than the idle budget
+TEST_F(EventLoopTest, SlicedTaskYieldsToFunctors) {
+    auto loop = EventLoop::create();
+    loop->setIdleBudget(0.001);
+    std::atomic<bool> stop(false);
+    std::atomic<bool> posted(false);
+    std::atomic<int> slices(0);
+    std::atomic<int> slicesAfterPosted(0);
+    loop->runSliced([&](MonotonicTime deadline) {
+        ++slices;
+        if (posted)
+            ++slicesAfterPosted;
+        while (MonotonicTime::now() < deadline) {
+        }
+        return !stop.load();
+    });
+    int slicesWhenPosted = 0;
+    int slicesWhenRun = -1;
+    std::thread poster([&]() {
+        // Waits for slices rather than time, the loop thread may get little of the CPU
+        for (int i = 0; i < 5000 && slices.load() < 5; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        slicesWhenPosted = slices.load();
+        loop->queueInLoop([&]() {
+            slicesWhenRun = slicesAfterPosted.load();
+            stop = true;
+            loop->runWhenIdle([&]() { loop->endLoop(); });
+        });
+        posted = true;
+    });
+    loop->loop();
+    poster.join();
+    EXPECT_GE(slicesWhenPosted, 5);
+    // Counted from the loop, as the poster thread competes with the spinning task for the CPU and may be held up
+    // between its posting and the flag. The slice in progress ends, then the functor runs before the next one,
+    // one more if a slice began meanwhile
+    EXPECT_LE(slicesWhenRun, 1);
+}
+
 // ThreadPool functionality tests
 TEST_F(EventLoopTest, ThreadPoolInitialization) {
     auto loop = EventLoop::create();
@@ -743,4 +743,69 @@ TEST_F(IOHandlerTest, DestructorDisablesHandler) {
     while (!cleanup_verified.load()) {
         CurrentThread::sleepUsec(1000); // 1ms
     }
-}
\ No newline at end of file
+}
+TEST_F(IOHandlerTest, InterestUpdatesCollapsedPerIteration) {
+    auto handler = loop_->handleIO(test_fd_);
+    std::atomic<int> write_called{0};
+    uint64_t requestedBefore = 0;
+    uint64_t appliedBefore = 0;
+
+    handler->setReadCallback([]() {});
+    handler->setWriteCallback([&write_called]() { write_called++; });
+    handler->setWriteEvent(false);
+    handler->enable();
+
+    loop_->queueInLoop([&]() {
+        // The handler and the loop's own handlers have been added to epoll before the first poll
+        EXPECT_GE(loop_->interestUpdatesApplied(), 1);
+        requestedBefore = loop_->interestUpdatesRequested();
+        appliedBefore = loop_->interestUpdatesApplied();
+
+        // Toggle write interest many times, the net change is none
+        for (int i = 0; i < 100; ++i) {
+            handler->setWriteEvent(true);
+            handler->setWriteEvent(false);
+        }
+        // Disable and enable again ends up unchanged as well
+        handler->disable();
+        handler->setReadCallback([]() {});
+        handler->enable();
+
+        loop_->queueInLoop([&]() {
+            EXPECT_GT(loop_->interestUpdatesRequested(), requestedBefore + 200);
+            EXPECT_EQ(loop_->interestUpdatesApplied(), appliedBefore);
+            loop_->endLoop();
+        });
+    });
+    loop_->loop();
+
+    // eventfd is always writable, but write interest never reached epoll
+    EXPECT_EQ(write_called.load(), 0);
+}
+
+TEST_F(IOHandlerTest, EdgeTriggered) {
+    auto handler = loop_->handleIO(test_fd_);
+    std::atomic<int> read_called{0};
+    int ticks = 0;
+
+    // Never reads the eventfd, level-triggered would report it in every iteration
+    handler->setReadCallback([&read_called]() { read_called++; });
+    handler->setEdgeTriggered(true);
+    handler->enable();
+
+    uint64_t value = 1;
+    ASSERT_EQ(::write(test_fd_, &value, sizeof(value)), sizeof(value));
+
+    auto timer = loop_->addTimer([&]() {
+        if (++ticks == 10)
+            loop_->endLoop();
+    }, addTime(Timestamp::now(), 0.005), 0.005);
+    loop_->runInLoop([&]() {
+        EXPECT_TRUE(handler->isEdgeTriggered());
+        EXPECT_TRUE(handler->getEvents() & EPOLLET);
+    });
+    loop_->loop();
+
+    EXPECT_EQ(ticks, 10);
+    EXPECT_EQ(read_called.load(), 1);
+}
@@ -0,0 +1,149 @@
+#include "hohnor/core/IdleReaper.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace Hohnor;
+
+static EventLoopPtr createLoop(double idleTick) {
+    EventLoop::Options options;
+    options.idleTick = idleTick;
+    return EventLoop::create(options);
+}
+
+// Idle entries are reaped within a tick after their deadline, active ones are kept
+TEST(IdleReaperTest, ReapIdle) {
+    auto loop = createLoop(0.01);
+    MonotonicTime start, reapedAt;
+    bool activeReaped = false;
+    auto idle = std::make_shared<IdleReaper::Entry>([&]() { reapedAt = MonotonicTime::now(); });
+    auto active = std::make_shared<IdleReaper::Entry>([&]() { activeReaped = true; });
+    std::shared_ptr<TimerHandler> toucher;
+    loop->runInLoop([&]() {
+        start = loop->now();
+        loop->idleReaper()->add(idle, 0.05);
+        loop->idleReaper()->add(active, 0.05);
+        toucher = loop->addTimer([&]() { active->touch(loop->now()); }, addTime(start, 0.01), 0.01);
+        loop->addTimer([&]() { loop->endLoop(); }, addTime(start, 0.2));
+    });
+    loop->loop();
+    toucher->cancel();
+    ASSERT_TRUE(reapedAt.valid());
+    EXPECT_GE(timeDifference(reapedAt, start), 0.05);
+    EXPECT_LT(timeDifference(reapedAt, start), 0.1);
+    EXPECT_FALSE(activeReaped);
+}
+
+// Released entries are dropped without a call, and the reaper timer stops when nothing is left
+TEST(IdleReaperTest, ReleaseAndStop) {
+    auto loop = createLoop(0.005);
+    int reaped = 0;
+    size_t sizeAfter = 1;
+    loop->runInLoop([&]() {
+        IdleReaper *reaper = loop->idleReaper();
+        for (int i = 0; i < 10; ++i) {
+            auto entry = std::make_shared<IdleReaper::Entry>([&]() { ++reaped; });
+            reaper->add(entry, 0.01);
+        }
+        EXPECT_EQ(reaper->size(), 10u);
+        loop->addTimer([&]() {
+            sizeAfter = loop->idleReaper()->size();
+            loop->endLoop();
+        }, addTime(loop->now(), 0.05));
+    });
+    loop->loop();
+    EXPECT_EQ(reaped, 0);
+    EXPECT_EQ(sizeAfter, 0u);
+}
+
+// Adding a tracked entry again moves it to the new timeout
+TEST(IdleReaperTest, ChangeTimeout) {
+    auto loop = createLoop(0.005);
+    MonotonicTime start, reapedAt;
+    int calls = 0;
+    auto entry = std::make_shared<IdleReaper::Entry>([&]() {
+        reapedAt = MonotonicTime::now();
+        ++calls;
+    });
+    loop->runInLoop([&]() {
+        start = loop->now();
+        loop->idleReaper()->add(entry, 10.0);
+        loop->idleReaper()->add(entry, 0.02);
+        EXPECT_EQ(loop->idleReaper()->size(), 2u);
+        loop->addTimer([&]() { loop->endLoop(); }, addTime(start, 0.1));
+    });
+    loop->loop();
+    EXPECT_EQ(calls, 1);
+    EXPECT_GE(timeDifference(reapedAt, start), 0.02);
+    EXPECT_LT(timeDifference(reapedAt, start), 0.06);
+}
+
+// Many entries with timeouts growing the buckets while tracked, reaped in bulk
+TEST(IdleReaperTest, ManyEntries) {
+    auto loop = createLoop(0.001);
+    const int kEntries = 100000;
+    std::vector<IdleReaper::EntryPtr> entries;
+    int reaped = 0;
+    MonotonicTime start;
+    loop->runInLoop([&]() {
+        start = loop->now();
+        for (int i = 0; i < kEntries; ++i) {
+            entries.push_back(std::make_shared<IdleReaper::Entry>([&]() {
+                if (++reaped == kEntries)
+                    loop->endLoop();
+            }));
+            // Over 64 to 164 ticks, longer ones added later
+            loop->idleReaper()->add(entries.back(), 0.064 + (i * 100 / kEntries) * 0.001);
+        }
+    });
+    loop->loop();
+    EXPECT_EQ(reaped, kEntries);
+    EXPECT_GE(timeDifference(MonotonicTime::now(), start), 0.163);
+    EXPECT_EQ(loop->idleReaper(), nullptr);
+}
+
+// A stall leaves an entry a round ahead in a bucket being caught up, after one whose onIdle grows the buckets.
+// It is put back by its own tick, and reaped in time rather than a round of the grown buckets later
+TEST(IdleReaperTest, GrowFromOnIdle) {
+    auto loop = createLoop(0.001);
+    const int64_t kTickUs = 1000;
+    MonotonicTime start;
+    std::vector<IdleReaper::EntryPtr> entries;
+    IdleReaper::EntryPtr late, grown;
+    int64_t lateBucket = -1;
+    bool lateReaped = false;
+    loop->runInLoop([&]() {
+        start = loop->now();
+        // One in each bucket but the few past the longest timeout that keeps kMinBuckets
+        for (int64_t k = 1; k <= 61; ++k) {
+            entries.push_back(std::make_shared<IdleReaper::Entry>([&, k]() {
+                if (k != lateBucket)
+                    return;
+                grown = std::make_shared<IdleReaper::Entry>(Functor());
+                loop->idleReaper()->add(grown, 2.0);
+            }));
+            loop->idleReaper()->add(entries.back(), k * 0.001);
+        }
+        // Runs before the reaper catches up
+        loop->addTimer([&]() {
+            MonotonicTime now = loop->now();
+            int64_t tick = (now.microSeconds() - start.microSeconds()) / kTickUs + 10;
+            while ((tick & 63) == 0 || (tick & 63) > 61)
+                ++tick;
+            lateBucket = tick & 63;
+            late = std::make_shared<IdleReaper::Entry>([&]() {
+                lateReaped = true;
+                loop->endLoop();
+            });
+            loop->idleReaper()->add(late, (start.microSeconds() + tick * kTickUs - now.microSeconds()) / 1e6);
+            loop->addTimer([&]() { loop->endLoop(); }, addTime(now, 1.0));
+        }, start);
+        while (timeDifference(MonotonicTime::now(), start) < 0.1) {
+        }
+    });
+    loop->loop();
+    EXPECT_NE(grown, nullptr);
+    EXPECT_TRUE(lateReaped);
+}
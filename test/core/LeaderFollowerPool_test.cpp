@@ -0,0 +1,160 @@
+#include "hohnor/core/LeaderFollowerPool.h"
+#include "hohnor/thread/CountDownLatch.h"
+#include "hohnor/log/Logging.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Hohnor;
+
+namespace
+{
+    //Returns the end kept by the test, the other end is in fds[1]
+    int makePair(int fds[2])
+    {
+        int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+        EXPECT_EQ(ret, 0);
+        return fds[0];
+    }
+
+    bool isOpen(int fd)
+    {
+        return ::fcntl(fd, F_GETFD) != -1;
+    }
+} // namespace
+
+class LeaderFollowerPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Logger::setGlobalLogLevel(Logger::LogLevel::DEBUG);
+    }
+};
+
+TEST_F(LeaderFollowerPoolTest, CallbacksOfOneFdNeverOverlap) {
+    const int kPairs = 8;
+    const int kMessages = 200;
+    LeaderFollowerPool pool("LFTest");
+    pool.start(4);
+    EXPECT_EQ(pool.size(), 4u);
+
+    int peers[kPairs];
+    std::atomic<int> running[kPairs];
+    std::atomic<int> received{0};
+    std::atomic<bool> overlapped{false};
+    CountDownLatch latch(1);
+    for (int i = 0; i < kPairs; ++i)
+    {
+        int fds[2];
+        peers[i] = makePair(fds);
+        running[i] = 0;
+        int fd = fds[1];
+        ASSERT_EQ(pool.add(fd, EPOLLIN, [fd, i, &running, &received, &overlapped, &latch](uint32_t events) {
+            EXPECT_TRUE(events & EPOLLIN);
+            if (running[i].fetch_add(1) != 0)
+                overlapped = true;
+            char buf[64];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof buf)) > 0)
+            {
+                if (received.fetch_add(static_cast<int>(n)) + n == kPairs * kMessages)
+                    latch.countDown();
+            }
+            //Give other threads the chance to take a new event of this fd
+            std::this_thread::yield();
+            running[i].fetch_sub(1);
+        }), 0);
+    }
+    for (int m = 0; m < kMessages; ++m)
+        for (int i = 0; i < kPairs; ++i)
+            ASSERT_EQ(::write(peers[i], "x", 1), 1);
+    latch.wait();
+    EXPECT_EQ(received.load(), kPairs * kMessages);
+    EXPECT_FALSE(overlapped.load());
+
+    uint64_t total = 0;
+    for (uint64_t count : pool.dispatched())
+        total += count;
+    EXPECT_GT(total, 0u);
+    pool.stop();
+    for (int i = 0; i < kPairs; ++i)
+        ::close(peers[i]);
+}
+
+TEST_F(LeaderFollowerPoolTest, RemoveFromOwnCallback) {
+    LeaderFollowerPool pool;
+    pool.start(2);
+    int fds[2];
+    int peer = makePair(fds);
+    int fd = fds[1];
+    std::atomic<int> calls{0};
+    CountDownLatch latch(1);
+    ASSERT_EQ(pool.add(fd, EPOLLIN, [&pool, fd, &calls, &latch](uint32_t) {
+        ++calls;
+        EXPECT_EQ(pool.remove(fd), 0);
+        //Still open while the callback runs
+        EXPECT_TRUE(isOpen(fd));
+        latch.countDown();
+    }), 0);
+    ASSERT_EQ(::write(peer, "x", 1), 1);
+    latch.wait();
+    //Closed once the callback returned, and never called again
+    for (int i = 0; i < 100 && isOpen(fd); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_FALSE(isOpen(fd));
+    EXPECT_EQ(pool.remove(fd), -1);
+    ::send(peer, "x", 1, MSG_NOSIGNAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(calls.load(), 1);
+    pool.stop();
+    ::close(peer);
+}
+
+TEST_F(LeaderFollowerPoolTest, ModifyEvents) {
+    LeaderFollowerPool pool;
+    pool.start(2);
+    int fds[2];
+    int peer = makePair(fds);
+    int fd = fds[1];
+    std::atomic<uint32_t> seen{0};
+    CountDownLatch latch(1);
+    //Writable at once but not tracked until modified
+    ASSERT_EQ(pool.add(fd, EPOLLIN, [&pool, fd, &seen, &latch](uint32_t events) {
+        seen |= events;
+        if (events & EPOLLOUT)
+        {
+            pool.modify(fd, EPOLLIN);
+            latch.countDown();
+        }
+    }), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(seen.load(), 0u);
+    ASSERT_EQ(pool.modify(fd, EPOLLOUT), 0);
+    latch.wait();
+    EXPECT_TRUE(seen.load() & EPOLLOUT);
+    EXPECT_EQ(pool.modify(-1, EPOLLIN), -1);
+    pool.stop();
+    //Fds still added are closed with the pool
+    ::close(peer);
+}
+
+TEST_F(LeaderFollowerPoolTest, StopWithoutEvents) {
+    int fds[2];
+    int peer = makePair(fds);
+    int fd = fds[1];
+    {
+        LeaderFollowerPool pool;
+        pool.start(3);
+        ASSERT_EQ(pool.add(fd, EPOLLIN, [](uint32_t) {}), 0);
+        pool.stop();
+        //Stopping twice is harmless
+        pool.stop();
+        EXPECT_TRUE(isOpen(fd));
+    }
+    EXPECT_FALSE(isOpen(fd));
+    ::close(peer);
+}
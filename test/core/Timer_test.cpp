@@ -5,9 +5,11 @@
 #include "hohnor/time/Timestamp.h"
 #include "hohnor/log/Logging.h"
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <chrono>
+#include <thread>
 #include <vector>
 
 using namespace Hohnor;
@@ -44,16 +46,18 @@ protected:
 TEST_F(TimerTest, TimerHandlerBasicProperties) {
     Timestamp when = futureTime(1.0);
     double interval = 0.0; // Non-repeating timer
+    // Sequences are global, tests run before this one created timers too
+    int64_t sequence = TimerHandler::numCreated();
     
     auto timer = loop_->addTimer([this]() {
         timer_executed_ = true;
     }, when, interval);
     
     EXPECT_NE(timer, nullptr);
-    EXPECT_EQ(timer->sequence(), 0);
+    EXPECT_EQ(timer->sequence(), sequence);
     EXPECT_EQ(timer->getRepeatInterval(), 0.0);
     EXPECT_FALSE(timer->isRepeat());
-    EXPECT_GT(timer->expiration().microSecondsSinceEpoch(), Timestamp::now().microSecondsSinceEpoch());
+    EXPECT_GT(timer->expiration(), MonotonicTime::now());
 }
 
 TEST_F(TimerTest, TimerHandlerRepeatingTimer) {
@@ -570,4 +574,315 @@ TEST_F(TimerTest, TimestampUtilityFunctions) {
     
     double negative_diff = timeDifference(past, now);
     EXPECT_NEAR(negative_diff, -1.0, 0.001);
-}
\ No newline at end of file
+}
+static EventLoopPtr createWheelLoop(double tick) {
+    EventLoop::Options options;
+    options.timers = TimerBackend::Wheel;
+    options.timerTick = tick;
+    return EventLoop::create(options);
+}
+
+// Timers of a wheel fire in order of expiration, never before it
+TEST_F(TimerTest, WheelTimersFireInOrder) {
+    auto loop = createWheelLoop(0.001);
+    std::vector<int> order;
+    bool early = false;
+    const double delays[] = {0.05, 0.01, 0.03, 0.02, 0.04};
+    std::vector<std::shared_ptr<TimerHandler>> timers;
+    for (int i = 0; i < 5; ++i) {
+        Timestamp when = futureTime(delays[i]);
+        int id = static_cast<int>(delays[i] * 100);
+        timers.push_back(loop->addTimer([&, id, when]() {
+            order.push_back(id);
+            early = early || Timestamp::now() < when;
+            if (order.size() == 5)
+                loop->endLoop();
+        }, when));
+    }
+    loop->loop();
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3, 4, 5}));
+    EXPECT_FALSE(early);
+}
+
+// Cancelled timers leave the wheel at once and are released
+TEST_F(TimerTest, WheelRepeatAndCancel) {
+    auto loop = createWheelLoop(0.001);
+    int ticks = 0;
+    bool cancelledFired = false;
+    auto repeat = loop->addTimer([&]() { ++ticks; }, futureTime(0.005), 0.005);
+    auto near = loop->addTimer([&]() { cancelledFired = true; }, futureTime(0.02));
+    auto far = loop->addTimer([&]() { cancelledFired = true; }, futureTime(10.0));
+    loop->addTimer([&]() {
+        near->disable();
+        far->disable();
+    }, futureTime(0.01));
+    loop->addTimer([&]() {
+        repeat->disable();
+        loop->endLoop();
+    }, futureTime(0.05));
+    loop->loop();
+
+    EXPECT_GE(ticks, 3);
+    EXPECT_LE(ticks, 10);
+    EXPECT_FALSE(cancelledFired);
+    EXPECT_EQ(near.use_count(), 1);
+    EXPECT_EQ(far.use_count(), 1);
+    EXPECT_EQ(repeat.use_count(), 1);
+}
+
+// With a 1us tick, these timers start in the second and third level and cascade down
+TEST_F(TimerTest, WheelCascade) {
+    auto loop = createWheelLoop(0.000001);
+    std::vector<int> order;
+    double maxLateness = 0;
+    const double delays[] = {0.1, 0.005, 0.03};
+    for (int i = 0; i < 3; ++i) {
+        Timestamp when = futureTime(delays[i]);
+        loop->addTimer([&, i, when]() {
+            order.push_back(i);
+            maxLateness = std::max(maxLateness, timeDifference(Timestamp::now(), when));
+            if (order.size() == 3)
+                loop->endLoop();
+        }, when);
+    }
+    loop->loop();
+    EXPECT_EQ(order, std::vector<int>({1, 2, 0}));
+    EXPECT_GE(maxLateness, 0.0);
+    EXPECT_LT(maxLateness, 0.05);
+}
+
+// A repeating timer late by a stall of the loop runs once per wakeup until it caught up, not once per tick
+TEST_F(TimerTest, WheelLateRepeatCatchesUp) {
+    auto loop = createWheelLoop(0.001);
+    const int kStallRun = 20;
+    int runs = 0;
+    double lateAfterStall = 1.0;
+    std::shared_ptr<TimerHandler> repeat;
+    repeat = loop->addTimer([&]() {
+        ++runs;
+        double late = timeDifference(MonotonicTime::now(), repeat->expiration());
+        if (runs == kStallRun)
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        else if (runs > kStallRun)
+            lateAfterStall = std::min(lateAfterStall, late);
+    }, addTime(MonotonicTime::now(), 0.001), 0.001);
+    loop->addTimer([&]() { loop->endLoop(); }, addTime(MonotonicTime::now(), 0.3));
+    loop->loop();
+    repeat->disable();
+    EXPECT_GT(runs, kStallRun);
+    // Reloaded by the interval it stays 40 ticks late when the wheel fires it once per tick
+    EXPECT_LT(lateAfterStall, 0.01);
+}
+
+// cancel() takes the timer out of the heap at once, nothing is kept until its expiration
+TEST_F(TimerTest, CancelReleasesTimer) {
+    bool fired = false;
+    auto far = loop_->addTimer([&fired]() { fired = true; }, futureTime(10.0));
+    auto repeat = loop_->addTimer([&fired]() { fired = true; }, futureTime(10.0), 1.0);
+    loop_->addTimer([&]() {
+        EXPECT_EQ(far.use_count(), 2);
+        far->cancel();
+        repeat->cancel();
+        EXPECT_EQ(far.use_count(), 1);
+        EXPECT_EQ(repeat.use_count(), 1);
+        loop_->endLoop();
+    }, futureTime(0.01));
+    loop_->loop();
+    EXPECT_FALSE(fired);
+}
+
+TEST_F(TimerTest, Reschedule) {
+    std::vector<int> order;
+    auto first = loop_->addTimer([&order]() { order.push_back(1); }, futureTime(0.01));
+    auto second = loop_->addTimer([&order]() { order.push_back(2); }, futureTime(0.02));
+    auto moved = loop_->addTimer([&order]() { order.push_back(3); }, futureTime(10.0));
+    loop_->addTimer([&]() { loop_->endLoop(); }, futureTime(0.05));
+    // Before the timers are queued, and after
+    moved->reschedule(futureTime(0.015));
+    loop_->runInLoop([&]() {
+        second->reschedule(futureTime(0.005));
+        first->reschedule(futureTime(0.03));
+    });
+    loop_->loop();
+    EXPECT_EQ(order, std::vector<int>({2, 3, 1}));
+}
+
+TEST_F(TimerTest, WheelReschedule) {
+    auto loop = createWheelLoop(0.001);
+    std::vector<int> order;
+    auto first = loop->addTimer([&order]() { order.push_back(1); }, futureTime(0.01));
+    auto second = loop->addTimer([&order]() { order.push_back(2); }, futureTime(10.0));
+    loop->addTimer([&]() { loop->endLoop(); }, futureTime(0.05));
+    loop->runInLoop([&]() {
+        second->reschedule(futureTime(0.005));
+        first->reschedule(futureTime(0.03));
+    });
+    loop->loop();
+    EXPECT_EQ(order, std::vector<int>({2, 1}));
+}
+
+// The new expiration replaces the reload by the interval, and a one-shot timer runs once more
+TEST_F(TimerTest, RescheduleFromOwnCallback) {
+    for (int wheel = 0; wheel < 2; ++wheel) {
+        auto loop = wheel ? createWheelLoop(0.001) : EventLoop::create();
+        std::vector<MonotonicTime> repeatRuns, onceRuns;
+        std::shared_ptr<TimerHandler> repeat, once;
+        repeat = loop->addTimer([&]() {
+            repeatRuns.push_back(MonotonicTime::now());
+            if (repeatRuns.size() == 1)
+                repeat->reschedule(addTime(MonotonicTime::now(), 0.01));
+        }, futureTime(0.01), 10.0);
+        once = loop->addTimer([&]() {
+            onceRuns.push_back(MonotonicTime::now());
+            if (onceRuns.size() == 1)
+                once->reschedule(addTime(MonotonicTime::now(), 0.01));
+        }, futureTime(0.01));
+        loop->addTimer([&]() { loop->endLoop(); }, futureTime(0.5));
+        loop->loop();
+        ASSERT_EQ(repeatRuns.size(), 2u);
+        EXPECT_LT(timeDifference(repeatRuns[1], repeatRuns[0]), 0.4);
+        ASSERT_EQ(onceRuns.size(), 2u);
+        EXPECT_LT(timeDifference(onceRuns[1], onceRuns[0]), 0.4);
+        EXPECT_FALSE(once->isRepeat());
+        repeat->cancel();
+    }
+}
+
+// Timers whose slack windows overlap run in one wakeup, and only the first one sets the timerfd
+TEST_F(TimerTest, SlackCoalescesTimers) {
+    std::vector<int64_t> iterations;
+    bool early = false;
+    Timestamp start = Timestamp::now();
+    loop_->runInLoop([&]() {
+        uint64_t updates = loop_->timerfdUpdates();
+        uint64_t avoided = loop_->timerfdUpdatesAvoided();
+        for (int i = 0; i < 10; ++i) {
+            Timestamp when = addTime(start, 0.01 + i * 0.0003);
+            auto timer = loop_->addTimer([&, when]() {
+                iterations.push_back(loop_->iteration());
+                early = early || Timestamp::now() < when;
+            }, when, 0.0, 0.005);
+            EXPECT_DOUBLE_EQ(timer->slack(), 0.005);
+            EXPECT_EQ(timer->deadline().microSeconds() - timer->expiration().microSeconds(), 5000);
+        }
+        // Queued after the timers
+        loop_->queueInLoop([&, updates]() {
+            EXPECT_EQ(loop_->timerfdUpdates(), updates + 1);
+        });
+        // One more for this after the ten ran
+        loop_->addTimer([&, updates, avoided]() {
+            EXPECT_EQ(loop_->timerfdUpdates(), updates + 2);
+            EXPECT_GE(loop_->timerfdUpdatesAvoided(), avoided + 9);
+            loop_->endLoop();
+        }, addTime(start, 0.05));
+    });
+    loop_->loop();
+    ASSERT_EQ(iterations.size(), 10u);
+    EXPECT_EQ(iterations.front(), iterations.back());
+    EXPECT_FALSE(early);
+}
+
+// Slack never delays a timer past its deadline, nor lets another timer fire late
+TEST_F(TimerTest, SlackKeepsDeadlines) {
+    std::vector<int> order;
+    double maxLateness = 0;
+    bool early = false;
+    auto add = [&](int id, double delay, double slack) {
+        Timestamp when = futureTime(delay);
+        loop_->addTimer([&, id, when, slack]() {
+            order.push_back(id);
+            early = early || Timestamp::now() < when;
+            maxLateness = std::max(maxLateness, timeDifference(Timestamp::now(), when) - slack);
+            if (order.size() == 3)
+                loop_->endLoop();
+        }, when, 0.0, slack);
+    };
+    add(1, 0.01, 0.05);
+    add(2, 0.02, 0.0);
+    add(3, 0.03, 0.005);
+    loop_->loop();
+    // The first one is due when the second one fires, but waits for the third one within its window
+    EXPECT_EQ(order, std::vector<int>({2, 3, 1}));
+    EXPECT_FALSE(early);
+    EXPECT_LT(maxLateness, 0.05);
+}
+
+static EventLoopPtr createTimerfdLessLoop(TimerBackend backend) {
+    EventLoop::Options options;
+    options.timers = backend;
+    options.timerfd = false;
+    return EventLoop::create(options);
+}
+
+// Without timerfd the poll waits for the next deadline, timers still run in order and never early
+TEST_F(TimerTest, TimerfdLessTimers) {
+    const TimerBackend backends[] = {TimerBackend::Heap, TimerBackend::Wheel};
+    for (TimerBackend backend : backends) {
+        auto loop = createTimerfdLessLoop(backend);
+        std::vector<int> order;
+        bool early = false;
+        double maxLateness = 0;
+        int ticks = 0;
+        const double delays[] = {0.03, 0.01, 0.02};
+        for (int i = 0; i < 3; ++i) {
+            MonotonicTime when = addTime(MonotonicTime::now(), delays[i]);
+            loop->addTimer([&, i, when]() {
+                order.push_back(i);
+                early = early || MonotonicTime::now() < when;
+                maxLateness = std::max(maxLateness, timeDifference(MonotonicTime::now(), when));
+            }, when);
+        }
+        auto repeat = loop->addTimer([&]() { ++ticks; }, addTime(MonotonicTime::now(), 0.002), 0.002);
+        auto cancelled = loop->addTimer([&]() { order.push_back(-1); }, addTime(MonotonicTime::now(), 0.025));
+        cancelled->cancel();
+        loop->addTimer([&]() {
+            repeat->cancel();
+            loop->endLoop();
+        }, addTime(MonotonicTime::now(), 0.05));
+        loop->loop();
+        EXPECT_EQ(order, std::vector<int>({1, 2, 0}));
+        EXPECT_FALSE(early);
+        EXPECT_LT(maxLateness, 0.05);
+        EXPECT_GE(ticks, 5);
+        EXPECT_EQ(loop->timerfdUpdates(), 0u);
+    }
+}
+
+
+// Precision timers spin to their expiration, they never run early and their lateness is recorded
+TEST_F(TimerTest, PrecisionTimer) {
+    const int kRuns = 50;
+    int runs = 0;
+    bool early = false;
+    std::shared_ptr<TimerHandler> timer;
+    timer = loop_->addPrecisionTimer([&]() {
+        early = early || MonotonicTime::now() < timer->expiration();
+        if (++runs == kRuns) {
+            timer->cancel();
+            loop_->endLoop();
+        }
+    }, addTime(MonotonicTime::now(), 0.005), 0.001);
+    EXPECT_TRUE(timer->isPrecise());
+    EXPECT_DOUBLE_EQ(timer->spin(), 0.00005);
+    loop_->addTimer([]() {}, addTime(MonotonicTime::now(), 0.002));
+    loop_->loop();
+    EXPECT_EQ(runs, kRuns);
+    EXPECT_FALSE(early);
+    EXPECT_EQ(loop_->precisionTimerLateness().count, static_cast<uint64_t>(kRuns));
+    EXPECT_EQ(loop_->timerLateness().count, 1u);
+}
+
+// A precision timer is not rounded to the tick of a wheel
+TEST_F(TimerTest, PrecisionTimerOnWheel) {
+    auto loop = createWheelLoop(0.05);
+    MonotonicTime start = MonotonicTime::now();
+    MonotonicTime ranAt;
+    loop->addTimer([]() {}, addTime(start, 0.01));
+    loop->addPrecisionTimer([&]() {
+        ranAt = MonotonicTime::now();
+        loop->endLoop();
+    }, addTime(start, 0.003));
+    loop->loop();
+    EXPECT_GE(timeDifference(ranAt, start), 0.003);
+    EXPECT_LT(timeDifference(ranAt, start), 0.04);
+}
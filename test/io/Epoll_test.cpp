@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <thread>
 #include <chrono>
+#include <vector>
 
 using namespace Hohnor;
 
@@ -251,6 +252,23 @@ TEST_F(EpollTest, WaitTimeout) {
     EXPECT_FALSE(iter.hasNext());
 }
 
+// Timeouts in microseconds are not rounded down to milliseconds
+TEST_F(EpollTest, PollMicrosTimeout) {
+    Epoll epoll;
+    ASSERT_EQ(epoll.add(pipefd_[0], EPOLLIN), 0);
+    PollEvent *events = NULL;
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(epoll.pollMicros(1500, &events), 0);
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    EXPECT_GE(duration.count(), 1500);
+    EXPECT_LE(duration.count(), 100000);
+
+    ASSERT_EQ(write(pipefd_[1], "x", 1), 1);
+    EXPECT_EQ(epoll.pollMicros(-1, &events), 1);
+    EXPECT_EQ(events[0].data.fd, pipefd_[0]);
+}
+
 TEST_F(EpollTest, WaitWithEvent) {
     Epoll epoll;
     
@@ -423,6 +441,26 @@ TEST_F(EpollTest, DataPointerStorage) {
     EXPECT_EQ(*static_cast<int*>(event.data.ptr), 12345);
 }
 
+TEST_F(EpollTest, DataU64Storage) {
+    Epoll epoll;
+    
+    PollData data;
+    data.u64 = (static_cast<uint64_t>(7) << 32) | 3;
+    ASSERT_EQ(epoll.add(pipefd_[1], EPOLLOUT, data), 0);
+    
+    {
+        auto iter = epoll.wait(1000);
+        ASSERT_EQ(iter.size(), 1);
+        EXPECT_EQ(iter.next().data.u64, data.u64);
+    }
+
+    data.u64 = 42;
+    ASSERT_EQ(epoll.modify(pipefd_[1], EPOLLOUT, data), 0);
+    auto again = epoll.wait(1000);
+    ASSERT_EQ(again.size(), 1);
+    EXPECT_EQ(again.next().data.u64, 42u);
+}
+
 TEST_F(EpollTest, DataFdStorage) {
     Epoll epoll;
     
@@ -523,4 +561,56 @@ TEST_F(EpollTest, WaitWithSignalMask) {
     
     EXPECT_EQ(iter.size(), 1);
     EXPECT_TRUE(iter.hasNext());
-}
\ No newline at end of file
+}
+// Events array doubles when a wait fills it up, and shrinks back when mostly unused
+TEST_F(EpollTest, AdaptiveEventsSize) {
+    Epoll epoll(4);
+    EXPECT_EQ(epoll.eventsSize(), 4);
+
+    std::vector<int> fds;
+    for (int i = 0; i < 10; ++i) {
+        int fds2[2];
+        ASSERT_EQ(pipe(fds2), 0);
+        fds.push_back(fds2[0]);
+        fds.push_back(fds2[1]);
+        // Write ends are always ready
+        ASSERT_EQ(epoll.add(fds2[1], EPOLLOUT), 0);
+    }
+
+    {
+        auto iter = epoll.wait(0);
+        EXPECT_EQ(iter.size(), 4);
+    }
+    {
+        auto iter = epoll.wait(0);
+        EXPECT_EQ(epoll.eventsSize(), 8);
+        EXPECT_EQ(iter.size(), 8);
+    }
+    {
+        auto iter = epoll.wait(0);
+        EXPECT_EQ(epoll.eventsSize(), 16);
+        EXPECT_EQ(iter.size(), 10);
+    }
+
+    // Only one fd stays ready from now on
+    for (size_t i = 1; i < fds.size(); i += 2) {
+        if (i != 1) {
+            ASSERT_EQ(epoll.remove(fds[i]), 0);
+        }
+    }
+    for (size_t i = 0; i < Epoll::kShrinkAfterIdleWaits + 1; ++i) {
+        auto iter = epoll.wait(0);
+        EXPECT_EQ(iter.size(), 1);
+    }
+    EXPECT_EQ(epoll.eventsSize(), 8);
+
+    // Never below the initial size
+    for (size_t i = 0; i < 4 * Epoll::kShrinkAfterIdleWaits; ++i) {
+        auto iter = epoll.wait(0);
+    }
+    EXPECT_EQ(epoll.eventsSize(), 4);
+
+    for (int fd : fds) {
+        close(fd);
+    }
+}
@@ -0,0 +1,168 @@
+#include "hohnor/io/IOUring.h"
+#include "hohnor/io/Epoll.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <memory>
+
+using namespace Hohnor;
+
+class IOUringTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, socketfd_), 0);
+        ring_.reset(new IOUring(64));
+        if (!ring_->valid())
+            GTEST_SKIP() << "io_uring is not supported";
+    }
+
+    void TearDown() override {
+        ring_.reset();
+        if (socketfd_[0] != -1) ::close(socketfd_[0]);
+        if (socketfd_[1] != -1) ::close(socketfd_[1]);
+    }
+
+    int socketfd_[2];
+    std::unique_ptr<IOUring> ring_;
+};
+
+TEST_F(IOUringTest, Backend) {
+    EXPECT_EQ(ring_->backend(), PollerBackend::IOUring);
+    EXPECT_STREQ(pollerBackendName(ring_->backend()), "io_uring");
+    EXPECT_GE(ring_->fd(), 0);
+}
+
+TEST_F(IOUringTest, AddAndPoll) {
+    int data = 42;
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN, &data), 0);
+    EXPECT_TRUE(fcntl(socketfd_[0], F_GETFL) & O_NONBLOCK);
+
+    PollEvent *events = NULL;
+    EXPECT_EQ(ring_->poll(0, &events), 0);
+
+    ASSERT_EQ(write(socketfd_[1], "x", 1), 1);
+    int n = ring_->poll(1000, &events);
+    ASSERT_EQ(n, 1);
+    EXPECT_TRUE(events[0].events & EPOLLIN);
+    EXPECT_EQ(events[0].data.ptr, &data);
+}
+
+TEST_F(IOUringTest, AddTwiceFails) {
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN), 0);
+    EXPECT_EQ(ring_->add(socketfd_[0], EPOLLIN), -1);
+    EXPECT_EQ(errno, EEXIST);
+}
+
+TEST_F(IOUringTest, ModifyAndRemoveUntracked) {
+    EXPECT_EQ(ring_->modify(socketfd_[0], EPOLLIN), -1);
+    EXPECT_EQ(errno, ENOENT);
+    EXPECT_EQ(ring_->remove(socketfd_[0]), -1);
+    EXPECT_EQ(errno, ENOENT);
+}
+
+// Unconsumed data is reported again, as a level-triggered epoll does
+TEST_F(IOUringTest, LevelTriggered) {
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN), 0);
+    ASSERT_EQ(write(socketfd_[1], "x", 1), 1);
+
+    PollEvent *events = NULL;
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    EXPECT_TRUE(events[0].events & EPOLLIN);
+
+    char c;
+    ASSERT_EQ(read(socketfd_[0], &c, 1), 1);
+    EXPECT_EQ(ring_->poll(0, &events), 0);
+    EXPECT_EQ(ring_->poll(10, &events), 0);
+}
+
+TEST_F(IOUringTest, Modify) {
+    int data = 1;
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN, &data), 0);
+    PollEvent *events = NULL;
+    EXPECT_EQ(ring_->poll(0, &events), 0);
+
+    // Socket is writable, switching to EPOLLOUT replaces the in flight poll
+    int other = 2;
+    ASSERT_EQ(ring_->modify(socketfd_[0], EPOLLOUT, &other), 0);
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    EXPECT_TRUE(events[0].events & EPOLLOUT);
+    EXPECT_FALSE(events[0].events & EPOLLIN);
+    EXPECT_EQ(events[0].data.ptr, &other);
+
+    // Modify after the poll fired takes effect on re-arm
+    ASSERT_EQ(ring_->modify(socketfd_[0], EPOLLIN, &data), 0);
+    EXPECT_EQ(ring_->poll(10, &events), 0);
+    ASSERT_EQ(write(socketfd_[1], "x", 1), 1);
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    EXPECT_TRUE(events[0].events & EPOLLIN);
+    EXPECT_EQ(events[0].data.ptr, &data);
+}
+
+// Completion of a removed poll is never reported, even if fd is added again
+TEST_F(IOUringTest, RemoveDropsStaleCompletions) {
+    int data = 1;
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN, &data), 0);
+    ASSERT_EQ(write(socketfd_[1], "x", 1), 1);
+    ASSERT_EQ(ring_->remove(socketfd_[0]), 0);
+
+    PollEvent *events = NULL;
+    EXPECT_EQ(ring_->poll(10, &events), 0);
+
+    int other = 2;
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN, &other), 0);
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    EXPECT_EQ(events[0].data.ptr, &other);
+}
+
+TEST_F(IOUringTest, HangUp) {
+    ASSERT_EQ(ring_->add(socketfd_[0], EPOLLIN | EPOLLRDHUP), 0);
+    ::close(socketfd_[1]);
+    socketfd_[1] = -1;
+    PollEvent *events = NULL;
+    ASSERT_EQ(ring_->poll(1000, &events), 1);
+    EXPECT_TRUE(events[0].events & EPOLLRDHUP);
+}
+
+// Interest changes ride on the wait, each poll() costs one io_uring_enter
+TEST_F(IOUringTest, BatchedSubmission) {
+    int fds[8][2];
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]), 0);
+        ASSERT_EQ(ring_->add(fds[i][0], EPOLLIN), 0);
+    }
+    EXPECT_EQ(ring_->syscalls(), 0);
+    PollEvent *events = NULL;
+    EXPECT_EQ(ring_->poll(0, &events), 0);
+    EXPECT_EQ(ring_->syscalls(), 1);
+
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQ(write(fds[i][1], "x", 1), 1);
+    }
+    int total = 0;
+    while (total < 8) {
+        int n = ring_->poll(1000, &events);
+        ASSERT_GT(n, 0);
+        total += n;
+    }
+    EXPECT_EQ(total, 8);
+    for (int i = 0; i < 8; ++i) {
+        ring_->remove(fds[i][0]);
+        ::close(fds[i][0]);
+        ::close(fds[i][1]);
+    }
+}
+
+TEST(PollerTest, CreateBackend) {
+    std::unique_ptr<Poller> epoll(Poller::create(PollerBackend::Epoll));
+    EXPECT_EQ(epoll->backend(), PollerBackend::Epoll);
+    EXPECT_STREQ(pollerBackendName(epoll->backend()), "epoll");
+
+    // Falls back to epoll if io_uring is not available
+    std::unique_ptr<Poller> uring(Poller::create(PollerBackend::IOUring));
+    IOUring probe(8);
+    EXPECT_EQ(uring->backend(), probe.valid() ? PollerBackend::IOUring : PollerBackend::Epoll);
+}
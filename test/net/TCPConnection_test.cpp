@@ -0,0 +1,478 @@
+#include "hohnor/net/TCPConnection.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/core/IOHandler.h"
+#include "hohnor/core/Timer.h"
+#include "hohnor/time/MonotonicTime.h"
+#include <gtest/gtest.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Hohnor;
+
+class TCPConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        loop_ = EventLoop::create();
+        expected_ = 0;
+    }
+
+    void TearDown() override {
+        server_.reset();
+        client_.reset();
+        loop_.reset();
+    }
+
+    // Connect server_ and client_ over a socketpair, the client appends what arrives to received_ and ends the
+    // loop once expected_ bytes are there. In the loop thread
+    void connect() {
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds), 0);
+        server_ = TCPConnection::create(loop_->handleIO(fds[0]));
+        client_ = TCPConnection::create(loop_->handleIO(fds[1]));
+        client_->setReadCompleteCallback([this](TCPConnectionPtr conn) {
+            received_.append(conn->getReadBuffer().retrieveAllAsString());
+            if (received_.size() >= expected_)
+                loop_->endLoop();
+        });
+        client_->readRaw();
+    }
+
+    // Run the loop until expected_ bytes arrived, or it took too long
+    void run(double timeout = 10.0) {
+        loop_->addTimer([this]() { loop_->endLoop(); }, addTime(MonotonicTime::now(), timeout));
+        loop_->loop();
+    }
+
+    static std::string pattern(size_t len, char first = 'a') {
+        std::string s(len, '\0');
+        for (size_t i = 0; i < len; ++i)
+            s[i] = static_cast<char>(first + i % 23);
+        return s;
+    }
+
+    // An unlinked temporary file holding content
+    static int tempFile(const std::string &content) {
+        char path[] = "/tmp/TCPConnectionTestXXXXXX";
+        int fd = ::mkstemp(path);
+        EXPECT_GE(fd, 0);
+        ::unlink(path);
+        EXPECT_EQ(::write(fd, content.data(), content.size()), static_cast<ssize_t>(content.size()));
+        return fd;
+    }
+
+    EventLoopPtr loop_;
+    TCPConnectionPtr server_;
+    TCPConnectionPtr client_;
+    std::string received_;
+    size_t expected_;
+};
+
+// --- Reads ---
+
+// A request is complete once its delimiter arrived, also when the delimiter is split between two reads
+TEST_F(TCPConnectionTest, ReadUntilSplitAcrossReads) {
+    const char *pieces[] = {"GET /one HTTP/1.1\r\nHost: a\r\n\r", "\n", "GET /two HTTP/1.1\r\n", "\r\n"};
+    std::vector<std::string> requests;
+    loop_->runInLoop([&]() {
+        connect();
+        server_->setReadCompleteCallback([&](TCPConnectionPtr conn) {
+            // Pieces of a loaded run may come in one read, with both requests
+            Buffer &buffer = conn->getReadBuffer();
+            std::string bytes(buffer.peek(), buffer.readableBytes());
+            size_t end;
+            while ((end = bytes.find("\r\n\r\n")) != std::string::npos) {
+                requests.push_back(bytes.substr(0, end + 4));
+                buffer.retrieve(end + 4);
+                bytes.erase(0, end + 4);
+            }
+            if (requests.size() == 2)
+                loop_->endLoop();
+        });
+        server_->readUntil("\r\n\r\n");
+        // Apart in time so each piece is a read of its own
+        for (int i = 0; i < 4; ++i) {
+            std::string piece = pieces[i];
+            loop_->addTimer([this, piece]() { client_->write(piece); }, addTime(loop_->now(), 0.01 * (i + 1)));
+        }
+    });
+    run();
+    ASSERT_EQ(requests.size(), 2u);
+    EXPECT_EQ(requests[0], "GET /one HTTP/1.1\r\nHost: a\r\n\r\n");
+    EXPECT_EQ(requests[1], "GET /two HTTP/1.1\r\n\r\n");
+}
+
+// --- Writes from other threads ---
+
+// Each overload hands its bytes to the outbound queue, they arrive in the order written
+TEST_F(TCPConnectionTest, WriteOverloadsFromOtherThread) {
+    auto shared = std::make_shared<const std::string>("shared;");
+    std::string copied = "copied;";
+    std::string expected = "owned;buffer;shared;copied;head+tail;piece;";
+    Buffer buffer;
+    buffer.append("buffer;", 7);
+    expected_ = expected.size();
+    std::thread writer;
+    loop_->runInLoop([&]() {
+        connect();
+        writer = std::thread([&]() {
+            server_->write(std::string("owned;"));
+            server_->write(std::move(buffer));
+            server_->write(shared);
+            server_->write(copied);
+            StringPiece parts[] = {StringPiece("head+"), StringPiece("tail;")};
+            server_->writev(parts, 2);
+            server_->write(StringPiece("piece;"));
+            // Reused at once, the bytes were copied
+            copied.assign("changed");
+        });
+    });
+    run();
+    writer.join();
+    EXPECT_EQ(received_, expected);
+    // The moved from buffer holds no storage, the shared bytes are let go once written
+    EXPECT_EQ(buffer.readableBytes(), 0u);
+    EXPECT_EQ(buffer.capacity(), 0u);
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+// Queued while the loop is busy, several times what one flush takes. The flush queues itself again until the
+// bytes are all out
+TEST_F(TCPConnectionTest, OutboundRequeuesPastBatch) {
+    const int kMessages = 5000;
+    std::string expected;
+    for (int i = 0; i < kMessages; ++i)
+        expected += std::to_string(i) + "\n";
+    expected_ = expected.size();
+    loop_->runInLoop([this, kMessages]() {
+        connect();
+        std::thread writer([this, kMessages]() {
+            for (int i = 0; i < kMessages; ++i)
+                server_->write(std::to_string(i) + "\n");
+        });
+        writer.join();
+    });
+    run();
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// Many more messages than one flush takes, from threads racing the loop clearing outboundScheduled_. Each one
+// arrives once, in the order of its thread
+TEST_F(TCPConnectionTest, OutboundKeepsOrderAcrossBatches) {
+    const int kThreads = 3;
+    const int kMessages = 20000;
+    for (int t = 0; t < kThreads; ++t) {
+        for (int i = 0; i < kMessages; ++i)
+            expected_ += std::to_string(t).size() + std::to_string(i).size() + 2;
+    }
+    std::vector<std::thread> writers;
+    loop_->runInLoop([&]() {
+        connect();
+        for (int t = 0; t < kThreads; ++t) {
+            writers.emplace_back([this, t, kMessages]() {
+                for (int i = 0; i < kMessages; ++i) {
+                    std::string message = std::to_string(t) + ":" + std::to_string(i) + "\n";
+                    if (t == 0) {
+                        server_->write(std::move(message));
+                    }
+                    else if (t == 1) {
+                        Buffer buffer(0);
+                        buffer.append(message);
+                        server_->write(std::move(buffer));
+                    }
+                    else {
+                        server_->write(std::make_shared<const std::string>(message));
+                    }
+                    // Let the loop drain the queue now and then, so pushes meet the flag being handed off
+                    if (i % 500 == 0)
+                        std::this_thread::yield();
+                }
+            });
+        }
+    });
+    run();
+    for (auto &writer : writers)
+        writer.join();
+    ASSERT_EQ(received_.size(), expected_);
+    int next[kThreads] = {0};
+    size_t pos = 0;
+    while (pos < received_.size()) {
+        size_t end = received_.find('\n', pos);
+        ASSERT_NE(end, std::string::npos);
+        size_t colon = received_.find(':', pos);
+        int t = std::stoi(received_.substr(pos, colon - pos));
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, kThreads);
+        ASSERT_EQ(std::stoi(received_.substr(colon + 1, end - colon - 1)), next[t]) << "thread " << t;
+        ++next[t];
+        pos = end + 1;
+    }
+    for (int t = 0; t < kThreads; ++t)
+        EXPECT_EQ(next[t], kMessages);
+}
+
+// A file sent from another thread ends the writev run of the bytes queued before it, the bytes after it start
+// the next one
+TEST_F(TCPConnectionTest, OutboundFilesSplitWritevRuns) {
+    const std::string content = pattern(10000, 'A');
+    int fd = tempFile(content);
+    const int kMessages = 5000;
+    std::string expected;
+    for (int i = 0; i < kMessages; ++i) {
+        expected += std::to_string(i) + "\n";
+        if (i % 700 == 0)
+            expected += content.substr(i % 100, 1000);
+    }
+    expected_ = expected.size();
+    std::thread writer;
+    loop_->runInLoop([&]() {
+        connect();
+        writer = std::thread([&]() {
+            for (int i = 0; i < kMessages; ++i) {
+                server_->write(std::to_string(i) + "\n");
+                if (i % 700 == 0)
+                    server_->sendFile(fd, i % 100, 1000);
+            }
+        });
+    });
+    run();
+    writer.join();
+    ::close(fd);
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// A staged write and a shutdown from the thread that queued more than one flush takes come after all of its
+// writes, the peer reads every byte and then the end of the stream
+TEST_F(TCPConnectionTest, ShutdownAfterOutboundFromOtherThread) {
+    const int kMessages = 1100;
+    const std::string expected = std::string(kMessages, 'x') + "end";
+    bool closed = false;
+    loop_->runInLoop([&]() {
+        connect();
+        // Ended by the close, not by the bytes
+        expected_ = expected.size() + 1;
+        client_->setCloseCallback([&]() {
+            closed = true;
+            loop_->endLoop();
+        });
+        // All queued while the loop is busy, so the first flush leaves messages behind
+        std::thread writer([this, kMessages]() {
+            for (int i = 0; i < kMessages; ++i)
+                server_->write(std::string("x"));
+            server_->getWriteBuffer().append("end", 3);
+            server_->write();
+            server_->shutdown();
+        });
+        writer.join();
+    });
+    run();
+    EXPECT_TRUE(closed);
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// --- sendFile ---
+
+// Files queued behind buffered bytes and between writes come out in the order they were sent
+TEST_F(TCPConnectionTest, SendFileInOrderWithWrites) {
+    const std::string content = pattern(3000000, 'A');
+    int fd = tempFile(content);
+    // More than the socket takes, so what follows is queued
+    const std::string big = pattern(2000000);
+    const std::string expected = big + content.substr(5, 1000000) + "mid" + content + std::string(70000, 'm') +
+                                 content.substr(0, 10) + "end";
+    expected_ = expected.size();
+    loop_->runInLoop([&]() {
+        connect();
+        server_->write(big);
+        server_->sendFile(fd, 5, 1000000);
+        server_->write(std::string("mid"));
+        server_->sendFile(fd, 0, content.size());
+        server_->write(std::string(70000, 'm'));
+        server_->sendFile(fd, 0, 10);
+        server_->write(std::string("end"));
+    });
+    run();
+    ::close(fd);
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// The rest of a file shorter than length is skipped, sent directly or queued, and the output goes on
+TEST_F(TCPConnectionTest, SendFileShorterThanLength) {
+    const std::string content = pattern(5000, 'A');
+    int fd = tempFile(content);
+    const std::string big = pattern(2000000);
+    const std::string expected = content + "between" + big + content + "after";
+    expected_ = expected.size();
+    loop_->runInLoop([&]() {
+        connect();
+        server_->sendFile(fd, 0, content.size() + 1000);
+        server_->write(std::string("between"));
+        server_->write(big);
+        server_->sendFile(fd, 0, content.size() + 1000);
+        server_->write(std::string("after"));
+    });
+    run();
+    ::close(fd);
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// Write complete comes once, after the last file segment went out
+TEST_F(TCPConnectionTest, SendFileWriteCompleteAfterLastSegment) {
+    const std::string content = pattern(3000000, 'A');
+    int fd = tempFile(content);
+    const std::string big = pattern(2000000);
+    expected_ = big.size() + 2 * content.size() + 1;
+    int completes = 0;
+    size_t outAtComplete = 0;
+    loop_->runInLoop([&]() {
+        connect();
+        server_->setWriteCompleteCallback([&](TCPConnectionPtr) {
+            ++completes;
+            // Read by the client or waiting in its socket
+            int queued = 0;
+            ::ioctl(client_->fd(), FIONREAD, &queued);
+            outAtComplete = received_.size() + queued;
+        });
+        server_->write(big);
+        server_->sendFile(fd, 0, content.size());
+        server_->write(std::string("|"));
+        server_->sendFile(fd, 0, content.size());
+    });
+    run();
+    ::close(fd);
+    EXPECT_EQ(received_.size(), expected_);
+    EXPECT_EQ(completes, 1);
+    EXPECT_EQ(outAtComplete, expected_);
+}
+
+// The fd is duplicated, the caller closes its own right after the call, in the loop or from another thread
+TEST_F(TCPConnectionTest, SendFileCallerClosesFd) {
+    const std::string content = pattern(1000000, 'A');
+    const std::string big = pattern(2000000);
+    const std::string expected = big + content + "-" + content;
+    expected_ = expected.size();
+    loop_->runInLoop([&]() {
+        connect();
+        server_->write(big);
+        int fd = tempFile(content);
+        server_->sendFile(fd, 0, content.size());
+        ::close(fd);
+        std::thread writer([&]() {
+            server_->write(std::string("-"));
+            int fd = tempFile(content);
+            server_->sendFile(fd, 0, content.size());
+            ::close(fd);
+        });
+        writer.join();
+    });
+    run();
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// --- writev ---
+
+// More parts than IOV_MAX and more bytes than the socket takes. The parts writev(2) took whole are skipped, the
+// one it stopped in is copied from where it stopped, and each byte arrives once
+TEST_F(TCPConnectionTest, WritevPartialWrite) {
+    const std::string header = "HEADER\r\n";
+    const std::string trailer = "\r\nTRAILER";
+    std::vector<std::string> body;
+    for (int i = 0; i < 2000; ++i)
+        body.push_back(pattern(500 + i % 7, static_cast<char>('A' + i % 26)));
+    std::vector<StringPiece> parts;
+    std::string expected = header;
+    parts.push_back(header);
+    for (const std::string &part : body) {
+        parts.push_back(part);
+        expected += part;
+    }
+    parts.push_back(StringPiece());
+    parts.push_back(trailer);
+    expected += trailer;
+    // Once more behind the bytes left of the first
+    expected += expected + "end";
+    expected_ = expected.size();
+    loop_->runInLoop([&]() {
+        connect();
+        server_->writev(parts.data(), parts.size());
+        server_->writev(parts.data(), parts.size());
+        server_->write(std::string("end"));
+    });
+    run();
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// From another thread the parts are gathered before writev returns, the caller may drop them
+TEST_F(TCPConnectionTest, WritevFromOtherThread) {
+    const std::string body = pattern(1000000);
+    const std::string expected = "HEADER\r\n" + body + "\r\nTRAILER" + "next";
+    expected_ = expected.size();
+    std::thread writer;
+    loop_->runInLoop([&]() {
+        connect();
+        writer = std::thread([&]() {
+            {
+                std::string header = "HEADER\r\n";
+                std::string trailer = "\r\nTRAILER";
+                std::string copy = body;
+                server_->writev({header, copy, trailer});
+            }
+            server_->write(std::string("next"));
+        });
+    });
+    run();
+    writer.join();
+    EXPECT_EQ(received_.size(), expected.size());
+    EXPECT_TRUE(received_ == expected);
+}
+
+// --- Idle timeout ---
+
+// A connection that reads or writes nothing for the timeout is closed, one the peer keeps writing to is not
+TEST_F(TCPConnectionTest, IdleTimeout) {
+    EventLoop::Options options;
+    options.idleTick = 0.01;
+    loop_ = EventLoop::create(options);
+    TCPConnectionPtr idle, idlePeer, active, activePeer;
+    MonotonicTime start, idleClosed;
+    bool activeClosed = false;
+    std::shared_ptr<TimerHandler> keepAlive;
+    loop_->runInLoop([&]() {
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds), 0);
+        idle = TCPConnection::create(loop_->handleIO(fds[0]));
+        idlePeer = TCPConnection::create(loop_->handleIO(fds[1]));
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds), 0);
+        active = TCPConnection::create(loop_->handleIO(fds[0]));
+        activePeer = TCPConnection::create(loop_->handleIO(fds[1]));
+
+        start = loop_->now();
+        idle->setCloseCallback([&]() { idleClosed = MonotonicTime::now(); });
+        active->setCloseCallback([&]() { activeClosed = true; });
+        active->setReadCompleteCallback([](TCPConnectionPtr conn) { conn->getReadBuffer().retrieveAll(); });
+        idle->readRaw();
+        active->readRaw();
+        idle->setIdleTimeout(0.1);
+        active->setIdleTimeout(0.1);
+        keepAlive = loop_->addTimer([&]() { activePeer->write(std::string("ping")); }, addTime(start, 0.02), 0.02);
+        loop_->addTimer([&]() { loop_->endLoop(); }, addTime(start, 0.4));
+    });
+    loop_->loop();
+    keepAlive->cancel();
+    ASSERT_TRUE(idleClosed.valid());
+    EXPECT_GE(timeDifference(idleClosed, start), 0.1);
+    EXPECT_LT(timeDifference(idleClosed, start), 0.3);
+    EXPECT_FALSE(activeClosed);
+}
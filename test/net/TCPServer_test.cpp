@@ -0,0 +1,140 @@
+#include "hohnor/net/TCPServer.h"
+#include "hohnor/core/EventLoop.h"
+#include "hohnor/thread/Mutex.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Hohnor;
+
+namespace
+{
+    // Blocking client, connect to port on loopback, send request and read as many bytes back
+    std::string request(uint16_t port, const std::string &request) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::string reply;
+        if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+            ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            char buf[256];
+            while (reply.size() < request.size()) {
+                ssize_t n = ::read(fd, buf, sizeof buf);
+                if (n <= 0)
+                    break;
+                reply.append(buf, n);
+            }
+        }
+        ::close(fd);
+        return reply;
+    }
+} // namespace
+
+// Connections are spread over the IO loops round robin, and every callback of a connection runs in the thread of
+// the loop it was given
+TEST(TCPServerTest, ConnectionsRunInTheirLoops) {
+    const int kLoops = 3;
+    const int kConnections = 6;
+    auto base = EventLoop::create();
+    auto server = TCPServer::create(base, InetAddress(0, true));
+    server->setLoopNum(kLoops);
+
+    Mutex mutex;
+    std::set<TCPConnectionPtr> connections;
+    std::map<EventLoop *, int> perLoop;
+    std::atomic<int> wrongThread(0);
+    std::atomic<int> closed(0);
+    server->setConnectionCallback([&](TCPConnectionPtr conn) {
+        EventLoop *loop = conn->loop().get();
+        if (EventLoop::loopOfCurrentThread() != loop)
+            ++wrongThread;
+        {
+            MutexGuard guard(mutex);
+            connections.insert(conn);
+            ++perLoop[loop];
+        }
+        std::weak_ptr<TCPConnection> weakConn(conn);
+        conn->setReadCompleteCallback([&, loop](TCPConnectionPtr conn) {
+            if (EventLoop::loopOfCurrentThread() != loop)
+                ++wrongThread;
+            conn->write(conn->getReadBuffer().retrieveAllAsString());
+        });
+        conn->setCloseCallback([&, loop, weakConn]() {
+            if (EventLoop::loopOfCurrentThread() != loop)
+                ++wrongThread;
+            MutexGuard guard(mutex);
+            connections.erase(weakConn.lock());
+            ++closed;
+        });
+        conn->readRaw();
+    });
+    server->start();
+    uint16_t port = InetAddress(SocketFuncs::getLocalAddr(server->acceptor()->fd())).port();
+
+    std::vector<std::string> replies;
+    std::thread client([&]() {
+        for (int i = 0; i < kConnections; ++i)
+            replies.push_back(request(port, "hello " + std::to_string(i)));
+        // The servers see the clients close in their own time
+        for (int i = 0; i < 1000 && closed < kConnections; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        base->endLoop();
+    });
+    base->loop();
+    client.join();
+    server->stop();
+
+    ASSERT_EQ(replies.size(), static_cast<size_t>(kConnections));
+    for (int i = 0; i < kConnections; ++i)
+        EXPECT_EQ(replies[i], "hello " + std::to_string(i));
+    EXPECT_EQ(wrongThread.load(), 0);
+    EXPECT_EQ(closed.load(), kConnections);
+    EXPECT_TRUE(connections.empty());
+    ASSERT_EQ(perLoop.size(), static_cast<size_t>(kLoops));
+    for (auto &loop : perLoop) {
+        EXPECT_NE(loop.first, base.get());
+        EXPECT_EQ(loop.second, kConnections / kLoops);
+    }
+}
+
+// Without IO loops connections stay in the base loop, like a bare TCPAcceptor
+TEST(TCPServerTest, NoLoopsKeepsBaseLoop) {
+    auto base = EventLoop::create();
+    auto server = TCPServer::create(base, InetAddress(0, true));
+    std::atomic<int> inBase(0);
+    std::vector<TCPConnectionPtr> connections;
+    server->setConnectionCallback([&](TCPConnectionPtr conn) {
+        if (conn->loop() == base && EventLoop::loopOfCurrentThread() == base.get())
+            ++inBase;
+        connections.push_back(conn);
+        conn->setReadCompleteCallback([](TCPConnectionPtr conn) {
+            conn->write(conn->getReadBuffer().retrieveAllAsString());
+        });
+        conn->readRaw();
+    });
+    server->start();
+    uint16_t port = InetAddress(SocketFuncs::getLocalAddr(server->acceptor()->fd())).port();
+    std::string reply;
+    std::thread client([&]() {
+        reply = request(port, "ping");
+        base->endLoop();
+    });
+    base->loop();
+    client.join();
+    server->stop();
+    connections.clear();
+    EXPECT_EQ(reply, "ping");
+    EXPECT_EQ(inBase.load(), 1);
+}
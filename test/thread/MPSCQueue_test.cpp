@@ -0,0 +1,200 @@
+#include "hohnor/thread/MPSCQueue.h"
+#include "hohnor/thread/Thread.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <functional>
+
+using namespace Hohnor;
+
+class MPSCQueueTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        // Setup code if needed
+    }
+
+    void TearDown() override
+    {
+        // Cleanup code if needed
+    }
+};
+
+// Test basic push and pop operations
+TEST_F(MPSCQueueTest, BasicPushPop)
+{
+    MPSCQueue<int> queue;
+    EXPECT_TRUE(queue.empty());
+
+    int value = 0;
+    EXPECT_FALSE(queue.pop(value));
+
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+    EXPECT_FALSE(queue.empty());
+
+    for (int i = 1; i <= 3; ++i)
+    {
+        ASSERT_TRUE(queue.pop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop(value));
+}
+
+// Test move-only style usage with strings
+TEST_F(MPSCQueueTest, MoveSemantics)
+{
+    MPSCQueue<std::string> queue;
+    std::string s("hello");
+    queue.push(std::move(s));
+    queue.push(std::string("world"));
+
+    std::string out;
+    ASSERT_TRUE(queue.pop(out));
+    EXPECT_EQ(out, "hello");
+    ASSERT_TRUE(queue.pop(out));
+    EXPECT_EQ(out, "world");
+}
+
+// popAll only consumes elements pushed before the call
+TEST_F(MPSCQueueTest, PopAllSnapshot)
+{
+    MPSCQueue<std::function<void()>> queue;
+    std::vector<int> order;
+    queue.push([&]() {
+        order.push_back(1);
+        // Pushed from the consumer itself, must not run in this round
+        queue.push([&]() { order.push_back(3); });
+    });
+    queue.push([&]() { order.push_back(2); });
+
+    size_t n = queue.popAll([](std::function<void()> &f) { f(); });
+    EXPECT_EQ(n, 2);
+    EXPECT_EQ(order, std::vector<int>({1, 2}));
+    EXPECT_FALSE(queue.empty());
+
+    n = queue.popAll([](std::function<void()> &f) { f(); });
+    EXPECT_EQ(n, 1);
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.popAll([](std::function<void()> &f) { f(); }), 0);
+}
+
+// pushLocal keeps the same order and snapshot semantics as push
+TEST_F(MPSCQueueTest, PushLocal)
+{
+    MPSCQueue<std::function<void()>> queue;
+    std::vector<int> order;
+    queue.pushLocal([&]() {
+        order.push_back(1);
+        queue.pushLocal([&]() { order.push_back(3); });
+    });
+    queue.pushLocal([&]() { order.push_back(2); });
+
+    EXPECT_EQ(queue.popAll([](std::function<void()> &f) { f(); }), 2);
+    EXPECT_EQ(order, std::vector<int>({1, 2}));
+    EXPECT_FALSE(queue.empty());
+    EXPECT_EQ(queue.popAll([](std::function<void()> &f) { f(); }), 1);
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+    EXPECT_TRUE(queue.empty());
+}
+
+// popWhile stops after the element f rejects, the rest stays queued in order
+TEST_F(MPSCQueueTest, PopWhile)
+{
+    MPSCQueue<int> queue;
+    for (int i = 0; i < 5; ++i)
+        queue.push(i);
+    std::vector<int> popped;
+    size_t n = queue.popWhile([&](int &x) {
+        popped.push_back(x);
+        return x < 1;
+    });
+    EXPECT_EQ(n, 2);
+    EXPECT_EQ(popped, std::vector<int>({0, 1}));
+
+    n = queue.popWhile([&](int &x) {
+        popped.push_back(x);
+        return true;
+    });
+    EXPECT_EQ(n, 3);
+    EXPECT_EQ(popped, std::vector<int>({0, 1, 2, 3, 4}));
+    EXPECT_TRUE(queue.empty());
+}
+
+// Elements left in queue are released on clear and destruction
+TEST_F(MPSCQueueTest, ReleaseElements)
+{
+    auto resource = std::make_shared<int>(42);
+    {
+        MPSCQueue<std::shared_ptr<int>> queue;
+        queue.push(resource);
+        queue.push(resource);
+        EXPECT_EQ(resource.use_count(), 3);
+
+        std::shared_ptr<int> out;
+        ASSERT_TRUE(queue.pop(out));
+        out.reset();
+        // Popped value must not be kept by the queue
+        EXPECT_EQ(resource.use_count(), 2);
+
+        queue.push(resource);
+        queue.clear();
+        EXPECT_EQ(resource.use_count(), 1);
+        EXPECT_TRUE(queue.empty());
+
+        queue.push(resource);
+    }
+    EXPECT_EQ(resource.use_count(), 1);
+}
+
+// Test multiple producers with single consumer, every element is seen once and per-producer order is kept
+TEST_F(MPSCQueueTest, MultipleProducers)
+{
+    const int kProducers = 4;
+    const int kItemsPerProducer = 50000;
+    MPSCQueue<std::pair<int, int>> queue;
+    std::atomic<int> done(0);
+
+    std::vector<std::unique_ptr<Thread>> producers;
+    for (int p = 0; p < kProducers; ++p)
+    {
+        producers.emplace_back(new Thread([&queue, &done, p, kItemsPerProducer]() {
+            for (int i = 0; i < kItemsPerProducer; ++i)
+            {
+                queue.push(std::make_pair(p, i));
+            }
+            done++;
+        }));
+        producers.back()->start();
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int received = 0;
+    bool ordered = true;
+    while (received < kProducers * kItemsPerProducer)
+    {
+        received += static_cast<int>(queue.popAll([&](std::pair<int, int> &item) {
+            if (item.second != next[item.first])
+                ordered = false;
+            next[item.first] = item.second + 1;
+        }));
+    }
+
+    for (auto &t : producers)
+    {
+        t->join();
+    }
+    EXPECT_EQ(done.load(), kProducers);
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(queue.empty());
+    for (int p = 0; p < kProducers; ++p)
+    {
+        EXPECT_EQ(next[p], kItemsPerProducer);
+    }
+}
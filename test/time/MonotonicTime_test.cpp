@@ -0,0 +1,50 @@
+#include "hohnor/time/MonotonicTime.h"
+#include <gtest/gtest.h>
+
+using namespace Hohnor;
+
+TEST(MonotonicTimeTest, DefaultConstructor) {
+    MonotonicTime t;
+    ASSERT_FALSE(t.valid());
+    ASSERT_FALSE(MonotonicTime::invalid().valid());
+}
+
+TEST(MonotonicTimeTest, NowNeverGoesBack) {
+    MonotonicTime first = MonotonicTime::now();
+    ASSERT_TRUE(first.valid());
+    MonotonicTime last = first;
+    for (int i = 0; i < 1000; ++i) {
+        MonotonicTime t = MonotonicTime::now();
+        ASSERT_GE(t, last);
+        last = t;
+    }
+}
+
+// The coarse clock is the same clock, behind by less than a few kernel ticks
+TEST(MonotonicTimeTest, Coarse) {
+    MonotonicTime precise = MonotonicTime::now();
+    MonotonicTime coarse = MonotonicTime::nowCoarse();
+    ASSERT_TRUE(coarse.valid());
+    EXPECT_LT(timeDifference(precise, coarse), 0.05);
+    EXPECT_GT(timeDifference(precise, coarse), -0.05);
+}
+
+TEST(MonotonicTimeTest, Arithmetic) {
+    MonotonicTime t(1000000);
+    MonotonicTime later = addTime(t, 1.5);
+    EXPECT_EQ(later.microSeconds(), 2500000);
+    EXPECT_NEAR(timeDifference(later, t), 1.5, 1e-9);
+    EXPECT_LT(t, later);
+    EXPECT_NE(t, later);
+    EXPECT_EQ(t.toString(), "1.000000");
+}
+
+TEST(MonotonicTimeTest, FromTimestamp) {
+    Timestamp when = addTime(Timestamp::now(), 10.0);
+    MonotonicTime converted = MonotonicTime::fromTimestamp(when);
+    // Never earlier than the distance from now
+    EXPECT_GE(timeDifference(converted, MonotonicTime::now()), 9.9);
+    EXPECT_LE(timeDifference(converted, MonotonicTime::now()), 10.0);
+    // And back
+    EXPECT_NEAR(timeDifference(converted.toTimestamp(), when), 0.0, 0.01);
+}